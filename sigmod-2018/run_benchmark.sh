@@ -0,0 +1,14 @@
+#!/bin/bash
+# Usage: run_benchmark.sh [workload-dir...] [-- bench options]
+# e.g.   run_benchmark.sh ./workloads/small -- --repeat 5 --baseline baseline.csv
+DIR=$( cd "$( dirname "${BASH_SOURCE[0]}" )" && pwd )
+
+WORKLOADS=()
+while [ $# -gt 0 ] && [ "$1" != "--" ]; do
+    WORKLOADS+=("$1")
+    shift
+done
+[ "$1" == "--" ] && shift
+[ ${#WORKLOADS[@]} -eq 0 ] && WORKLOADS=("$DIR/workloads/small")
+
+$DIR/build/bench "$@" "${WORKLOADS[@]}"
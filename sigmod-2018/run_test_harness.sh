@@ -8,4 +8,4 @@ cd $WORKLOAD_DIR
 
 WORKLOAD=$(basename "$PWD")
 echo execute $WORKLOAD ...
-$DIR/build/harness *.init *.work *.result ../../run.sh
+$DIR/build/harness ${TRACE:+--trace "$TRACE"} *.init *.work *.result ../../run.sh
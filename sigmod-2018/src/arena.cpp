@@ -0,0 +1,48 @@
+#include "arena.h"
+
+#include <cstdlib>
+
+namespace {
+
+// The free blocks of a thread
+struct BlockPool {
+    std::vector<char *> blocks;
+
+    ~BlockPool() {
+        for (auto *block: blocks) {
+            free(block);
+        }
+    }
+};
+
+thread_local BlockPool pool;
+
+}
+
+// Return the blocks to the pool
+Arena::~Arena() {
+    for (auto *block: blocks_) {
+        if (pool.blocks.size() < kMaxPooledBlocks) {
+            pool.blocks.push_back(block);
+        } else {
+            free(block);
+        }
+    }
+}
+
+// Continue in a new block, from the pool if possible
+void Arena::grow() {
+    char *block;
+    if (!pool.blocks.empty()) {
+        block = pool.blocks.back();
+        pool.blocks.pop_back();
+    } else {
+        block = static_cast<char *>(malloc(kBlockSize));
+        if (block == nullptr) {
+            throw std::bad_alloc();
+        }
+    }
+    blocks_.push_back(block);
+    current_ = block;
+    end_ = block + kBlockSize;
+}
@@ -0,0 +1,63 @@
+#include "batch.h"
+
+#include <charconv>
+
+// Set the number of checksums
+void QueryResult::resize(uint32_t num_sums) {
+    count = num_sums;
+    empty = false;
+    if (num_sums > kInlineSums) {
+        overflow = std::make_unique<uint64_t[]>(num_sums);
+    } else {
+        overflow.reset();
+    }
+}
+
+// Append the text format
+void QueryResult::format(std::string &out) const {
+    char number[24];
+    for (uint32_t i = 0; i < count; ++i) {
+        if (i != 0) out += ' ';
+        if (empty) {
+            out += "NULL";
+        } else {
+            auto end = std::to_chars(number, number + sizeof(number), data()[i]).ptr;
+            out.append(number, end);
+        }
+    }
+    out += '\n';
+}
+
+// Add a query
+QueryResult *Batch::add(uint32_t num_selections) {
+    results_.emplace_back().resize(num_selections);
+    size_.fetch_add(1);
+    return &results_.back();
+}
+
+// A query is complete
+void Batch::complete() {
+    // The count is raised under the lock: a waiter that sees the batch
+    // complete may destroy it, so nothing may touch it after the unlock
+    std::lock_guard<std::mutex> lk(m_);
+    if (completed_.fetch_add(1) + 1 == size_.load()) {
+        cv_.notify_all();
+    }
+}
+
+// Wait for all queries
+void Batch::wait() {
+    std::unique_lock<std::mutex> lk(m_);
+    cv_.wait(lk, [&]() { return completed_.load() == size_.load(); });
+}
+
+// Print the batch
+void Batch::print(std::ostream &out) {
+    wait();
+    std::string text;
+    text.reserve(results_.size() * 32);
+    for (auto &result: results_) {
+        result.format(text);
+    }
+    out.write(text.data(), text.size());
+}
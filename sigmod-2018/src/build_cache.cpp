@@ -0,0 +1,62 @@
+#include "build_cache.h"
+
+#include <chrono>
+
+// Get or build a table
+std::shared_ptr<const JoinTable> BuildCache::get(const std::string &key, uint64_t bytes,
+                                                 const std::function<std::shared_ptr<const JoinTable>()> &build) {
+    std::promise<std::shared_ptr<const JoinTable>> promise;
+    {
+        std::unique_lock<std::mutex> lk(m_);
+        auto entry = entries_.find(key);
+        if (entry != entries_.end()) {
+            auto table = entry->second.table;
+            lk.unlock();
+            return table.get();
+        }
+        if (!memory_.tryReserve(bytes)) {
+            // Under memory pressure the old tables go first
+            evict();
+            if (!memory_.tryReserve(bytes)) {
+                return nullptr;
+            }
+        }
+        entries_.emplace(key, Entry{promise.get_future().share(), bytes});
+    }
+    try {
+        auto table = build();
+        promise.set_value(table);
+        return table;
+    } catch (...) {
+        promise.set_exception(std::current_exception());
+        std::lock_guard<std::mutex> lk(m_);
+        memory_.release(bytes);
+        entries_.erase(key);
+        throw;
+    }
+}
+
+// Drop the built tables
+void BuildCache::evict() {
+    for (auto entry = entries_.begin(); entry != entries_.end();) {
+        auto &table = entry->second.table;
+        if (table.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            memory_.release(entry->second.bytes);
+            entry = entries_.erase(entry);
+        } else {
+            ++entry;
+        }
+    }
+}
+
+// Drop all tables
+void BuildCache::clear() {
+    std::lock_guard<std::mutex> lk(m_);
+    evict();
+}
+
+// The number of cached tables
+size_t BuildCache::size() {
+    std::lock_guard<std::mutex> lk(m_);
+    return entries_.size();
+}
@@ -0,0 +1,426 @@
+#include "bulk_loader.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <thread>
+#include <unistd.h>
+
+#include <linux/io_uring.h>
+
+namespace {
+
+/// The bytes before the columns in a relation file: the number of rows and of columns
+constexpr uint64_t kHeaderBytes = 2 * sizeof(uint64_t);
+
+/// An aligned read buffer
+using Buffer = std::unique_ptr<char, decltype(&std::free)>;
+
+// Allocate an aligned read buffer
+Buffer allocateBuffer(uint64_t bytes) {
+    auto *memory = static_cast<char *>(std::aligned_alloc(BulkLoader::kAlignment, bytes));
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return Buffer(memory, &std::free);
+}
+
+/// A minimal io_uring, set up with the raw system calls: reads are prepared
+/// in the submission ring and their results taken from the completion ring
+class Ring {
+private:
+    int fd_ = -1;
+    /// The mappings of the rings and of the submission entries
+    void *sq_ring_ = MAP_FAILED, *cq_ring_ = MAP_FAILED;
+    size_t sq_ring_bytes_ = 0, cq_ring_bytes_ = 0;
+    io_uring_sqe *sqes_ = static_cast<io_uring_sqe *>(MAP_FAILED);
+    size_t sqes_bytes_ = 0;
+    /// The fields of the rings shared with the kernel
+    unsigned *sq_tail_ = nullptr, *sq_mask_ = nullptr, *sq_array_ = nullptr;
+    unsigned *cq_head_ = nullptr, *cq_tail_ = nullptr, *cq_mask_ = nullptr;
+    io_uring_cqe *cqes_ = nullptr;
+    /// The prepared entries not submitted yet
+    unsigned to_submit_ = 0;
+
+public:
+    /// Set up a ring for entries reads in flight, false if the kernel does not allow it
+    bool setup(unsigned entries) {
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+        io_uring_params params{};
+        fd_ = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+        if (fd_ < 0) {
+            return false;
+        }
+        sq_ring_bytes_ = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+        cq_ring_bytes_ = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+        bool single_mmap = params.features & IORING_FEAT_SINGLE_MMAP;
+        if (single_mmap) {
+            sq_ring_bytes_ = cq_ring_bytes_ = std::max(sq_ring_bytes_, cq_ring_bytes_);
+        }
+        sq_ring_ = mmap(nullptr, sq_ring_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                        fd_, IORING_OFF_SQ_RING);
+        if (sq_ring_ == MAP_FAILED) {
+            return false;
+        }
+        if (single_mmap) {
+            cq_ring_ = sq_ring_;
+        } else {
+            cq_ring_ = mmap(nullptr, cq_ring_bytes_, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE,
+                            fd_, IORING_OFF_CQ_RING);
+            if (cq_ring_ == MAP_FAILED) {
+                return false;
+            }
+        }
+        sqes_bytes_ = params.sq_entries * sizeof(io_uring_sqe);
+        sqes_ = static_cast<io_uring_sqe *>(mmap(nullptr, sqes_bytes_, PROT_READ | PROT_WRITE,
+                                                 MAP_SHARED | MAP_POPULATE, fd_, IORING_OFF_SQES));
+        if (sqes_ == MAP_FAILED) {
+            return false;
+        }
+        auto *sq = static_cast<char *>(sq_ring_), *cq = static_cast<char *>(cq_ring_);
+        sq_tail_ = reinterpret_cast<unsigned *>(sq + params.sq_off.tail);
+        sq_mask_ = reinterpret_cast<unsigned *>(sq + params.sq_off.ring_mask);
+        sq_array_ = reinterpret_cast<unsigned *>(sq + params.sq_off.array);
+        cq_head_ = reinterpret_cast<unsigned *>(cq + params.cq_off.head);
+        cq_tail_ = reinterpret_cast<unsigned *>(cq + params.cq_off.tail);
+        cq_mask_ = reinterpret_cast<unsigned *>(cq + params.cq_off.ring_mask);
+        cqes_ = reinterpret_cast<io_uring_cqe *>(cq + params.cq_off.cqes);
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    /// The destructor
+    ~Ring() {
+        if (sqes_ != MAP_FAILED) munmap(sqes_, sqes_bytes_);
+        if (cq_ring_ != MAP_FAILED && cq_ring_ != sq_ring_) munmap(cq_ring_, cq_ring_bytes_);
+        if (sq_ring_ != MAP_FAILED) munmap(sq_ring_, sq_ring_bytes_);
+        if (fd_ >= 0) close(fd_);
+    }
+
+    /// Prepare a read into one buffer
+    void prepareReadv(int fd, const iovec *iov, uint64_t offset, uint64_t user_data) {
+        // Only this thread writes the tail, the kernel reads it
+        unsigned tail = *sq_tail_;
+        unsigned index = tail & *sq_mask_;
+        auto &sqe = sqes_[index];
+        std::memset(&sqe, 0, sizeof(sqe));
+        sqe.opcode = IORING_OP_READV;
+        sqe.fd = fd;
+        sqe.off = offset;
+        sqe.addr = reinterpret_cast<uint64_t>(iov);
+        sqe.len = 1;
+        sqe.user_data = user_data;
+        sq_array_[index] = index;
+        __atomic_store_n(sq_tail_, tail + 1, __ATOMIC_RELEASE);
+        ++to_submit_;
+    }
+
+    /// Submit the prepared reads and wait for at least one completion
+    bool submitAndWait() {
+#if defined(__NR_io_uring_enter)
+        while (true) {
+            long res = syscall(__NR_io_uring_enter, fd_, to_submit_, 1, IORING_ENTER_GETEVENTS, nullptr, 0);
+            if (res >= 0) {
+                to_submit_ -= std::min<unsigned>(to_submit_, res);
+                return true;
+            }
+            if (errno != EINTR) {
+                return false;
+            }
+        }
+#else
+        return false;
+#endif
+    }
+
+    /// Take back the prepared reads the kernel has not seen, returns their number
+    unsigned discardUnsubmitted() {
+        unsigned discarded = to_submit_;
+        __atomic_store_n(sq_tail_, *sq_tail_ - discarded, __ATOMIC_RELEASE);
+        to_submit_ = 0;
+        return discarded;
+    }
+
+    /// Call f(user_data, result) for every completed read
+    template <class F>
+    void reap(F f) {
+        unsigned head = *cq_head_;
+        while (head != __atomic_load_n(cq_tail_, __ATOMIC_ACQUIRE)) {
+            auto &cqe = cqes_[head & *cq_mask_];
+            f(cqe.user_data, cqe.res);
+            ++head;
+        }
+        __atomic_store_n(cq_head_, head, __ATOMIC_RELEASE);
+    }
+};
+
+}
+
+// Parse a load backend
+LoadBackend parseLoadBackend(const std::string &backend) {
+    if (backend == "uring") return LoadBackend::IoUring;
+    if (backend == "threads") return LoadBackend::Threads;
+    return LoadBackend::Auto;
+}
+
+// The name of a backend
+const char *loadBackendName(LoadBackend backend) {
+    switch (backend) {
+        case LoadBackend::IoUring:
+            return "io_uring";
+        case LoadBackend::Threads:
+            return "threads";
+        default:
+            return "auto";
+    }
+}
+
+// A one line summary
+std::string BulkLoader::Report::summary() const {
+    char line[256];
+    snprintf(line, sizeof(line), "read %.1f MiB in %.1f ms, %.1f MiB/s (%s, queue depth %u, %u/%u files direct)",
+             bytes / double(1 << 20), seconds * 1000, megabytesPerSecond(), loadBackendName(backend),
+             queue_depth, direct_files, files);
+    return line;
+}
+
+// The constructor
+BulkLoader::BulkLoader(Options options) : options_(options) {
+    options_.queue_depth = std::max(1u, options_.queue_depth);
+    options_.chunk_bytes = std::max(kAlignment, (options_.chunk_bytes + kAlignment - 1) / kAlignment * kAlignment);
+}
+
+// Load the relations of the files
+std::vector<Relation> BulkLoader::load(const std::vector<std::string> &file_names) {
+    auto start = std::chrono::steady_clock::now();
+    report_ = Report();
+    report_.queue_depth = options_.queue_depth;
+    files_.clear();
+    chunks_.clear();
+
+    std::vector<Relation> relations;
+    // The files point to the relations, they must stay in place
+    relations.reserve(file_names.size());
+    try {
+        for (auto &name: file_names) {
+            File file;
+            file.fd = open(name.c_str(), O_RDONLY | O_CLOEXEC);
+            if (file.fd < 0) {
+                throw std::runtime_error("cannot open " + name);
+            }
+            files_.push_back(file);
+            struct stat sb{};
+            uint64_t header[2];
+            if (fstat(file.fd, &sb) != 0 || pread(file.fd, header, kHeaderBytes, 0) != ssize_t(kHeaderBytes)) {
+                throw std::runtime_error("cannot read " + name);
+            }
+            uint64_t rows = header[0], num_columns = header[1];
+            file.bytes = sb.st_size;
+            if (num_columns > 0 && rows > (file.bytes - kHeaderBytes) / sizeof(uint64_t) / num_columns) {
+                throw std::runtime_error(name + " is not a relation file");
+            }
+            relations.push_back(Relation::allocate(rows, num_columns));
+            file.relation = &relations.back();
+            if (options_.direct) {
+                // Not every file system supports direct I/O, those files are read through the page cache
+                file.direct_fd = open(name.c_str(), O_RDONLY | O_DIRECT | O_CLOEXEC);
+                report_.direct_files += file.direct_fd >= 0;
+            }
+            files_.back() = file;
+
+            uint64_t end = kHeaderBytes + rows * num_columns * sizeof(uint64_t);
+            if (end > kHeaderBytes) {
+                report_.bytes += end;
+                for (uint64_t offset = 0; offset < end; offset += options_.chunk_bytes) {
+                    uint64_t length = std::min(options_.chunk_bytes,
+                                               (end - offset + kAlignment - 1) / kAlignment * kAlignment);
+                    chunks_.push_back({static_cast<unsigned>(files_.size() - 1), offset, length});
+                }
+            }
+        }
+        report_.files = files_.size();
+
+        bool uring = options_.backend != LoadBackend::Threads && readIoUring();
+        if (!uring) {
+            readThreads();
+        }
+        report_.backend = uring ? LoadBackend::IoUring : LoadBackend::Threads;
+    } catch (...) {
+        closeFiles();
+        throw;
+    }
+    closeFiles();
+    report_.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return relations;
+}
+
+// Close the files
+void BulkLoader::closeFiles() {
+    for (auto &file: files_) {
+        if (file.fd >= 0) close(file.fd);
+        if (file.direct_fd >= 0) close(file.direct_fd);
+    }
+    files_.clear();
+}
+
+// Read a chunk with blocking reads
+uint64_t BulkLoader::readChunk(const Chunk &chunk, char *buffer) {
+    auto &file = files_[chunk.file];
+    int fd = file.direct_fd >= 0 ? file.direct_fd : file.fd;
+    ssize_t res;
+    do {
+        res = pread(fd, buffer, chunk.length, chunk.offset);
+    } while (res < 0 && errno == EINTR);
+    // A direct read the file system refuses is done through the page cache
+    if (res < 0 && errno != EINVAL) {
+        throw std::runtime_error(std::string("read failed: ") + strerror(errno));
+    }
+    return completeShortRead(chunk, buffer, std::max<ssize_t>(res, 0));
+}
+
+// Complete a short read
+uint64_t BulkLoader::completeShortRead(const Chunk &chunk, char *buffer, uint64_t done) {
+    auto &file = files_[chunk.file];
+    uint64_t needed = std::min(chunk.length, file.bytes - chunk.offset);
+    // The rest may be unaligned, it is read through the page cache
+    while (done < needed) {
+        ssize_t res = pread(file.fd, buffer + done, needed - done, chunk.offset + done);
+        if (res < 0 && errno == EINTR) continue;
+        if (res <= 0) {
+            throw std::runtime_error(res == 0 ? "unexpected end of file" : strerror(errno));
+        }
+        done += res;
+    }
+    return done;
+}
+
+// Copy the bytes of a chunk into the columns
+void BulkLoader::scatter(const Chunk &chunk, const char *data, uint64_t bytes) {
+    auto &relation = *files_[chunk.file].relation;
+    uint64_t column_bytes = relation.size() * sizeof(uint64_t);
+    for (unsigned c = 0; c < relation.columns().size(); ++c) {
+        uint64_t column_begin = kHeaderBytes + c * column_bytes;
+        uint64_t begin = std::max(chunk.offset, column_begin);
+        uint64_t end = std::min(chunk.offset + bytes, column_begin + column_bytes);
+        if (begin < end) {
+            std::memcpy(reinterpret_cast<char *>(relation.columns()[c]) + (begin - column_begin),
+                        data + (begin - chunk.offset), end - begin);
+        }
+    }
+}
+
+// Read all chunks through io_uring
+bool BulkLoader::readIoUring() {
+    unsigned depth = options_.queue_depth;
+    // The ring goes before the buffers and vectors the kernel reads and writes
+    std::vector<Buffer> buffers;
+    std::vector<iovec> iovecs(depth);
+    Ring ring;
+    if (!ring.setup(depth)) {
+        return false;
+    }
+    std::vector<size_t> slot_chunk(depth);
+    std::vector<unsigned> free_slots;
+    for (unsigned slot = 0; slot < depth; ++slot) {
+        buffers.push_back(allocateBuffer(options_.chunk_bytes));
+        free_slots.push_back(slot);
+    }
+
+    size_t next = 0;
+    unsigned in_flight = 0;
+    std::string error;
+    // After an error the reads in flight are still waited for, they write into the buffers
+    while ((error.empty() && next < chunks_.size()) || in_flight > 0) {
+        while (error.empty() && !free_slots.empty() && next < chunks_.size()) {
+            unsigned slot = free_slots.back();
+            free_slots.pop_back();
+            auto &chunk = chunks_[next];
+            auto &file = files_[chunk.file];
+            slot_chunk[slot] = next++;
+            iovecs[slot] = {buffers[slot].get(), chunk.length};
+            ring.prepareReadv(file.direct_fd >= 0 ? file.direct_fd : file.fd, &iovecs[slot], chunk.offset, slot);
+            ++in_flight;
+        }
+        if (!ring.submitAndWait()) {
+            if (!error.empty()) {
+                // Not even waiting works, the kernel may still write into the
+                // buffers: better leak them than free them
+                new std::vector<Buffer>(std::move(buffers));
+                new std::vector<iovec>(std::move(iovecs));
+                break;
+            }
+            // The reads the kernel took are waited for like after a failed read
+            error = std::string("io_uring_enter failed: ") + strerror(errno);
+            in_flight -= ring.discardUnsubmitted();
+            continue;
+        }
+        ring.reap([&](uint64_t slot, int res) {
+            --in_flight;
+            free_slots.push_back(slot);
+            if (!error.empty()) {
+                return;
+            }
+            try {
+                auto &chunk = chunks_[slot_chunk[slot]];
+                // A direct read the file system refuses is done through the page cache
+                if (res < 0 && res != -EINVAL) {
+                    throw std::runtime_error(std::string("read failed: ") + strerror(-res));
+                }
+                uint64_t done = completeShortRead(chunk, buffers[slot].get(), std::max(res, 0));
+                scatter(chunk, buffers[slot].get(), done);
+            } catch (std::exception &e) {
+                error = e.what();
+            }
+        });
+    }
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+    return true;
+}
+
+// Read all chunks on a pool of threads
+void BulkLoader::readThreads() {
+    std::atomic<size_t> next{0};
+    std::mutex m;
+    std::string error;
+    auto work = [&]() {
+        auto buffer = allocateBuffer(options_.chunk_bytes);
+        for (size_t i = next++; i < chunks_.size(); i = next++) {
+            try {
+                auto &chunk = chunks_[i];
+                scatter(chunk, buffer.get(), readChunk(chunk, buffer.get()));
+            } catch (std::exception &e) {
+                std::lock_guard<std::mutex> lk(m);
+                error = e.what();
+                next = chunks_.size();
+            }
+        }
+    };
+    unsigned num_threads = std::min<size_t>(options_.queue_depth, chunks_.size());
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < num_threads; ++i) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto &t: threads) {
+        t.join();
+    }
+    if (!error.empty()) {
+        throw std::runtime_error(error);
+    }
+}
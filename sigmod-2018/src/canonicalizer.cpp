@@ -0,0 +1,158 @@
+#include "canonicalizer.h"
+
+#include <algorithm>
+#include <map>
+#include <numeric>
+#include <tuple>
+#include <utility>
+
+namespace {
+
+using Signature = std::vector<uint64_t>;
+
+// Number the distinct signatures in their sorted order, which does not depend
+// on the order of the bindings. Returns the number of distinct signatures.
+unsigned rank(const std::vector<Signature> &signatures, std::vector<unsigned> &colours) {
+    std::map<Signature, unsigned> ranks;
+    for (auto &signature: signatures) {
+        ranks.emplace(signature, 0);
+    }
+    unsigned next = 0;
+    for (auto &entry: ranks) {
+        entry.second = next++;
+    }
+    for (unsigned binding = 0; binding < signatures.size(); ++binding) {
+        colours[binding] = ranks[signatures[binding]];
+    }
+    return next;
+}
+
+}
+
+// Canonicalize a query
+CanonicalQuery Canonicalizer::canonicalize(const QueryInfo &query) {
+    auto &rel_ids = query.relation_ids();
+    unsigned num_bindings = rel_ids.size();
+
+    // The signature of a binding without its neighbours: the relation, the
+    // filters and the predicates within the binding
+    std::vector<Signature> signatures(num_bindings);
+    for (unsigned binding = 0; binding < num_bindings; ++binding) {
+        signatures[binding].push_back(rel_ids[binding]);
+    }
+    std::vector<std::tuple<unsigned, char, uint64_t>> filters;
+    for (auto &f: query.filters()) {
+        filters.emplace_back(f.filter_column.col_id, f.comparison, f.constant);
+    }
+    std::vector<unsigned> filter_order(filters.size());
+    std::iota(filter_order.begin(), filter_order.end(), 0);
+    std::sort(filter_order.begin(), filter_order.end(), [&](unsigned a, unsigned b) {
+        return filters[a] < filters[b];
+    });
+    for (auto i: filter_order) {
+        auto &[col_id, comparison, constant] = filters[i];
+        auto &signature = signatures[query.filters()[i].filter_column.binding];
+        signature.insert(signature.end(), {0, col_id, uint64_t(comparison), constant});
+    }
+    std::vector<std::vector<std::pair<unsigned, unsigned>>> self_predicates(num_bindings);
+    for (auto &p: query.predicates()) {
+        if (p.left.binding == p.right.binding) {
+            self_predicates[p.left.binding].emplace_back(std::min(p.left.col_id, p.right.col_id),
+                                                         std::max(p.left.col_id, p.right.col_id));
+        }
+    }
+    for (unsigned binding = 0; binding < num_bindings; ++binding) {
+        auto &pairs = self_predicates[binding];
+        std::sort(pairs.begin(), pairs.end());
+        for (auto &[a, b]: pairs) {
+            signatures[binding].insert(signatures[binding].end(), {1, a, b});
+        }
+    }
+
+    // Refine by the colours of the joined bindings until no class splits
+    std::vector<unsigned> colours(num_bindings);
+    unsigned num_colours = rank(signatures, colours);
+    for (unsigned round = 0; round < num_bindings; ++round) {
+        std::vector<Signature> refined(num_bindings);
+        std::vector<std::vector<std::tuple<unsigned, unsigned, unsigned>>> edges(num_bindings);
+        for (auto &p: query.predicates()) {
+            if (p.left.binding == p.right.binding) continue;
+            edges[p.left.binding].emplace_back(p.left.col_id, p.right.col_id, colours[p.right.binding]);
+            edges[p.right.binding].emplace_back(p.right.col_id, p.left.col_id, colours[p.left.binding]);
+        }
+        for (unsigned binding = 0; binding < num_bindings; ++binding) {
+            refined[binding].push_back(colours[binding]);
+            std::sort(edges[binding].begin(), edges[binding].end());
+            for (auto &[own, other, colour]: edges[binding]) {
+                refined[binding].insert(refined[binding].end(), {own, other, colour});
+            }
+        }
+        unsigned refined_colours = rank(refined, colours);
+        if (refined_colours == num_colours) break;
+        num_colours = refined_colours;
+    }
+
+    // The canonical binding of every binding, ties keep their order
+    std::vector<unsigned> order(num_bindings);
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+        return colours[a] < colours[b];
+    });
+    std::vector<unsigned> mapped(num_bindings);
+    for (unsigned i = 0; i < num_bindings; ++i) {
+        mapped[order[i]] = i;
+    }
+    auto column = [&](const SelectInfo &info) {
+        return std::make_pair(mapped[info.binding], info.col_id);
+    };
+    auto text = [](const std::pair<unsigned, unsigned> &c) {
+        return std::to_string(c.first) + "." + std::to_string(c.second);
+    };
+
+    // The smaller column on the left
+    std::vector<std::pair<std::pair<unsigned, unsigned>, std::pair<unsigned, unsigned>>> predicates;
+    for (auto &p: query.predicates()) {
+        auto left = column(p.left), right = column(p.right);
+        if (right < left) std::swap(left, right);
+        predicates.emplace_back(left, right);
+    }
+    std::sort(predicates.begin(), predicates.end());
+    predicates.erase(std::unique(predicates.begin(), predicates.end()), predicates.end());
+    std::vector<std::tuple<std::pair<unsigned, unsigned>, char, uint64_t>> mapped_filters;
+    for (auto &f: query.filters()) {
+        mapped_filters.emplace_back(column(f.filter_column), f.comparison, f.constant);
+    }
+    std::sort(mapped_filters.begin(), mapped_filters.end());
+    mapped_filters.erase(std::unique(mapped_filters.begin(), mapped_filters.end()), mapped_filters.end());
+    std::vector<std::pair<unsigned, unsigned>> selections;
+    for (auto &s: query.selections()) {
+        selections.push_back(column(s));
+    }
+    std::sort(selections.begin(), selections.end());
+    selections.erase(std::unique(selections.begin(), selections.end()), selections.end());
+
+    CanonicalQuery canonical;
+    for (unsigned i = 0; i < num_bindings; ++i) {
+        canonical.key += (i > 0 ? " " : "") + std::to_string(rel_ids[order[i]]);
+    }
+    canonical.key += "|";
+    bool first = true;
+    for (auto &[left, right]: predicates) {
+        canonical.key += (first ? "" : "&") + text(left) + "=" + text(right);
+        first = false;
+    }
+    for (auto &[c, comparison, constant]: mapped_filters) {
+        canonical.key += (first ? "" : "&") + text(c) + comparison + std::to_string(constant);
+        first = false;
+    }
+    canonical.key += "|";
+    for (unsigned i = 0; i < selections.size(); ++i) {
+        canonical.key += (i > 0 ? " " : "") + text(selections[i]);
+    }
+    for (auto &s: query.selections()) {
+        canonical.selections.push_back(
+                std::lower_bound(selections.begin(), selections.end(), column(s)) - selections.begin());
+    }
+    canonical.query = QueryInfo(canonical.key);
+    return canonical;
+}
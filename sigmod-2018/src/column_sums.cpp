@@ -0,0 +1,103 @@
+#include "column_sums.h"
+
+#include <algorithm>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+namespace ColumnSums {
+
+// Sum one column over the ids in [begin, end)
+static uint64_t sumBlock(const TupleId *ids, uint64_t begin, uint64_t end, const uint64_t *column) {
+    uint64_t acc0 = 0, acc1 = 0, acc2 = 0, acc3 = 0;
+    uint64_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        acc0 += column[ids[i]];
+        acc1 += column[ids[i + 1]];
+        acc2 += column[ids[i + 2]];
+        acc3 += column[ids[i + 3]];
+    }
+    for (; i < end; ++i) {
+        acc0 += column[ids[i]];
+    }
+    return acc0 + acc1 + acc2 + acc3;
+}
+
+// The portable kernel
+void sumScalar(const TupleId *ids, uint64_t count,
+               const uint64_t *const *columns, unsigned num_columns, uint64_t *sums) {
+    for (uint64_t begin = 0; begin < count; begin += kBlockSize) {
+        uint64_t end = std::min(count, begin + kBlockSize);
+        for (unsigned c = 0; c < num_columns; ++c) {
+            sums[c] += sumBlock(ids, begin, end, columns[c]);
+        }
+    }
+}
+
+#if defined(__x86_64__)
+
+// The AVX2 kernel
+__attribute__((target("avx2")))
+void sumAvx2(const TupleId *ids, uint64_t count,
+             const uint64_t *const *columns, unsigned num_columns, uint64_t *sums) {
+    for (uint64_t begin = 0; begin < count; begin += kBlockSize) {
+        uint64_t end = std::min(count, begin + kBlockSize);
+        // Gathers only pay off for clustered ids, like the ascending ids of a
+        // scan or a probe side. The scalar loads of scattered ids (a build side)
+        // overlap their cache misses better.
+        if (ids[end - 1] < ids[begin] || ids[end - 1] - ids[begin] > kClusteredSpread * (end - begin)) {
+            for (unsigned c = 0; c < num_columns; ++c) {
+                sums[c] += sumBlock(ids, begin, end, columns[c]);
+            }
+            continue;
+        }
+        for (unsigned c = 0; c < num_columns; ++c) {
+            auto column = reinterpret_cast<const long long *>(columns[c]);
+            __m256i acc0 = _mm256_setzero_si256(), acc1 = acc0, acc2 = acc0, acc3 = acc0;
+            uint64_t i = begin;
+            for (; i + 16 <= end; i += 16) {
+                auto id = reinterpret_cast<const __m256i *>(ids + i);
+                acc0 = _mm256_add_epi64(acc0, _mm256_i64gather_epi64(column, _mm256_loadu_si256(id), 8));
+                acc1 = _mm256_add_epi64(acc1, _mm256_i64gather_epi64(column, _mm256_loadu_si256(id + 1), 8));
+                acc2 = _mm256_add_epi64(acc2, _mm256_i64gather_epi64(column, _mm256_loadu_si256(id + 2), 8));
+                acc3 = _mm256_add_epi64(acc3, _mm256_i64gather_epi64(column, _mm256_loadu_si256(id + 3), 8));
+            }
+            auto acc = _mm256_add_epi64(_mm256_add_epi64(acc0, acc1), _mm256_add_epi64(acc2, acc3));
+            alignas(32) uint64_t lanes[4];
+            _mm256_store_si256(reinterpret_cast<__m256i *>(lanes), acc);
+            uint64_t sum = lanes[0] + lanes[1] + lanes[2] + lanes[3];
+            for (; i < end; ++i) {
+                sum += column[ids[i]];
+            }
+            sums[c] += sum;
+        }
+    }
+}
+
+// Whether the CPU supports the AVX2 kernel
+bool hasAvx2() {
+    return __builtin_cpu_supports("avx2");
+}
+
+#else
+
+// The AVX2 kernel, not available
+void sumAvx2(const TupleId *ids, uint64_t count,
+             const uint64_t *const *columns, unsigned num_columns, uint64_t *sums) {
+    sumScalar(ids, count, columns, num_columns, sums);
+}
+
+// Whether the CPU supports the AVX2 kernel
+bool hasAvx2() {
+    return false;
+}
+
+#endif
+
+// The fastest kernel of the CPU
+Kernel best() {
+    return hasAvx2() ? sumAvx2 : sumScalar;
+}
+
+}
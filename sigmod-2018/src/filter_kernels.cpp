@@ -0,0 +1,187 @@
+#include "filter_kernels.h"
+
+#include <algorithm>
+#include <utility>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#endif
+
+#include "bitmap.h"
+#include "column_sums.h"
+
+namespace FilterKernels {
+
+// One comparison
+template<FilterInfo::Comparison C>
+static inline bool compare(uint64_t value, uint64_t constant) {
+    if constexpr (C == FilterInfo::Comparison::Equal) {
+        return value == constant;
+    } else if constexpr (C == FilterInfo::Comparison::Greater) {
+        return value > constant;
+    } else {
+        return value < constant;
+    }
+}
+
+// The kernel for the comparisons Cs, the filter indexes Is
+template<FilterInfo::Comparison... Cs, size_t... Is>
+static uint64_t filterRows(std::index_sequence<Is...>, const uint64_t *const *columns, const uint64_t *constants,
+                       uint64_t begin, uint64_t end, TupleId *out) {
+    const uint64_t *cols[] = {columns[Is]...};
+    const uint64_t values[] = {constants[Is]...};
+    uint64_t count = 0;
+    for (uint64_t i = begin; i != end; ++i) {
+        // Not short-circuited, a mispredicted branch costs more than a load
+        bool pass = (compare<Cs>(cols[Is][i], values[Is]) & ...);
+        out[count] = i;
+        count += pass;
+    }
+    return count;
+}
+
+// The kernel for the comparisons Cs
+template<FilterInfo::Comparison... Cs>
+static uint64_t filter(const uint64_t *const *columns, const uint64_t *constants,
+                       uint64_t begin, uint64_t end, TupleId *out) {
+    return filterRows<Cs...>(std::make_index_sequence<sizeof...(Cs)>(), columns, constants, begin, end, out);
+}
+
+// Choose the kernel, one comparison at a time
+template<FilterInfo::Comparison... Cs>
+static Kernel select(const std::vector<FilterInfo> &filters) {
+    if constexpr (sizeof...(Cs) > 0) {
+        if (sizeof...(Cs) == filters.size()) {
+            return filter<Cs...>;
+        }
+    }
+    if constexpr (sizeof...(Cs) < kMaxFilters) {
+        switch (filters[sizeof...(Cs)].comparison) {
+            case FilterInfo::Comparison::Equal:
+                return select<Cs..., FilterInfo::Comparison::Equal>(filters);
+            case FilterInfo::Comparison::Greater:
+                return select<Cs..., FilterInfo::Comparison::Greater>(filters);
+            case FilterInfo::Comparison::Less:
+                return select<Cs..., FilterInfo::Comparison::Less>(filters);
+        }
+    }
+    return nullptr;
+}
+
+// The kernel for the comparisons of the filters
+Kernel select(const std::vector<FilterInfo> &filters) {
+    if (filters.empty() || filters.size() > kMaxFilters) {
+        return nullptr;
+    }
+    return select<>(filters);
+}
+
+// The bits of the rows [begin, end) of one word
+template<FilterInfo::Comparison C>
+static inline uint64_t compareWord(const uint64_t *column, uint64_t constant, uint64_t begin, uint64_t end) {
+    uint64_t bits = 0;
+    for (uint64_t i = begin; i != end; ++i) {
+        bits |= uint64_t(compare<C>(column[i], constant)) << (i - begin);
+    }
+    return bits;
+}
+
+// Store the bits of a word, or AND them into it
+template<bool Combine>
+static inline void storeWord(uint64_t *word, uint64_t bits) {
+    if constexpr (Combine) {
+        *word &= bits;
+    } else {
+        *word = bits;
+    }
+}
+
+// The portable bitmap kernel
+template<FilterInfo::Comparison C, bool Combine>
+static void bitmapScalar(const uint64_t *column, uint64_t constant, uint64_t begin, uint64_t end, uint64_t *words) {
+    for (uint64_t i = begin; i < end; i += Bitmap::kWordBits) {
+        auto *word = &words[i / Bitmap::kWordBits];
+        // An earlier filter already rejected all rows of the word
+        if (Combine && *word == 0) continue;
+        storeWord<Combine>(word, compareWord<C>(column, constant, i, std::min(end, i + Bitmap::kWordBits)));
+    }
+}
+
+#if defined(__x86_64__)
+
+// Four comparisons as four bits. AVX2 only compares signed values, with
+// flipped sign bits they compare like the unsigned ones.
+template<FilterInfo::Comparison C>
+__attribute__((target("avx2")))
+static inline uint64_t compare4(const uint64_t *values, __m256i constant, __m256i sign) {
+    auto value = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(values));
+    __m256i mask;
+    if constexpr (C == FilterInfo::Comparison::Equal) {
+        mask = _mm256_cmpeq_epi64(value, constant);
+    } else if constexpr (C == FilterInfo::Comparison::Greater) {
+        mask = _mm256_cmpgt_epi64(_mm256_xor_si256(value, sign), constant);
+    } else {
+        mask = _mm256_cmpgt_epi64(constant, _mm256_xor_si256(value, sign));
+    }
+    return _mm256_movemask_pd(_mm256_castsi256_pd(mask));
+}
+
+// The AVX2 bitmap kernel
+template<FilterInfo::Comparison C, bool Combine>
+__attribute__((target("avx2")))
+static void bitmapAvx2(const uint64_t *column, uint64_t constant, uint64_t begin, uint64_t end, uint64_t *words) {
+    const __m256i sign = _mm256_set1_epi64x(INT64_MIN);
+    __m256i constants = _mm256_set1_epi64x(constant);
+    if constexpr (C != FilterInfo::Comparison::Equal) {
+        constants = _mm256_xor_si256(constants, sign);
+    }
+    uint64_t i = begin;
+    for (; i + Bitmap::kWordBits <= end; i += Bitmap::kWordBits) {
+        auto *word = &words[i / Bitmap::kWordBits];
+        if (Combine && *word == 0) continue;
+        uint64_t bits = 0;
+        for (unsigned j = 0; j < Bitmap::kWordBits; j += 4) {
+            bits |= compare4<C>(column + i + j, constants, sign) << j;
+        }
+        storeWord<Combine>(word, bits);
+    }
+    if (i < end) {
+        bitmapScalar<C, Combine>(column, constant, i, end, words);
+    }
+}
+
+#else
+
+// The AVX2 bitmap kernel, not available
+template<FilterInfo::Comparison C, bool Combine>
+static void bitmapAvx2(const uint64_t *column, uint64_t constant, uint64_t begin, uint64_t end, uint64_t *words) {
+    bitmapScalar<C, Combine>(column, constant, begin, end, words);
+}
+
+#endif
+
+// The bitmap kernel for a comparison
+template<bool Combine>
+static BitmapKernel selectBitmap(FilterInfo::Comparison comparison, bool avx2) {
+    switch (comparison) {
+        case FilterInfo::Comparison::Equal:
+            return avx2 ? bitmapAvx2<FilterInfo::Comparison::Equal, Combine>
+                        : bitmapScalar<FilterInfo::Comparison::Equal, Combine>;
+        case FilterInfo::Comparison::Greater:
+            return avx2 ? bitmapAvx2<FilterInfo::Comparison::Greater, Combine>
+                        : bitmapScalar<FilterInfo::Comparison::Greater, Combine>;
+        case FilterInfo::Comparison::Less:
+            return avx2 ? bitmapAvx2<FilterInfo::Comparison::Less, Combine>
+                        : bitmapScalar<FilterInfo::Comparison::Less, Combine>;
+    }
+    return nullptr;
+}
+
+// The bitmap kernel for a comparison
+BitmapKernel selectBitmap(FilterInfo::Comparison comparison, bool combine, bool scalar) {
+    static const bool avx2 = ColumnSums::hasAvx2();
+    bool simd = avx2 && !scalar;
+    return combine ? selectBitmap<true>(comparison, simd) : selectBitmap<false>(comparison, simd);
+}
+
+}
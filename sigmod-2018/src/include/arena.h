@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/// A bump allocator for the state of one query. Small allocations are carved
+/// out of blocks that are all freed at once when the arena is destroyed; the
+/// blocks go back to a pool of the destroying thread and are reused by the
+/// next query. Large allocations go to the heap, so growing result vectors do
+/// not leave their old buffers behind.
+class Arena {
+private:
+    /// The blocks of the arena
+    std::vector<char *> blocks_;
+    /// The free part of the current block
+    char *current_ = nullptr, *end_ = nullptr;
+
+    /// Continue in a new block
+    void grow();
+
+public:
+    /// The size of a block
+    static constexpr size_t kBlockSize = 1 << 20;
+    /// Allocations above this size go to the heap
+    static constexpr size_t kLargeAllocation = kBlockSize / 8;
+    /// The number of free blocks a thread keeps
+    static constexpr size_t kMaxPooledBlocks = 16;
+
+    /// The constructor
+    Arena() = default;
+    /// Delete copy constructor
+    Arena(const Arena &other) = delete;
+    /// The destructor, returns the blocks to the pool of the thread
+    ~Arena();
+
+    /// Allocate memory
+    void *allocate(size_t bytes, size_t alignment) {
+        if (bytes > kLargeAllocation) {
+            return ::operator new(bytes);
+        }
+        auto aligned = (reinterpret_cast<uintptr_t>(current_) + alignment - 1) & ~(alignment - 1);
+        if (current_ == nullptr || aligned + bytes > reinterpret_cast<uintptr_t>(end_)) {
+            grow();
+            aligned = (reinterpret_cast<uintptr_t>(current_) + alignment - 1) & ~(alignment - 1);
+        }
+        current_ = reinterpret_cast<char *>(aligned + bytes);
+        return reinterpret_cast<void *>(aligned);
+    }
+    /// Free memory, only the last allocation is actually given back
+    void deallocate(void *memory, size_t bytes) {
+        if (bytes > kLargeAllocation) {
+            ::operator delete(memory);
+        } else if (static_cast<char *>(memory) + bytes == current_) {
+            current_ = static_cast<char *>(memory);
+        }
+    }
+
+    /// The number of blocks in use
+    size_t numBlocks() const {
+        return blocks_.size();
+    }
+};
+
+/// An STL allocator in an arena. Without an arena it uses the heap.
+template<typename T>
+class ArenaAllocator {
+private:
+    template<typename U> friend class ArenaAllocator;
+    /// The arena, null for the heap
+    Arena *arena_;
+
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    /// The constructor
+    ArenaAllocator(Arena *arena = nullptr) noexcept: arena_(arena) {};
+    /// The converting constructor
+    template<typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) noexcept: arena_(other.arena_) {};
+
+    /// Allocate n objects
+    T *allocate(size_t n) {
+        if (arena_ == nullptr) {
+            return static_cast<T *>(::operator new(n * sizeof(T)));
+        }
+        return static_cast<T *>(arena_->allocate(n * sizeof(T), alignof(T)));
+    }
+    /// Free n objects
+    void deallocate(T *p, size_t n) noexcept {
+        if (arena_ == nullptr) {
+            ::operator delete(p);
+        } else {
+            arena_->deallocate(p, n * sizeof(T));
+        }
+    }
+
+    /// The arena, null for the heap
+    Arena *arena() const {
+        return arena_;
+    }
+
+    template<typename U>
+    bool operator==(const ArenaAllocator<U> &other) const {
+        return arena_ == other.arena_;
+    }
+    template<typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const {
+        return arena_ != other.arena_;
+    }
+};
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+
+/// The checksums of one query as a binary record, written by the worker that
+/// ran the query and formatted only when its batch is printed
+struct QueryResult {
+    /// The number of checksums stored inline
+    static constexpr unsigned kInlineSums = 6;
+
+    /// The number of checksums
+    uint32_t count = 0;
+    /// The query result is empty, all checksums are NULL
+    bool empty = false;
+    /// The checksums if there are at most kInlineSums
+    uint64_t sums[kInlineSums];
+    /// The checksums of queries with more selections
+    std::unique_ptr<uint64_t[]> overflow;
+
+    /// Set the number of checksums
+    void resize(uint32_t num_sums);
+    /// The checksums
+    uint64_t *data() {
+        return overflow ? overflow.get() : sums;
+    }
+    const uint64_t *data() const {
+        return overflow ? overflow.get() : sums;
+    }
+    /// Append the text format: the checksums separated by spaces and a newline
+    void format(std::string &out) const;
+};
+
+/// The results of a batch of queries in query order. Records are added by the
+/// scheduling thread and filled in by the workers, which only synchronize
+/// through the completion counter.
+class Batch {
+private:
+    /// The results, a deque keeps them in place while the batch grows
+    std::deque<QueryResult> results_;
+    /// The number of queries added and completed
+    std::atomic<size_t> size_{0}, completed_{0};
+    /// Wakes up the waiting thread when the batch is complete
+    std::mutex m_;
+    std::condition_variable cv_;
+
+public:
+    /// Add a query with the given number of selections, returns its record
+    QueryResult *add(uint32_t num_selections);
+    /// A query has written its record
+    void complete();
+    /// Wait until all queries added so far are complete
+    void wait();
+    /// Wait for the batch and write all results in query order
+    void print(std::ostream &out);
+
+    /// The number of queries
+    size_t size() const {
+        return size_.load();
+    }
+};
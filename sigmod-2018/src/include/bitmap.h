@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "arena.h"
+
+/// A set of rows of a relation, one bit per row. The selection of a scan
+/// that passes many rows is kept as a bitmap instead of a tuple id list, 64
+/// times smaller than the ids of a relation that passes completely.
+class Bitmap {
+public:
+    /// The rows of a word
+    static constexpr uint64_t kWordBits = 64;
+
+private:
+    /// The bits, row i is bit i % kWordBits of word i / kWordBits
+    std::vector<uint64_t, ArenaAllocator<uint64_t>> words_;
+    /// The number of rows
+    uint64_t size_;
+
+public:
+    /// The constructor, no row is set. The words are allocated in the arena
+    /// (on the heap without one).
+    explicit Bitmap(uint64_t size, Arena *arena = nullptr)
+            : words_((size + kWordBits - 1) / kWordBits, 0, ArenaAllocator<uint64_t>(arena)), size_(size) {};
+
+    /// The number of rows
+    uint64_t size() const {
+        return size_;
+    }
+    /// The words, the bits past size() are 0
+    uint64_t *words() {
+        return words_.data();
+    }
+    const uint64_t *words() const {
+        return words_.data();
+    }
+
+    /// Whether a row is set
+    bool test(uint64_t row) const {
+        return (words_[row / kWordBits] >> (row % kWordBits)) & 1;
+    }
+    /// Set a row
+    void set(uint64_t row) {
+        words_[row / kWordBits] |= uint64_t(1) << (row % kWordBits);
+    }
+    /// The number of rows set in [begin, end), begin a multiple of kWordBits
+    uint64_t count(uint64_t begin, uint64_t end) const {
+        uint64_t count = 0;
+        for (uint64_t w = begin / kWordBits, last = (end + kWordBits - 1) / kWordBits; w < last; ++w) {
+            count += __builtin_popcountll(words_[w]);
+        }
+        return count;
+    }
+
+    /// Call f(row) for the rows set in [begin, end), in ascending order
+    template<typename F>
+    void forEach(uint64_t begin, uint64_t end, F &&f) const {
+        if (begin >= end) {
+            return;
+        }
+        uint64_t first = begin / kWordBits, last = (end - 1) / kWordBits;
+        for (uint64_t w = first; w <= last; ++w) {
+            uint64_t word = words_[w];
+            if (w == first) word &= ~uint64_t(0) << (begin % kWordBits);
+            if (w == last) word &= ~uint64_t(0) >> (kWordBits - 1 - (end - 1) % kWordBits);
+            for (; word != 0; word &= word - 1) {
+                f(w * kWordBits + __builtin_ctzll(word));
+            }
+        }
+    }
+};
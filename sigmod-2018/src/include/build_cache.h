@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+#include "memory_budget.h"
+#include "operators.h"
+
+/// The build-side hash tables of the joins of a batch, shared between the
+/// queries. The key names the scan and the key columns of the build side.
+/// The first join to ask for a table builds it, concurrent joins with the
+/// same key wait for it.
+class BuildCache {
+private:
+    /// A table, ready once the future is
+    struct Entry {
+        std::shared_future<std::shared_ptr<const JoinTable>> table;
+        /// The accounted bytes
+        uint64_t bytes;
+    };
+
+    /// The tables by key
+    std::unordered_map<std::string, Entry> entries_;
+    std::mutex m_;
+    /// The memory of the cached tables
+    MemoryBudget memory_;
+
+    /// Drop the tables that are built, the ones in use stay alive with their joins
+    void evict();
+
+public:
+    /// Cache at most 1 GiB of tables unless a limit is set
+    static constexpr uint64_t kDefaultLimit = uint64_t(1) << 30;
+
+    /// The constructor
+    explicit BuildCache(MemoryBudget *parent = nullptr, uint64_t limit = kDefaultLimit)
+            : memory_(limit, parent) {};
+
+    /// The table of the key, built by build() if it is not cached. Null if
+    /// the table does not fit into the memory of the cache.
+    std::shared_ptr<const JoinTable> get(const std::string &key, uint64_t bytes,
+                                         const std::function<std::shared_ptr<const JoinTable>()> &build);
+    /// Drop all tables, at the end of a batch
+    void clear();
+
+    /// The number of cached tables
+    size_t size();
+};
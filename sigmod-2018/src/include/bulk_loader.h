@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "relation.h"
+
+/// How the bulk loader issues its reads
+enum class LoadBackend {
+    /// io_uring if the kernel allows it, threads otherwise
+    Auto,
+    /// Asynchronous reads through io_uring
+    IoUring,
+    /// Blocking preads on a pool of threads
+    Threads,
+};
+
+/// Parse "auto" / "uring" / "threads"
+LoadBackend parseLoadBackend(const std::string &backend);
+/// The name of a backend
+const char *loadBackendName(LoadBackend backend);
+
+/// Loads relation files (the binary format of Relation::storeRelation) with
+/// many large reads in flight at once. The files are cut into aligned chunks
+/// and the chunks of all files are read in one stream, up to the queue depth
+/// at a time, with O_DIRECT where the file system supports it. A finished
+/// chunk is copied to the columns it overlaps, so the reads stay aligned no
+/// matter where the columns start in the file.
+class BulkLoader {
+public:
+    /// The alignment of the offsets, lengths and buffers of direct reads
+    static constexpr uint64_t kAlignment = 4096;
+    /// The reads in flight unless configured otherwise
+    static constexpr unsigned kDefaultQueueDepth = 32;
+    /// The bytes of a read unless configured otherwise
+    static constexpr uint64_t kDefaultChunkBytes = uint64_t(1) << 20;
+
+    /// The configuration of a loader
+    struct Options {
+        LoadBackend backend = LoadBackend::Auto;
+        /// The maximum number of reads in flight, also the number of threads
+        /// of the thread backend
+        unsigned queue_depth = kDefaultQueueDepth;
+        /// The bytes of a read, rounded up to kAlignment
+        uint64_t chunk_bytes = kDefaultChunkBytes;
+        /// Bypass the page cache where possible
+        bool direct = true;
+    };
+
+    /// What the last load did
+    struct Report {
+        /// The backend that did the reads
+        LoadBackend backend = LoadBackend::Auto;
+        unsigned queue_depth = 0;
+        /// The files loaded and the ones opened with O_DIRECT
+        unsigned files = 0, direct_files = 0;
+        /// The bytes read and the time it took
+        uint64_t bytes = 0;
+        double seconds = 0;
+
+        /// The read throughput
+        double megabytesPerSecond() const {
+            return seconds > 0 ? bytes / seconds / (1 << 20) : 0;
+        }
+        /// A one line summary
+        std::string summary() const;
+    };
+
+private:
+    /// An open relation file
+    struct File {
+        /// Buffered and (if available) direct descriptors of the file
+        int fd = -1, direct_fd = -1;
+        /// The bytes of the file
+        uint64_t bytes = 0;
+        /// The relation the file is loaded into
+        Relation *relation = nullptr;
+    };
+    /// One aligned read
+    struct Chunk {
+        unsigned file;
+        uint64_t offset, length;
+    };
+
+    Options options_;
+    Report report_;
+    std::vector<File> files_;
+    std::vector<Chunk> chunks_;
+
+    /// Read a chunk into buffer with blocking reads, returns the bytes read
+    uint64_t readChunk(const Chunk &chunk, char *buffer);
+    /// Complete a read that ended short of the chunk before the end of the file
+    uint64_t completeShortRead(const Chunk &chunk, char *buffer, uint64_t done);
+    /// Copy the bytes of a chunk into the columns they belong to
+    void scatter(const Chunk &chunk, const char *data, uint64_t bytes);
+    /// Read all chunks through io_uring, false if io_uring is not available
+    bool readIoUring();
+    /// Read all chunks on a pool of threads
+    void readThreads();
+    /// Close the files
+    void closeFiles();
+
+public:
+    /// The constructor, with the default options
+    BulkLoader() : BulkLoader(Options()) {};
+    /// The constructor
+    explicit BulkLoader(Options options);
+
+    /// Load the relations of the files, in order. Throws if a file cannot be
+    /// read or is not a relation file.
+    std::vector<Relation> load(const std::vector<std::string> &file_names);
+
+    /// What the last load did
+    const Report &report() const {
+        return report_;
+    }
+};
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+#include "parser.h"
+
+/// A query in canonical form and how to answer the original from it
+struct CanonicalQuery {
+    /// The canonical query
+    QueryInfo query;
+    /// The text of the canonical query, equal for queries that only differ in
+    /// the order of their bindings, predicates, filters and selections
+    std::string key;
+    /// The selection of the canonical query for every selection of the original
+    std::vector<unsigned> selections;
+};
+
+/// Brings a query into a canonical form, so the copies of a query in a batch
+/// can be answered by one execution. The bindings are numbered by a signature
+/// that does not depend on their order: the relation, the filters and the
+/// predicates within the binding, refined by the signatures of the joined
+/// bindings until it is stable. Bindings with equal signatures keep their
+/// order, so such queries might not be recognized as equal, but a query is
+/// never mistaken for another one. Predicates are oriented and sorted,
+/// filters sorted and the selections sorted without repetitions.
+class Canonicalizer {
+public:
+    /// The canonical form of a parsed query
+    static CanonicalQuery canonicalize(const QueryInfo &query);
+};
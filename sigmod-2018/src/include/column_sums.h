@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+
+#include "relation.h"
+
+/// Kernels that add up the values of late-materialized columns. All columns
+/// share one tuple id list, which is walked in cache sized blocks: every block
+/// is summed for each column before moving on, so the ids are read from memory
+/// once no matter how many columns are selected. Summing one column at a time
+/// inside a block (instead of one row at a time) keeps the loads of a column
+/// independent of each other, so the out-of-order core overlaps their misses.
+namespace ColumnSums {
+/// The ids summed per column before moving to the next column, 512 KiB of ids
+static constexpr uint64_t kBlockSize = 65536;
+/// The AVX2 kernel gathers a block if its ids ascend and span at most this
+/// many rows per id
+static constexpr uint64_t kClusteredSpread = 4;
+
+/// A summation kernel: sums[c] += columns[c][ids[i]] for all i < count
+using Kernel = void (*)(const TupleId *ids, uint64_t count,
+                        const uint64_t *const *columns, unsigned num_columns, uint64_t *sums);
+
+/// The portable kernel, four independent accumulators per column
+void sumScalar(const TupleId *ids, uint64_t count,
+               const uint64_t *const *columns, unsigned num_columns, uint64_t *sums);
+/// The AVX2 kernel, gathers four values per instruction from blocks of
+/// clustered ids. Only call it if hasAvx2() holds.
+void sumAvx2(const TupleId *ids, uint64_t count,
+             const uint64_t *const *columns, unsigned num_columns, uint64_t *sums);
+/// Whether the CPU supports the AVX2 kernel
+bool hasAvx2();
+
+/// The fastest kernel of the CPU, chosen once at runtime
+Kernel best();
+
+/// Sum with the fastest kernel
+inline void sum(const TupleId *ids, uint64_t count,
+                const uint64_t *const *columns, unsigned num_columns, uint64_t *sums) {
+    static const Kernel kernel = best();
+    kernel(ids, count, columns, num_columns, sums);
+}
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "parser.h"
+#include "relation.h"
+
+/// Selection kernels of FilterScan, instantiated at compile time for every
+/// combination of up to kMaxFilters comparisons. Inside a kernel the
+/// comparisons and the number of filters are constants, so the row loop
+/// evaluates all filters without a switch or a loop over the filters, and
+/// appends the row id without a branch.
+namespace FilterKernels {
+/// The most filters a kernel is instantiated for
+static constexpr unsigned kMaxFilters = 4;
+
+/// A selection kernel: writes the ids of the rows in [begin, end) that pass
+/// all filters (columns[f][row] <comparison f> constants[f]) to out, returns
+/// their number. out needs room for end - begin ids.
+using Kernel = uint64_t (*)(const uint64_t *const *columns, const uint64_t *constants,
+                            uint64_t begin, uint64_t end, TupleId *out);
+
+/// The kernel for the comparisons of the filters, in their order, nullptr
+/// for none or more than kMaxFilters filters
+Kernel select(const std::vector<FilterInfo> &filters);
+
+/// A bitmap kernel: sets bit i of words (the layout of Bitmap) for the rows i
+/// in [begin, end) with column[i] <comparison> constant and clears it for the
+/// others, including the bits past end in the last word. begin is a multiple
+/// of Bitmap::kWordBits. A combining kernel ANDs the bits into words instead,
+/// so the filters of a scan are applied to a block of words one by one.
+using BitmapKernel = void (*)(const uint64_t *column, uint64_t constant,
+                              uint64_t begin, uint64_t end, uint64_t *words);
+
+/// The bitmap kernel for a comparison: the AVX2 one (compares four rows and
+/// moves their masks into the word at once) if the CPU supports it and scalar
+/// is not set, the portable one otherwise
+BitmapKernel selectBitmap(FilterInfo::Comparison comparison, bool combine, bool scalar = false);
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include "arena.h"
+
+/// The hash table of a join. All entries are grouped by bucket in one array
+/// (built with a counting sort), so a lookup is a bucket offset followed by a
+/// short sequential scan. probeBatch() looks up several keys together and
+/// prefetches their buckets and entries first (group prefetching), so the
+/// cache misses of the lookups overlap instead of following each other.
+class JoinHashTable {
+public:
+    /// A build tuple
+    struct Entry {
+        uint64_t key;
+        uint64_t row;
+    };
+    using Entries = std::vector<Entry, ArenaAllocator<Entry>>;
+
+    /// The number of lookups in flight together in probeBatch
+    static constexpr size_t kBatchSize = 16;
+
+private:
+    /// bucket_starts_[b] is the first entry of bucket b, one extra for the end
+    std::vector<uint64_t, ArenaAllocator<uint64_t>> bucket_starts_;
+    /// The entries, grouped by bucket
+    Entries entries_;
+    /// The number of bucket bits
+    unsigned bits_ = 1;
+
+    /// The bucket of a key, the high bits of a multiplicative hash
+    uint64_t bucket(uint64_t key) const {
+        return (key * 0x9e3779b97f4a7c15ull) >> (64 - bits_);
+    }
+
+public:
+    /// The constructor, the arrays are allocated in the arena (on the heap without one)
+    explicit JoinHashTable(Arena *arena = nullptr)
+            : bucket_starts_(ArenaAllocator<uint64_t>(arena)), entries_(ArenaAllocator<Entry>(arena)) {};
+
+    /// Build the table over the given tuples
+    void build(const std::vector<Entry> &entries);
+
+    /// Call on_match(row) for every build row with the key
+    template<typename F>
+    void probe(uint64_t key, F &&on_match) const {
+        auto b = bucket(key);
+        for (uint64_t i = bucket_starts_[b], end = bucket_starts_[b + 1]; i != end; ++i) {
+            if (entries_[i].key == key) {
+                on_match(entries_[i].row);
+            }
+        }
+    }
+
+    /// Call on_match(i, row) for every build row matching keys[i], for all i < count
+    template<typename F>
+    void probeBatch(const uint64_t *keys, size_t count, F &&on_match) const {
+        uint64_t begins[kBatchSize], ends[kBatchSize];
+        for (size_t base = 0; base < count; base += kBatchSize) {
+            size_t n = std::min(kBatchSize, count - base);
+            // Stage 1: hash and prefetch the bucket offsets
+            for (size_t i = 0; i < n; ++i) {
+                begins[i] = bucket(keys[base + i]);
+                __builtin_prefetch(&bucket_starts_[begins[i]]);
+            }
+            // Stage 2: read the offsets and prefetch the first entry of every bucket
+            for (size_t i = 0; i < n; ++i) {
+                auto b = begins[i];
+                begins[i] = bucket_starts_[b];
+                ends[i] = bucket_starts_[b + 1];
+                if (begins[i] != ends[i]) {
+                    __builtin_prefetch(&entries_[begins[i]]);
+                }
+            }
+            // Stage 3: compare the keys
+            for (size_t i = 0; i < n; ++i) {
+                auto key = keys[base + i];
+                for (uint64_t j = begins[i]; j != ends[i]; ++j) {
+                    if (entries_[j].key == key) {
+                        on_match(base + i, entries_[j].row);
+                    }
+                }
+            }
+        }
+    }
+
+    /// The number of entries
+    size_t size() const {
+        return entries_.size();
+    }
+    /// The number of buckets
+    size_t numBuckets() const {
+        return bucket_starts_.empty() ? 0 : bucket_starts_.size() - 1;
+    }
+};
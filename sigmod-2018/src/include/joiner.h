@@ -1,16 +1,30 @@
 #pragma once
 
+#include <atomic>
+#include <chrono>
 #include <vector>
 #include <cstdint>
 #include <set>
+#include <shared_mutex>
 #include <optional>
 #include <thread>
+#include <functional>
 #include <future>
 #include <queue>
+#include <algorithm>
+#include <iostream>
 
+#include "batch.h"
+#include "build_cache.h"
+#include "canonicalizer.h"
+#include "numa.h"
 #include "operators.h"
 #include "relation.h"
 #include "parser.h"
+#include "query_compiler.h"
+#include "sharding.h"
+#include "statistics.h"
+#include "tasks.h"
 
 template <class T>
 class Channel {
@@ -47,30 +61,182 @@ private:
     std::queue<T> q_;
 };
 
+/// A set of shared queues. A consumer takes from its preferred queue first and
+/// falls back to the others, so work stays local without leaving anyone idle.
+template <class T>
+class MultiChannel {
+public:
+    explicit MultiChannel(size_t num_queues = 1) : qs_(num_queues) {}
+    ~MultiChannel() = default;
+
+    /**
+     * @brief Changes the number of queues. Must only be called while all queues are empty.
+     */
+    void Resize(size_t num_queues) {
+        std::unique_lock<std::mutex> lk(m_);
+        qs_.resize(std::max<size_t>(num_queues, 1));
+    }
+
+    /**
+     * @brief Inserts an element into one of the queues.
+     *
+     * @param element The element to be inserted.
+     * @param queue The queue to insert into.
+     */
+    void Put(T element, size_t queue = 0) {
+        std::unique_lock<std::mutex> lk(m_);
+        qs_[queue % qs_.size()].push(std::move(element));
+        lk.unlock();
+        cv_.notify_one();
+    }
+
+    /**
+     * @brief Gets an element, from the preferred queue if possible. Blocks until an element is available.
+     */
+    auto Get(size_t preferred = 0) -> T {
+        std::unique_lock<std::mutex> lk(m_);
+        size_t queue = 0;
+        cv_.wait(lk, [&]() {
+            for (size_t i = 0; i < qs_.size(); ++i) {
+                queue = (preferred + i) % qs_.size();
+                if (!qs_[queue].empty()) return true;
+            }
+            return false;
+        });
+        T element = std::move(qs_[queue].front());
+        qs_[queue].pop();
+        return element;
+    }
+
+private:
+    std::mutex m_;
+    std::condition_variable cv_;
+    std::vector<std::queue<T>> qs_;
+};
+
+/// When a query ran, in nanoseconds of the steady clock (CLOCK_MONOTONIC, so
+/// other processes on the host can compare their timestamps)
+struct QueryTrace {
+    /// The id of a part of a query run by a helping worker
+    static constexpr size_t kPart = SIZE_MAX;
 
-class Joiner {
+    /// The id the query was parsed with, kPart for a part
+    size_t query_id = kPart;
+    /// The worker thread that ran it, the number of threads if the shard
+    /// workers ran its batch
+    unsigned worker = 0;
+    /// Scheduled (a part: submitted), started and finished
+    int64_t enqueued_ns = 0, started_ns = 0, finished_ns = 0;
+
+    /// The current time of the clock
+    static int64_t now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
+class Joiner : public TaskRunner {
 private:
     /// The relations that might be joined
     std::vector<Relation> relations_;
 
-    Channel<std::optional<QueryInfo>> request_queue_;
-    using Response = std::pair<size_t, std::string>;
-    Channel<std::optional<Response>> response_queue_;
+    /// A copy of a query in the batch answered by another task
+    struct Answer {
+        QueryResult *result;
+        /// The selection of the answering query for every checksum of the copy
+        std::vector<unsigned> selections;
+        /// The id of the copy and when it was scheduled
+        size_t query_id;
+        int64_t enqueued_ns;
+    };
+    /// A scheduled query and the record of its result, or a part of a query
+    /// handed to another worker (only work is set)
+    struct Task {
+        QueryInfo query;
+        QueryResult *result = nullptr;
+        Batch *batch = nullptr;
+        /// The estimated cost of the query
+        double cost = 0;
+        /// The number of threads the query may use
+        unsigned parallelism = 1;
+        std::function<void()> work;
+        /// The copies of the query in the batch this task answers, empty if
+        /// the task only answers its own record
+        std::vector<Answer> answers;
+        /// When the task was scheduled and started, only taken while tracing
+        int64_t enqueued_ns = 0, started_ns = 0;
+        /// The record of a query answering copies, result points to it
+        std::shared_ptr<QueryResult> canonical_result;
+    };
+    /// One request queue per NUMA node plus a shared one (the last)
+    MultiChannel<std::optional<Task>> request_queue_;
+    /// The batch being scheduled by scheduleQuery
+    std::unique_ptr<Batch> batch_ = std::make_unique<Batch>();
+    /// The queries of the batch, dispatched when it is complete
+    std::vector<Task> pending_;
 
     std::vector<std::thread> worker_threads_;
 
     unsigned num_t_ = 5;  // 线程数量
 
-    size_t batch_size_ = 0;  // 批处理大小
+    /// The NUMA placement of relations and workers
+    NumaPolicy numa_policy_ = NumaPolicy::None;
+    NumaTopology topology_ = NumaTopology::simulate(1, 1);
+    /// Bytes of relations placed on every node
+    std::vector<uint64_t> node_bytes_;
+
+    /// The memory of all running queries
+    MemoryBudget memory_;
+    /// The memory limit of a single query
+    uint64_t query_memory_limit_ = MemoryBudget::kUnlimited;
+    /// The build-side hash tables shared by the queries of a batch
+    BuildCache build_cache_{&memory_};
+    /// The number of batches running, the build cache is cleared when the last one ends
+    std::atomic<unsigned> active_batches_{0};
+
+    /// The samples and distinct counts of the relations
+    Statistics statistics_;
+    /// Whether the planner estimates from the statistics or with default selectivities
+    bool use_statistics_ = true;
+    /// Whether the copies of a query in a batch run only once
+    bool deduplicate_ = true;
+    /// Serializes the appends, queries never take it
+    std::mutex append_mutex_;
+    /// Guards the replacement of the statistics of a relation by an append
+    std::shared_mutex statistics_mutex_;
+    /// Receives the estimates of the planner and the real sizes
+    std::function<void(bool, double, uint64_t)> estimate_observer_;
+    /// Receives the trace of every query
+    std::function<void(const QueryTrace &)> query_observer_;
+    /// Compiles hot query templates, null if queries are only interpreted
+    std::unique_ptr<QueryCompiler> compiler_;
+    /// Runs the batches on worker processes, null if they run on the threads
+    std::unique_ptr<ShardedExecutor> sharding_;
 
 public:
     /// Add relation
     void addRelation(const char *file_name);
     void addRelation(Relation &&relation);
-    /// Get relation
+    /// Add a relation whose columns the joiner does not own, e.g. the view
+    /// of a shared segment. Rows cannot be appended to it.
+    void addSharedRelation(Relation &&relation);
+    /// Append count rows to a relation, columns[c] holds their values of
+    /// column c. Queries that are running keep the rows of their snapshot,
+    /// queries started afterwards see the new rows. Appends are serialized
+    /// with each other, queries only wait for the swap of the statistics.
+    /// Throws std::logic_error if the relation is not appendable.
+    void appendRows(RelationId relation_id, const std::vector<const uint64_t *> &columns, uint64_t count);
+    /// Get relation, throws std::out_of_range if it does not exist
     const Relation &getRelation(unsigned relation_id);
+    /// Check that the relations and columns of a parsed query exist, throws
+    /// std::invalid_argument otherwise. Queries from untrusted sources have
+    /// to pass it before they are scheduled.
+    void checkQuery(const QueryInfo &query) const;
     /// Joins a given set of relations
     std::string join(QueryInfo &i);
+    /// Joins a given set of relations and writes the checksums into result,
+    /// using up to parallelism worker threads
+    void join(QueryInfo &i, QueryResult &result, unsigned parallelism = 1);
 
     Joiner() = default;
     ~Joiner() {
@@ -86,27 +252,115 @@ public:
         return relations_;
     }
 
-    void StartWorkerThread();
+    void StartWorkerThread(unsigned worker_id = 0);
 
+    /// Add a query to the batch. The queries of a batch are started when the
+    /// batch is printed, the most expensive ones first.
     void scheduleQuery(std::optional<QueryInfo> query);
 
-    void printCheckSum();
+    /// Run a part of a query on some worker
+    void submit(std::function<void()> task) override;
+
+    /// The estimated cost of a query
+    double estimateCost(const QueryInfo &query);
+    /// A snapshot of the statistics, later appends do not change it
+    Statistics currentStatistics();
+
+    /// Enable NUMA aware placement of relations, worker pinning and scheduling.
+    /// Has to be called before the worker threads are started.
+    void enableNuma(NumaPolicy policy, NumaTopology topology);
 
-    void setBatchSize(size_t batch_size) {
-        batch_size_ = batch_size;
+    /// Estimate from the statistics of the relations (the default) or with
+    /// default selectivities
+    void useStatistics(bool enabled) {
+        use_statistics_ = enabled;
+    }
+    /// Run the copies of a query within a batch once (the default), or every
+    /// copy on its own
+    void useDeduplication(bool enabled) {
+        deduplicate_ = enabled;
+    }
+    /// Call observer(join, estimate, actual) with the estimated and the real
+    /// size of every filtered scan (join == false) and every join of a query,
+    /// on the thread running the query
+    void setEstimateObserver(std::function<void(bool, double, uint64_t)> observer) {
+        estimate_observer_ = std::move(observer);
     }
 
+    /// Call observer with the trace of every scheduled query when its record
+    /// is written, and of every part of a query run by a helping worker, on
+    /// the thread that ran it. Has to be set before queries are scheduled.
+    void setQueryObserver(std::function<void(const QueryTrace &)> observer) {
+        query_observer_ = std::move(observer);
+    }
+
+    /// Limit the memory of a single query and of all queries together. A join
+    /// whose hash table does not fit spills its inputs to disk.
+    void setMemoryLimits(uint64_t query_bytes, uint64_t total_bytes) {
+        query_memory_limit_ = query_bytes;
+        memory_.reset(total_bytes, nullptr);
+    }
+
+    /// Compile hot query templates to native code. Compiled pipelines run on
+    /// one thread and keep their hash tables on the heap, outside the memory
+    /// budget, so queries given several threads stay interpreted.
+    void enableCompilation(QueryCompiler::Options options) {
+        compiler_ = std::make_unique<QueryCompiler>(std::move(options));
+    }
+    /// The query compiler, null unless compilation is enabled
+    QueryCompiler *compiler() {
+        return compiler_.get();
+    }
+
+    /// Run the batches on worker processes that each join one hash partition
+    /// of the relations (see ShardedExecutor). join() still runs on the
+    /// calling thread. A batch falls back to the threads if a worker fails.
+    void enableSharding(ShardedExecutor::Options options) {
+        sharding_ = std::make_unique<ShardedExecutor>(options);
+    }
+
+    /// The NUMA node a query prefers to run on, -1 if it has no preference
+    int homeNode(const QueryInfo &query) const;
+
+    /// Waits for the queries scheduled since the last call and writes their
+    /// results in query order
+    void printCheckSum(std::ostream &out = std::cout);
+
+    /// Runs a batch of queries and writes their results in query order. Unlike
+    /// scheduleQuery and printCheckSum it may be called by several threads at
+    /// once, their batches share the workers and the build cache.
+    void runBatch(std::vector<QueryInfo> queries, std::ostream &out);
+
     void setNumThreads(unsigned num_t) {
         num_t_ = num_t;
         for(int i = 0; i < num_t; i++) {
-            worker_threads_.emplace_back([&]{StartWorkerThread();});
+            worker_threads_.emplace_back([this, i]{StartWorkerThread(i);});
         }
     }
 
 private:
+    /// Place a newly added relation according to the NUMA policy
+    void placeRelation(Relation &relation);
+    /// Replace the copies of a query in a batch (equal in canonical form) by
+    /// one task answering all of them
+    void deduplicate(std::vector<Task> &tasks);
+    /// Write the records a finished task answers and mark them complete
+    void complete(Task &task, unsigned worker);
+    /// Start the queries of a batch, longest first
+    void dispatch(std::vector<Task> &tasks);
+    /// Start the queries of a batch, wait for them and write the results
+    void finishBatch(Batch &batch, std::vector<Task> &tasks, std::ostream &out);
+    /// Run the queries of a batch on the shard workers, false if they failed
+    /// and the queries still have to run
+    bool runSharded(std::vector<Task> &tasks);
+    /// The key of the scan of a binding with the given number of rows in the build cache
+    static std::string scanKey(unsigned binding, const QueryInfo &query, uint64_t rows);
+
     /// Add scan to query
-    std::unique_ptr<Operator> addScan(std::set<unsigned> &used_relations,
-                                      const SelectInfo &info,
+    std::unique_ptr<Operator> addScan(const SelectInfo &info,
                                       QueryInfo &query, std::shared_ptr<Context> context);
+    /// Computes the checksums of the query result
+    void checksum(std::unique_ptr<Operator> root, QueryInfo &query,
+                  std::shared_ptr<Context> context, QueryResult &result);
 };
 
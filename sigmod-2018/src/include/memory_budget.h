@@ -0,0 +1,119 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <limits>
+#include <utility>
+#include <vector>
+
+/// Accounts the memory used by operators. Every query has its own budget whose
+/// parent is the budget of the whole process, a reservation has to fit into both.
+class MemoryBudget {
+private:
+    /// The bytes in use
+    std::atomic<uint64_t> used_{0};
+    /// The maximum number of bytes
+    uint64_t limit_ = kUnlimited;
+    /// The enclosing budget, may be null
+    MemoryBudget *parent_ = nullptr;
+
+public:
+    static constexpr uint64_t kUnlimited = std::numeric_limits<uint64_t>::max();
+
+    /// The constructor
+    explicit MemoryBudget(uint64_t limit = kUnlimited, MemoryBudget *parent = nullptr)
+            : limit_(limit), parent_(parent) {};
+    /// Delete copy constructor
+    MemoryBudget(const MemoryBudget &other) = delete;
+    /// The destructor, returns everything still in use to the parent
+    ~MemoryBudget();
+
+    /// Set the limit and the parent, only while nothing is reserved
+    void reset(uint64_t limit, MemoryBudget *parent);
+
+    /// Reserve memory that can be done without, false (and nothing reserved) if it does not fit
+    bool tryReserve(uint64_t bytes);
+    /// Account memory that is needed anyway, even above the limit
+    void charge(uint64_t bytes);
+    /// Return reserved memory
+    void release(uint64_t bytes);
+
+    /// The bytes that can still be reserved
+    uint64_t available() const;
+    /// The bytes in use
+    uint64_t used() const {
+        return used_.load(std::memory_order_relaxed);
+    }
+    /// The limit
+    uint64_t limit() const {
+        return limit_;
+    }
+};
+
+/// A temporary file of (key, value) pairs, written and read back sequentially
+/// in large blocks. Small files never leave the write buffer.
+class SpillFile {
+private:
+    using Record = std::pair<uint64_t, uint64_t>;
+    /// The file, created on the first full block
+    FILE *file_ = nullptr;
+    /// The block being written
+    std::vector<Record> buffer_;
+    /// The number of records
+    uint64_t size_ = 0;
+
+    /// Write the buffer to the file
+    void flush();
+
+public:
+    /// The records per block, 64 KiB of I/O
+    static constexpr size_t kBlockRecords = 4096;
+
+    /// The constructor
+    SpillFile() = default;
+    /// Delete copy constructor
+    SpillFile(const SpillFile &other) = delete;
+    /// The destructor, the file is removed when it is closed
+    ~SpillFile();
+
+    /// Append a record
+    void append(uint64_t key, uint64_t value) {
+        buffer_.emplace_back(key, value);
+        ++size_;
+        if (buffer_.size() == kBlockRecords) {
+            flush();
+        }
+    }
+
+    /// The number of records
+    uint64_t size() const {
+        return size_;
+    }
+
+    /// Call f(key, value) for all records in the order they were appended.
+    /// Records can still be appended afterwards.
+    template<typename F>
+    void read(F &&f);
+};
+
+// Read all records back
+template<typename F>
+void SpillFile::read(F &&f) {
+    if (file_ != nullptr) {
+        flush();
+        rewind(file_);
+        buffer_.resize(kBlockRecords);
+        size_t count;
+        while ((count = fread(buffer_.data(), sizeof(Record), kBlockRecords, file_)) > 0) {
+            for (size_t i = 0; i < count; ++i) {
+                f(buffer_[i].first, buffer_[i].second);
+            }
+        }
+        buffer_.clear();
+        return;
+    }
+    for (auto &[key, value]: buffer_) {
+        f(key, value);
+    }
+}
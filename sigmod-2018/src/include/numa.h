@@ -0,0 +1,63 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+/// How relations are spread over the NUMA nodes
+enum class NumaPolicy {
+    /// No NUMA awareness, the default
+    None,
+    /// The pages of every relation are interleaved over all nodes
+    Interleave,
+    /// Every relation is placed on one node, balancing the bytes per node
+    PerNode,
+};
+
+/// Parse "interleave" / "node" / "none"
+NumaPolicy parseNumaPolicy(const std::string &policy);
+
+/// The NUMA nodes of the machine and the cpus that belong to them
+class NumaTopology {
+private:
+    /// node_cpus_[n] are the cpus of node n
+    std::vector<std::vector<unsigned>> node_cpus_;
+    /// Simulated nodes only affect scheduling, not memory placement
+    bool simulated_ = false;
+
+public:
+    /// Read the topology from /sys/devices/system/node. If the environment
+    /// variable SIGMOD_NUMA_NODES is set, a topology with that many simulated
+    /// nodes is returned instead, so the NUMA paths can be tested on a single
+    /// node machine.
+    static NumaTopology detect();
+    /// Split the given cpus round-robin into num_nodes simulated nodes
+    static NumaTopology simulate(unsigned num_nodes, unsigned num_cpus);
+
+    /// The number of nodes
+    unsigned numNodes() const {
+        return node_cpus_.size();
+    }
+    /// The cpus of a node
+    const std::vector<unsigned> &cpus(unsigned node) const {
+        return node_cpus_[node];
+    }
+    /// Whether the nodes are simulated
+    bool simulated() const {
+        return simulated_;
+    }
+};
+
+namespace numa {
+/// Allocate page-aligned memory on a node (node < 0 interleaves over all
+/// nodes). Placement is best effort: on a single or simulated node it is a
+/// plain anonymous mapping. Returns nullptr on failure.
+void *allocate(size_t bytes, int node, const NumaTopology &topology);
+/// Place the pages of a mapping on a node (node < 0 interleaves them), also
+/// the ones committed later. Best effort like allocate().
+void bind(void *memory, size_t bytes, int node, const NumaTopology &topology);
+/// Release memory from allocate()
+void release(void *memory, size_t bytes);
+/// Pin the calling thread to a cpu
+bool pinThread(unsigned cpu);
+}
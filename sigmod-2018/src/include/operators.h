@@ -3,12 +3,17 @@
 #include <cassert>
 #include <memory>
 #include <stdexcept>
+#include <type_traits>
 #include <unordered_map>
 #include <unordered_set>
 #include <utility>
 #include <vector>
 #include <set>
+#include <string>
 
+#include "arena.h"
+#include "bitmap.h"
+#include "join_hash_table.h"
 #include "relation.h"
 #include "parser.h"
 
@@ -22,6 +27,9 @@ namespace std {
     };
 }
 
+/// The tuple ids of one binding in a late-materialized result, in the arena of the query
+using TupleIds = std::vector<TupleId, ArenaAllocator<TupleId>>;
+
 /// Operators materialize their entire result
 class Operator {
 protected:
@@ -30,12 +38,19 @@ protected:
     /// The late-materialized results
     std::vector<TupleId *> result_columns_;
     /// The tmp results. tmp_results[i] is the list of tid filtered from the i-th table
-    std::vector<std::vector<TupleId>> tmp_results_;
+    std::vector<TupleIds> tmp_results_;
     /// The result size
     uint64_t result_size_ = 0;
     /// The query context
     std::shared_ptr<Context> context_;
 
+    /// Add an empty result column in the arena of the query for every binding
+    void allocateResults() {
+        for (unsigned i = 0; i < context_->relations_.size(); i++) {
+            tmp_results_.emplace_back(ArenaAllocator<TupleId>(&context_->arena_));
+        }
+    }
+
 public:
     /// The destructor
     virtual ~Operator() = default;;
@@ -52,7 +67,14 @@ public:
     virtual void run() = 0;
 
     /// Get  late-materialized results
-    virtual std::vector<std::vector<TupleId>> *getResults();
+    virtual std::vector<TupleIds> *getResults();
+
+    /// The result as a bitmap over the relation of its only binding, nullptr
+    /// if it is a list of tuple ids. Consumers that handle a bitmap ask for it
+    /// before calling getResults(), which turns it into tuple ids.
+    virtual const Bitmap *bitmap() {
+        return nullptr;
+    }
 
     uint64_t result_size() const {
         return result_size_;
@@ -65,15 +87,16 @@ protected:
     const Relation &relation_;
     /// The name of the relation in the query
     unsigned relation_binding_;
+    /// The number of rows in the snapshot of the query
+    uint64_t rows_;
 
 public:
     /// The constructor
     Scan(const Relation &r, unsigned relation_binding, std::shared_ptr<Context> context)
             : relation_(r), relation_binding_(relation_binding) {
         context_ = std::move(context);
-        for (int i = 0; i < context_->relations_.size(); i++) {
-            tmp_results_.emplace_back();
-        }
+        rows_ = context_->sizes_[relation_binding_];
+        allocateResults();
     };
 
     /// Require a column and add it to results
@@ -83,7 +106,7 @@ public:
     void run() override;
 
     /// Get  late-materialized results
-    virtual std::vector<std::vector<TupleId>> *getResults() override;
+    virtual std::vector<TupleIds> *getResults() override;
 };
 
 class FilterScan : public Scan {
@@ -92,6 +115,14 @@ private:
     std::vector<FilterInfo> filters_;
     /// The input data
     std::vector<uint64_t *> input_data_;
+    /// The selected rows, if too many of them pass for a list of tuple ids
+    std::unique_ptr<Bitmap> bitmap_;
+
+    /// The rows filtered by one call of a selection kernel
+    static constexpr uint64_t kFilterBlock = 4096;
+    /// The selection is kept as tuple ids while at most 1/kSparseFraction of
+    /// the rows pass, beyond that the ids take more memory than a bitmap
+    static constexpr uint64_t kSparseFraction = Bitmap::kWordBits;
 
 private:
     /// Apply filter
@@ -100,6 +131,10 @@ private:
     /// Copy tuple to result
     void copy2Result(uint64_t id);
 
+    /// Move the tuple ids selected so far to a bitmap and filter the rows
+    /// from begin (a multiple of kFilterBlock) on into it
+    void runBitmap(uint64_t begin);
+
 public:
     /// The constructor
     FilterScan(const Relation &r, std::vector<FilterInfo> filters, std::shared_ptr<Context> context)
@@ -122,50 +157,212 @@ public:
     void run() override;
 
     /// Get  late-materialized results
-    virtual std::vector<std::vector<TupleId>> *getResults() override {
-        return Operator::getResults();
+    virtual std::vector<TupleIds> *getResults() override;
+
+    /// The selected rows as a bitmap, if they are kept as one
+    const Bitmap *bitmap() override {
+        return bitmap_.get();
     }
 };
 
+/// The hash table over the build side of a join, keyed by the join key and
+/// holding the row numbers of the build input. Immutable once built, so
+/// joins with the same build side can share it, see BuildCache.
+struct JoinTable {
+    /// The hash table for the join
+    JoinHashTable hash_table;
+    /// Heavy-hitter keys of the build side, with all their build rows in one
+    /// list. They are kept out of hash_table so their fan-out is emitted in
+    /// bulk and never lands in a single hash partition.
+    std::unordered_map<uint64_t, std::vector<uint64_t>> heavy_hitters;
+
+    /// The constructor, the nodes are allocated in the arena (on the heap without one)
+    explicit JoinTable(Arena *arena = nullptr) : hash_table(arena) {};
+};
+
 class Join : public Operator {
 private:
     /// The input operators
     std::unique_ptr<Operator> left_, right_;
-    /// The join predicate info
-    PredicateInfo p_info_;
-
-    using HT = std::unordered_multimap<uint64_t, uint64_t>;
-
-    /// The hash table for the join
-    HT hash_table_;
+    /// The join predicates, all between the left and the right input. With
+    /// more than one the join is on the composite key of all of them.
+    std::vector<PredicateInfo> p_infos_;
+    /// A key column of an input: the values of row i are values[ids[i]], or
+    /// values[i] without ids (a bitmap input, its rows are the tuple ids)
+    struct KeyColumn {
+        const TupleId *ids;
+        const uint64_t *values;
+    };
+    /// The key columns of the left and the right input
+    std::vector<KeyColumn> left_keys_, right_keys_;
+    /// A result column of an input: the tuple ids of a binding, nullptr for
+    /// the binding of a bitmap input
+    struct InputColumn {
+        unsigned binding;
+        const TupleId *ids;
+    };
+    /// The result columns of the left and the right input
+    std::vector<InputColumn> left_columns_, right_columns_;
+    /// The inputs given as bitmaps, nullptr for tuple id lists. The rows of a
+    /// bitmap input are the rows of its relation set in the bitmap.
+    const Bitmap *left_bitmap_ = nullptr, *right_bitmap_ = nullptr;
+
+    /// The hash table of the build side, maybe shared with other queries
+    std::shared_ptr<const JoinTable> table_;
+    /// The cache key of the scans of the left and the right input, empty if
+    /// an input is not a plain scan of one binding
+    std::string left_scan_key_, right_scan_key_;
     /// Columns that have to be materialized
     std::unordered_set<SelectInfo> requested_columns_;
     /// Left/right columns that have been requested
     std::vector<SelectInfo> requested_columns_left_, requested_columns_right_;
-    /// The input data that has to be copied
-    std::vector<std::vector<TupleId>> *left_input_, *right_input_;
+
+    /// Number of build keys sampled to detect heavy hitters
+    static constexpr uint64_t kSkewSampleSize = 1024;
+    /// A sampled key is heavy if it makes up at least 1/kHeavyHitterFraction of the sample
+    static constexpr uint64_t kHeavyHitterFraction = 64;
+
+    /// The hash table did not fit into the memory budget, the inputs are partitioned to disk
+    bool spilled_ = false;
+    /// The accounted bytes of one hash table entry (the entry, its bucket and the build buffer)
+    static constexpr uint64_t kHashTableEntryBytes = 40;
+    /// The probe rows handled together, their lookups are batched and their matches copied in bulk
+    static constexpr uint64_t kProbeBlock = 256;
+    /// The maximum number of partitions of a spilled join
+    static constexpr unsigned kMaxSpillPartitions = 1024;
+    /// Probe sides up to this size are never split over several threads
+    static constexpr uint64_t kMinParallelProbe = 1 << 16;
+    /// The most key columns the key loops are instantiated for
+    static constexpr unsigned kMaxSpecializedKeys = 3;
 
 private:
-    /// Copy tuple to result
-    void copy2Result(uint64_t left_id, uint64_t right_id);
+    /// Copy tuple to out
+    void copy2Result(uint64_t left_id, uint64_t right_id, std::vector<TupleIds> &out);
+    /// Copy the matches of one probe tuple with many build tuples to out
+    void copy2Result(const std::vector<uint64_t> &left_ids, uint64_t right_id, std::vector<TupleIds> &out);
+    /// Copy the pairs of matching build and probe tuples to out
+    void copy2Result(const std::vector<uint64_t> &left_ids, const std::vector<uint64_t> &right_ids,
+                     std::vector<TupleIds> &out);
+    /// Sample the build keys and collect the heavy hitters
+    void detectHeavyHitters(JoinTable &table);
+    /// Fill a hash table with the build side
+    void fillTable(JoinTable &table);
+    /// Probe the in-memory hash table with the probe rows [begin, end), returns the number of results
+    template<unsigned NumKeys>
+    uint64_t probeRange(uint64_t begin, uint64_t end, std::vector<TupleIds> &out);
+    /// Grace hash join: partition both inputs to temp files and join one partition at a time
+    void graceJoin();
+    /// The result columns of an input, binding is the one of a bitmap input
+    static std::vector<InputColumn> inputColumns(Operator &input, const Bitmap *bitmap, unsigned binding);
+
+    /// The tuple id of row i of a result column
+    static uint64_t tupleId(const TupleId *ids, uint64_t i) {
+        return ids != nullptr ? ids[i] : i;
+    }
+    /// The end of the rows of an input, the size of the relation of a bitmap
+    static uint64_t numRows(const Operator &input, const Bitmap *bitmap) {
+        return bitmap != nullptr ? bitmap->size() : input.result_size();
+    }
+    /// Call f(i) for the rows i of an input in [begin, end): all of them for
+    /// tuple ids, the ones set for a bitmap
+    template<typename F>
+    static void forEachRow(const Bitmap *bitmap, uint64_t begin, uint64_t end, F &&f) {
+        if (bitmap != nullptr) {
+            bitmap->forEach(begin, end, f);
+            return;
+        }
+        for (uint64_t i = begin; i != end; ++i) {
+            f(i);
+        }
+    }
+
+    /// Call f(std::integral_constant<unsigned, NumKeys>()) with the number of
+    /// key columns as a constant, so f can instantiate its loops for it. More
+    /// than kMaxSpecializedKeys key columns are passed as 0, a runtime number.
+    template<typename F>
+    auto withNumKeys(F &&f) const {
+        switch (p_infos_.size()) {
+            case 1:
+                return f(std::integral_constant<unsigned, 1>());
+            case 2:
+                return f(std::integral_constant<unsigned, 2>());
+            case 3:
+                return f(std::integral_constant<unsigned, 3>());
+            default:
+                return f(std::integral_constant<unsigned, 0>());
+        }
+    }
+
+    /// The hash key of a row of an input, the hash of all columns for a
+    /// composite key. NumKeys is the number of key columns, 0 for keys.size().
+    template<unsigned NumKeys = 0>
+    static uint64_t key(const std::vector<KeyColumn> &keys, uint64_t i) {
+        size_t num_keys = NumKeys != 0 ? NumKeys : keys.size();
+        auto columns = keys.data();
+        uint64_t key = columns[0].values[tupleId(columns[0].ids, i)];
+        for (size_t k = 1; k < num_keys; ++k) {
+            uint64_t value = columns[k].values[tupleId(columns[k].ids, i)];
+            key ^= value + 0x9e3779b97f4a7c15ull + (key << 6) + (key >> 2);
+        }
+        return key;
+    }
+    /// Whether the composite keys of a left and a right row are really equal
+    template<unsigned NumKeys = 0>
+    bool keysEqual(uint64_t left_id, uint64_t right_id) const {
+        size_t num_keys = NumKeys != 0 ? NumKeys : left_keys_.size();
+        for (size_t k = 0; k < num_keys; ++k) {
+            if (left_keys_[k].values[tupleId(left_keys_[k].ids, left_id)]
+                != right_keys_[k].values[tupleId(right_keys_[k].ids, right_id)]) {
+                return false;
+            }
+        }
+        return true;
+    }
 
 public:
     /// The constructor
     Join(std::unique_ptr<Operator> &&left,
          std::unique_ptr<Operator> &&right,
          const PredicateInfo &p_info, std::shared_ptr<Context> context)
-            : left_(std::move(left)), right_(std::move(right)), p_info_(p_info) {
+            : Join(std::move(left), std::move(right), std::vector<PredicateInfo>{p_info}, std::move(context)) {};
+
+    /// The constructor for a join on the composite key of several predicates
+    Join(std::unique_ptr<Operator> &&left,
+         std::unique_ptr<Operator> &&right,
+         std::vector<PredicateInfo> p_infos, std::shared_ptr<Context> context)
+            : left_(std::move(left)), right_(std::move(right)), p_infos_(std::move(p_infos)) {
         context_ = std::move(context);
-        for (int i = 0; i < context_->relations_.size(); i++) {
-            tmp_results_.emplace_back();
-        }
+        allocateResults();
     };
 
     /// Require a column and add it to results
     bool require(SelectInfo info) override;
 
-    /// Run
+    /// Run, the same as prepare(), build() and probe() in order
     void run() override;
+
+    /// Set the cache keys of the inputs (see Joiner::scanKey), a build side
+    /// with a key can use the build cache of the context
+    void setScanKeys(std::string left_key, std::string right_key) {
+        left_scan_key_ = std::move(left_key);
+        right_scan_key_ = std::move(right_key);
+    }
+
+    /// Run the inputs and pick the smaller one as build side
+    void prepare();
+    /// Build the hash table over the build side
+    void build();
+    /// Probe the hash table with the probe side
+    void probe();
+
+    /// The heavy-hitter keys found during build
+    const std::unordered_map<uint64_t, std::vector<uint64_t>> &heavy_hitters() const {
+        return table_->heavy_hitters;
+    }
+    /// Whether the join spilled to disk
+    bool spilled() const {
+        return spilled_;
+    }
 };
 
 class SelfJoin : public Operator {
@@ -177,20 +374,18 @@ private:
     /// The required IUs
     std::set<SelectInfo> required_IUs_;
     /// The entire input data
-    std::vector<std::vector<TupleId>>* input_data_;
+    std::vector<TupleIds>* input_data_;
 
 private:
-    /// Copy tuple to result
-    void copy2Result(uint64_t id);
+    /// Copy the given input rows to result
+    void copy2Result(const std::vector<uint64_t> &rows);
 
 public:
     /// The constructor
     SelfJoin(std::unique_ptr<Operator> &&input, PredicateInfo &p_info, std::shared_ptr<Context> context)
             : input_(std::move(input)), p_info_(p_info) {
         context_ = std::move(context);
-        for (int i = 0; i < context_->relations_.size(); i++) {
-            tmp_results_.emplace_back();
-        }
+        allocateResults();
     };
 
     /// Require a column and add it to results
@@ -200,6 +395,96 @@ public:
     void run() override;
 };
 
+/// Worst-case optimal multiway join (Generic Join) over the inputs of all
+/// bindings of a query. Every class of columns that are equal by the join
+/// predicates is one join variable. The variables are bound one at a time by
+/// intersecting the sorted values of all inputs that contain them, so cyclic
+/// queries never materialize the pairwise join results.
+class MultiwayJoin : public Operator {
+private:
+    /// A range of rows in the sorted input of a binding
+    struct Range {
+        uint64_t begin, end;
+    };
+    /// The sorted input of one binding
+    struct Trie {
+        /// The tuple ids, sorted by the values of the binding's variables
+        std::vector<TupleId> rows;
+        /// values[level][i] is the value of the level-th variable in rows[i]
+        std::vector<std::vector<uint64_t>> values;
+    };
+
+    /// The inputs, indexed by binding (nullptr if not joined)
+    std::vector<std::unique_ptr<Operator>> inputs_;
+    /// The join predicates
+    std::vector<PredicateInfo> predicates_;
+    /// The sorted inputs, indexed by binding
+    std::vector<Trie> tries_;
+    /// For every variable in order, the bindings containing it and the trie level of it
+    std::vector<std::vector<std::pair<unsigned, unsigned>>> variables_;
+    /// The joined bindings
+    std::vector<unsigned> bindings_;
+
+private:
+    /// Sort the inputs by their variables
+    void buildTries();
+    /// Bind the variable at depth in all ranges
+    void join(unsigned depth, std::vector<Range> &ranges);
+    /// Copy the cross product of the ranges to result
+    void copy2Result(const std::vector<Range> &ranges);
+
+public:
+    /// The constructor
+    MultiwayJoin(std::vector<std::unique_ptr<Operator>> &&inputs,
+                 std::vector<PredicateInfo> predicates, std::shared_ptr<Context> context)
+            : inputs_(std::move(inputs)), predicates_(std::move(predicates)) {
+        context_ = std::move(context);
+        allocateResults();
+    };
+
+    /// Require a column and add it to results
+    bool require(SelectInfo info) override {
+        return true;
+    }
+
+    /// Run
+    void run() override;
+};
+
+/// An input that has already been run, its results are passed on as they are.
+/// Lets the adaptive planner execute a plan step by step.
+class Materialized : public Operator {
+private:
+    /// The input operator, already run
+    std::unique_ptr<Operator> input_;
+
+public:
+    /// The constructor
+    Materialized(std::unique_ptr<Operator> &&input, std::shared_ptr<Context> context)
+            : input_(std::move(input)) {
+        context_ = std::move(context);
+        result_size_ = input_->result_size();
+    };
+
+    /// Require a column and add it to results
+    bool require(SelectInfo info) override {
+        return true;
+    }
+
+    /// Run, nothing to do
+    void run() override {}
+
+    /// Get  late-materialized results
+    std::vector<TupleIds> *getResults() override {
+        return input_->getResults();
+    }
+
+    /// The result of the input as a bitmap, if it is one
+    const Bitmap *bitmap() override {
+        return input_->bitmap();
+    }
+};
+
 class Checksum : public Operator {
 private:
     /// The input operator
@@ -210,6 +495,10 @@ private:
     std::vector<uint64_t> check_sums_;
 
 public:
+    /// The minimal number of tuple ids summed on several threads
+    static constexpr uint64_t kMinParallelChecksum = 1 << 16;
+
+
     /// The constructor
     Checksum(std::unique_ptr<Operator> &&input,
              std::vector<SelectInfo> col_info, std::shared_ptr<Context> context)
@@ -7,7 +7,10 @@
 #include <vector>
 #include <memory>
 
+#include "arena.h"
+#include "memory_budget.h"
 #include "relation.h"
+#include "tasks.h"
 
 struct SelectInfo {
     /// Relation id
@@ -125,6 +128,10 @@ public:
     void parseQuery(std::string &raw_query){
         parseQuery(raw_query, 0);
     }
+    /// Check the syntax of a query from an untrusted source before it is
+    /// parsed, including that its bindings exist and are connected by join
+    /// predicates. Throws std::invalid_argument describing the first error.
+    static void checkSyntax(const std::string &raw_query);
 
     /// Dump text format
     std::string dumpText();
@@ -157,6 +164,8 @@ public:
     }
 
 private:
+    friend class Rewriter;
+
     /// Parse a single predicate
     void parsePredicate(std::string &raw_predicate);
     /// Resolve bindings of relation ids
@@ -164,14 +173,33 @@ private:
 
 };
 
+class BuildCache;
+
 class Context {
 public:
     Context(std::vector<const Relation*>& relations, std::shared_ptr<QueryInfo> query)
-        : relations_(relations), query_(std::move(query)) {}
+        : relations_(relations), query_(std::move(query)) {
+        for (auto relation: relations_) {
+            sizes_.push_back(relation->size());
+        }
+    }
     // The relations
     std::vector<const Relation*> relations_;
+    // The number of rows of every relation when the query started, the query
+    // does not see rows appended later
+    std::vector<uint64_t> sizes_;
     // The query
     std::shared_ptr<QueryInfo> query_;
+    // The memory budget of the query, unlimited unless set by the joiner
+    MemoryBudget memory_;
+    // The arena of the operator state of the query
+    Arena arena_;
+    // The build-side hash tables shared with other queries, may be null
+    BuildCache *build_cache_ = nullptr;
+    // The workers that can help with the query, null if it runs on one thread
+    TaskRunner *tasks_ = nullptr;
+    // The number of threads the query may use
+    unsigned parallelism_ = 1;
 
     // Get the column of a select info
     const TupleId* getColumn(const SelectInfo& info) const {
@@ -0,0 +1,77 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+#include "parser.h"
+#include "relation.h"
+#include "statistics.h"
+
+/// One step of a left-deep plan: join the binding to the intermediate result
+struct PlanStep {
+    /// The binding to join
+    unsigned binding;
+    /// The estimated size of the intermediate result after the join
+    double estimate;
+};
+
+/// Orders the joins of a query into a left-deep plan. The plan can be
+/// recomputed in the middle of the execution from the observed size of the
+/// intermediate result, see Joiner::join.
+class Planner {
+private:
+    /// The query
+    const QueryInfo &query_;
+    /// The relations of the bindings
+    const std::vector<const Relation *> &relations_;
+    /// The statistics of all relations, nullptr to use default selectivities
+    const Statistics *statistics_;
+    /// The selectivities of the sample joins between two bindings, negative if too few matched
+    mutable std::map<std::pair<unsigned, unsigned>, double> join_selectivities_;
+
+    /// The filters of a binding
+    std::vector<FilterInfo> filters(unsigned binding) const;
+    /// Estimated selectivity of the join predicates between two bindings,
+    /// columns are their (binding column, other column) pairs
+    double joinSelectivity(unsigned binding, double binding_size, unsigned other, double other_size,
+                           const std::vector<std::pair<unsigned, unsigned>> &columns) const;
+
+public:
+    /// Re-plan if an intermediate is off from its estimate by more than this factor
+    static constexpr double kReplanThreshold = 4.0;
+
+    /// The constructor
+    Planner(const QueryInfo &query, const std::vector<const Relation *> &relations,
+            const Statistics *statistics = nullptr)
+            : query_(query), relations_(relations), statistics_(statistics) {};
+
+    /// Estimated fraction of the tuples passing a filter
+    static double filterSelectivity(const FilterInfo &filter);
+    /// Estimated number of tuples of a binding after its filters
+    double estimateScan(unsigned binding) const;
+    /// Estimated size of joining an intermediate of the given bindings with another binding
+    double estimateJoin(const std::set<unsigned> &joined, double joined_size,
+                        unsigned binding, double binding_size) const;
+
+    /// Greedy left-deep plan over all joined bindings, the first step is the
+    /// binding the plan starts with. input_sizes are the sizes of the
+    /// bindings after their filters.
+    std::vector<PlanStep> plan(const std::vector<double> &input_sizes) const;
+    /// Continue a plan from an intermediate of the given bindings and size
+    std::vector<PlanStep> plan(std::set<unsigned> joined, double joined_size,
+                               const std::vector<double> &input_sizes) const;
+
+    /// Estimated cost of running the query: the scanned tuples plus the
+    /// tuples of all intermediate results of the plan
+    double estimateCost() const;
+
+    /// Whether the query graph of the bindings has a cycle (of at least three
+    /// bindings, several predicates between two bindings are no cycle)
+    bool isCyclic() const;
+
+    /// Whether an observed size is too far off from its estimate to keep the plan
+    static bool needsReplan(double estimate, double actual);
+};
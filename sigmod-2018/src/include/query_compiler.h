@@ -0,0 +1,132 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "batch.h"
+#include "parser.h"
+
+/// Compiles hot query templates to native code. A template is a rewritten
+/// query without its filter constants: the relations, predicates, filtered
+/// columns with their comparisons and the selections. Queries are
+/// interpreted until their template has run hot_threshold times, then a C++
+/// pipeline specialized for the template (its scans, the joins in the order
+/// the interpreter planned and the checksums) is generated and compiled by
+/// the system compiler into a shared object, in the background. Once it is
+/// loaded, the queries of the template run it with their filter constants
+/// as parameters. A template whose compilation or loading fails stays
+/// interpreted.
+class QueryCompiler {
+public:
+    /// A compiled pipeline: columns are the columns of the template's column
+    /// slots, rows the rows of every binding and constants the constants of
+    /// the filters in query order. Writes the checksums to sums and returns the
+    /// number of result tuples.
+    using Function = uint64_t (*)(const uint64_t *const *columns, const uint64_t *rows,
+                                  const uint64_t *constants, uint64_t *sums);
+
+    /// The runs of a template before it is compiled unless configured otherwise
+    static constexpr unsigned kDefaultHotThreshold = 3;
+
+    /// The configuration of a compiler
+    struct Options {
+        /// The interpreted runs of a template before it is compiled
+        unsigned hot_threshold = kDefaultHotThreshold;
+        /// The compiler command
+        std::string compiler = "c++";
+        /// The directory of the generated files, a new temporary one if empty
+        std::string directory;
+    };
+
+private:
+    /// What happened to a template
+    enum class State {
+        Interpreted,
+        Compiling,
+        Compiled,
+        /// Not compilable, or the compilation failed
+        Failed,
+    };
+    /// A query template
+    struct Template {
+        State state = State::Interpreted;
+        /// The interpreted runs
+        unsigned runs = 0;
+        /// The (binding, column) of every column slot
+        std::vector<std::pair<unsigned, unsigned>> slots;
+        /// The compiled pipeline
+        Function function = nullptr;
+    };
+    /// A template to compile
+    struct Job {
+        std::string key;
+        std::string source;
+    };
+
+    Options options_;
+    /// The templates by key
+    std::unordered_map<std::string, Template> templates_;
+    /// The templates waiting for the compiler thread
+    std::deque<Job> jobs_;
+    /// A job is being compiled
+    bool compiling_ = false;
+    bool stop_ = false;
+    /// The loaded shared objects
+    std::vector<void *> handles_;
+    /// The number of compiled files, names the next one
+    unsigned num_files_ = 0;
+    /// The directory was created by the compiler and is removed with it
+    bool own_directory_ = false;
+    /// The runs of compiled pipelines
+    uint64_t compiled_runs_ = 0;
+    std::mutex m_;
+    std::condition_variable cv_;
+    /// Compiles the jobs
+    std::thread thread_;
+
+    /// Compile the jobs until stopped
+    void compileLoop();
+    /// Compile a source file into a shared object and load its pipeline,
+    /// nullptr on any failure
+    Function compile(const std::string &source);
+
+public:
+    /// The constructor, with the default options
+    QueryCompiler() : QueryCompiler(Options()) {};
+    /// The constructor
+    explicit QueryCompiler(Options options);
+    /// The destructor, waits for a running compilation and removes the files
+    ~QueryCompiler();
+
+    /// The template key of a rewritten query
+    static std::string templateKey(const QueryInfo &query);
+    /// The source of the pipeline of a rewritten query joining the bindings in
+    /// order (a left-deep plan over all bindings, every one after the first
+    /// has a predicate to one before it). Fills the column slots the pipeline
+    /// expects.
+    static std::string generate(const QueryInfo &query, const std::vector<unsigned> &order,
+                                std::vector<std::pair<unsigned, unsigned>> &slots);
+
+    /// Run a rewritten query with the compiled pipeline of its template on
+    /// the relations and rows of the context, false if the template is not
+    /// compiled (yet) or the pipeline failed
+    bool run(const std::string &key, const QueryInfo &query, const Context &context, QueryResult &result);
+    /// Count an interpreted run of a template that joined the bindings in
+    /// order, the template is compiled when it becomes hot
+    void interpreted(const std::string &key, const QueryInfo &query, const std::vector<unsigned> &order);
+
+    /// Wait until all hot templates are compiled or failed
+    void wait();
+    /// The number of compiled and of failed templates
+    unsigned compiledTemplates();
+    unsigned failedTemplates();
+    /// The number of queries that ran compiled
+    uint64_t compiledRuns();
+};
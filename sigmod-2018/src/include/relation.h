@@ -1,21 +1,42 @@
 #pragma once
 
+#include <atomic>
 #include <cstdint>
 #include <string>
 #include <vector>
 #include <unordered_map>
 #include <map>
 
+#include "numa.h"
+
 using RelationId = unsigned;
 using TupleId = uint64_t;
 using Index = std::unordered_map<uint64_t, std::vector<TupleId>>;
 
 class Relation {
+public:
+    /// The number of rows a relation can grow to. The address range of an
+    /// appendable column is reserved for that many rows, so appends never
+    /// move a column. That is 32 GiB of address space per column, but no
+    /// memory until rows are committed. Where the address space is limited
+    /// (RLIMIT_AS), columns fall back to plain allocations and the relation
+    /// is not appendable.
+    static constexpr uint64_t kMaxRows = uint64_t(1) << 32;
+    /// The rows of an appendable column are committed in segments of this many
+    static constexpr uint64_t kSegmentRows = uint64_t(1) << 16;
+
 private:
     /// Owns memory (false if it was mmaped)
     bool owns_memory_=true;
-    /// The number of tuples
-    uint64_t size_;
+    /// The columns are reserved address ranges of kMaxRows rows
+    bool reserved_ = false;
+    /// The rows committed in every reserved column
+    uint64_t committed_ = 0;
+    /// The NUMA node holding the columns, -1 if unknown or interleaved
+    int home_node_ = -1;
+    /// The number of tuples. Published after the rows are written, so a
+    /// reader sees complete rows up to the size it read.
+    std::atomic<uint64_t> size_;
     /// The join column containing the keys
     std::vector<uint64_t *> columns_;
 
@@ -29,10 +50,16 @@ public:
             : owns_memory_(true), size_(size), columns_(columns) {}
     /// Constructor using mmap
     explicit Relation(const char *file_name);
+    /// A relation with uninitialized columns, to be filled in by a loader.
+    /// It is appendable unless the columns cannot be reserved.
+    static Relation allocate(uint64_t size, unsigned num_columns);
+    /// A relation on columns owned by someone else, e.g. a shared memory
+    /// segment. It is not appendable.
+    static Relation view(uint64_t size, std::vector<uint64_t *> columns);
     /// Delete copy constructor
     Relation(const Relation &other) = delete;
     /// Move constructor
-    Relation(Relation &&other) = default;
+    Relation(Relation &&other) noexcept;
 
     /// The destructor
     ~Relation();
@@ -46,14 +73,36 @@ public:
 
     /// The number of tuples
     uint64_t size() const {
-        return size_;
+        return size_.load(std::memory_order_acquire);
     }
     /// The join column containing the keys
     const std::vector<uint64_t *> &columns() const {
         return columns_;
     }
 
-    /// Build an index for all column
+    /// Move the columns to a NUMA node (node < 0 interleaves them over all nodes)
+    void place(int node, const NumaTopology &topology);
+    /// The NUMA node holding the columns, -1 if unknown or interleaved
+    int home_node() const {
+        return home_node_;
+    }
+
+    /// Move the columns into reserved address ranges, so rows can be appended.
+    /// Invalidates the column pointers: call it before queries see the relation.
+    /// Returns false, and keeps the columns, if they cannot be reserved.
+    bool makeAppendable();
+    /// Whether rows can be appended
+    bool appendable() const {
+        return reserved_;
+    }
+    /// Append count rows, columns[c] holds their values of column c. Running
+    /// readers are not disturbed: the columns stay in place and the new rows
+    /// become visible at once when the size is published. Appends must not
+    /// run concurrently with each other or with match(). Throws if the
+    /// relation is not appendable or would grow beyond kMaxRows.
+    void append(const std::vector<const uint64_t *> &columns, uint64_t count);
+
+    /// Build an index for all column, append() keeps it up to date
     void buildIndex();
     /// Match with Index and Return matched tuple ids
     std::vector<TupleId> match(const uint64_t key, const uint64_t column_id) const;
@@ -61,5 +110,9 @@ public:
 private:
     /// Loads data from a file
     void loadRelation(const char *file_name);
+    /// Allocate the columns for rows rows, reserved if possible
+    void allocateColumns(unsigned num_columns, uint64_t rows);
+    /// Commit the reserved columns up to at least rows rows
+    void commit(uint64_t rows);
 };
 
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "parser.h"
+
+/// Rewrites a parsed query before it is planned. The columns connected by
+/// equi-join predicates form equivalence classes: the filters of a class are
+/// tightened to one range and pushed to all of its columns, predicates that
+/// follow from the others are dropped, and the filters are ordered by their
+/// estimated selectivity.
+class Rewriter {
+public:
+    /// Rewrite a query, false if its filters contradict each other (the result is empty)
+    static bool rewrite(QueryInfo &query);
+};
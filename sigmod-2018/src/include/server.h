@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <list>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include "joiner.h"
+
+/// Serves the query protocol of the driver over a Unix domain socket. Every
+/// connection is a session: it sends queries, one per line, and "F" to end a
+/// batch, and gets the checksums of the batch back in query order, or
+/// "ERROR <reason>" for a query that is malformed or names a relation or
+/// column that does not exist. The batches of all sessions run concurrently
+/// on the workers and the build cache of one Joiner.
+class Server {
+private:
+    /// A connection and the thread serving it
+    struct Session {
+        int fd;
+        std::thread thread;
+        /// The thread has finished and can be joined
+        std::atomic<bool> done{false};
+    };
+
+    /// The joiner running the queries
+    Joiner &joiner_;
+    /// The path of the socket
+    std::string path_;
+    /// The listening socket
+    int listen_fd_ = -1;
+    /// Accepts the connections
+    std::thread accept_thread_;
+    /// The sessions, finished ones are joined by the accepting thread
+    std::list<Session> sessions_;
+    std::mutex m_;
+    /// stop() has been called
+    std::atomic<bool> stopping_{false};
+
+    /// Accept connections until the server is stopped
+    void acceptLoop();
+    /// Serve the batches of a session until the client disconnects
+    void serve(Session &session);
+    /// Run the queries of a batch that passed the checks, returns the
+    /// response with an error line in place of every query that did not
+    std::string runBatch(std::vector<QueryInfo> &queries, const std::vector<std::string> &errors);
+
+public:
+    /// The constructor
+    Server(Joiner &joiner, std::string path) : joiner_(joiner), path_(std::move(path)) {};
+    /// The destructor, stops the server
+    ~Server();
+
+    /// Listen on the socket and accept sessions in the background. Replaces a
+    /// stale socket file. Throws if the socket cannot be created.
+    void start();
+    /// Stop accepting, disconnect the sessions once their running batches
+    /// are answered and remove the socket file
+    void stop();
+};
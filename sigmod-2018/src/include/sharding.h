@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+
+#include "batch.h"
+#include "parser.h"
+#include "relation.h"
+
+/// Runs batches on local worker processes. The coordinator copies the
+/// relations into a shared memory segment, every relation hash partitioned
+/// by the column the queries join on most, so partition w of every relation
+/// is a contiguous range of rows. Worker w runs every query on partition w
+/// of the bindings that are joined to the driving binding on partition
+/// columns, and on all rows of the other bindings: every result tuple is
+/// produced by exactly one worker, the one owning the partition of its join
+/// key. The coordinator adds up the checksums of the workers.
+class ShardedExecutor {
+public:
+    /// The worker processes unless configured otherwise
+    static constexpr unsigned kDefaultWorkers = 4;
+
+    /// The configuration of an executor
+    struct Options {
+        /// The number of worker processes and partitions
+        unsigned workers = kDefaultWorkers;
+    };
+
+private:
+    /// A relation in the shared segment
+    struct SharedRelation {
+        /// The column the rows are partitioned by
+        unsigned partition_column = 0;
+        /// The columns, rows grouped by partition
+        std::vector<uint64_t *> columns;
+        /// Partition w holds the rows [bounds[w], bounds[w + 1])
+        std::vector<uint64_t> bounds;
+    };
+    /// A worker process and the coordinator's end of its socket
+    struct Worker {
+        pid_t pid = -1;
+        int fd = -1;
+    };
+
+    Options options_;
+    std::vector<SharedRelation> relations_;
+    std::vector<Worker> workers_;
+    /// The shared segment
+    void *segment_ = nullptr;
+    uint64_t segment_bytes_ = 0;
+    /// Serializes the batches and the restarts
+    std::mutex m_;
+
+    /// Partition the relations by the join columns the queries use most and
+    /// start the workers
+    void start(const std::vector<Relation> &relations, const std::vector<QueryInfo> &queries);
+    /// Stop the workers and release the segment, with m_ held
+    void stopLocked();
+    /// Run the queries of the batches it receives on partition worker
+    [[noreturn]] void serve(unsigned worker, int fd);
+
+public:
+    /// The constructor, with the default options
+    ShardedExecutor() : ShardedExecutor(Options()) {};
+    /// The constructor, the workers are started by the first batch
+    explicit ShardedExecutor(Options options);
+    /// The destructor, stops the workers
+    ~ShardedExecutor();
+
+    /// The partition of a join key
+    static unsigned partitionOf(uint64_t key, unsigned workers) {
+        return ((key * 0x9e3779b97f4a7c15ull) >> 32) % workers;
+    }
+    /// The column of every relation the queries join on most, ties and
+    /// relations that are not joined go to the lowest column
+    static std::vector<unsigned> partitionColumns(const std::vector<Relation> &relations,
+                                                  const std::vector<QueryInfo> &queries);
+    /// The bindings of a query that only read the partition of a worker: the
+    /// bindings joined to each other on their partition columns with the
+    /// most rows together
+    static std::vector<bool> partitionedBindings(const QueryInfo &query, const std::vector<unsigned> &columns,
+                                                 const std::vector<Relation> &relations);
+
+    /// Run a batch on the workers and write the combined checksums, starting
+    /// the workers on the relations if they are not running. Throws if a
+    /// worker fails, the workers are stopped then.
+    void run(const std::vector<Relation> &relations, const std::vector<QueryInfo> &queries,
+             const std::vector<QueryResult *> &results);
+    /// Stop the workers, the next batch partitions the relations again
+    void stop();
+
+    /// The number of workers
+    unsigned workers() const {
+        return options_.workers;
+    }
+};
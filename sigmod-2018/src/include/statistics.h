@@ -0,0 +1,141 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "parser.h"
+#include "relation.h"
+
+/// Approximate number of distinct values of a column (HyperLogLog, 2^kPrecision
+/// registers, about 1.6% standard error)
+class HyperLogLog {
+public:
+    /// The number of bits of the hash choosing a register
+    static constexpr unsigned kPrecision = 12;
+
+private:
+    /// The longest run of leading zeros seen per register, plus one
+    std::vector<uint8_t> registers_;
+
+public:
+    /// The constructor
+    HyperLogLog() : registers_(1u << kPrecision, 0) {};
+
+    /// Add a value
+    void add(uint64_t value) {
+        // murmur3 finalizer, the values themselves are far from uniform
+        uint64_t hash = value;
+        hash ^= hash >> 33;
+        hash *= 0xff51afd7ed558ccdull;
+        hash ^= hash >> 33;
+        hash *= 0xc4ceb9fe1a85ec53ull;
+        hash ^= hash >> 33;
+        auto &reg = registers_[hash >> (64 - kPrecision)];
+        // The remaining bits with a stop bit, so a zero rest is well defined
+        uint64_t rest = (hash << kPrecision) | (uint64_t(1) << (kPrecision - 1));
+        reg = std::max<uint8_t>(reg, __builtin_clzll(rest) + 1);
+    }
+
+    /// The estimated number of distinct values added
+    double estimate() const;
+};
+
+/// The statistics of one relation: a uniform sample of its rows and the
+/// distinct counts of its columns. The sampled values of all columns are
+/// aligned, sample(c)[i] and sample(d)[i] belong to the same row, so filters
+/// and join predicates on several columns can be evaluated on the sample.
+/// Appended rows are added incrementally: they go through reservoir sampling
+/// and into the distinct count sketches.
+class RelationStatistics {
+public:
+    /// The number of sampled rows, smaller relations are sampled completely
+    static constexpr uint64_t kSampleSize = 1024;
+
+private:
+    /// The number of rows of the relation
+    uint64_t rows_ = 0;
+    /// The sampled values of every column
+    std::vector<std::vector<uint64_t>> sample_;
+    /// The distinct counts of every column
+    std::vector<double> distinct_;
+    /// The distinct count sketches of every column
+    std::vector<HyperLogLog> sketches_;
+    /// Chooses the sampled rows
+    std::mt19937_64 gen_;
+
+    /// Estimate the distinct counts from the sketches
+    void updateDistinct();
+
+public:
+    /// The constructor, samples the relation and counts its distinct values
+    explicit RelationStatistics(const Relation &relation, uint64_t seed = 42);
+
+    /// The number of rows of the relation
+    uint64_t rows() const {
+        return rows_;
+    }
+    /// The number of sampled rows
+    uint64_t sampleSize() const {
+        return sample_.empty() ? 0 : sample_[0].size();
+    }
+    /// The sampled values of a column
+    const std::vector<uint64_t> &sample(unsigned col_id) const {
+        return sample_[col_id];
+    }
+    /// The estimated number of distinct values of a column
+    double distinct(unsigned col_id) const {
+        return distinct_[col_id];
+    }
+
+    /// Add the rows [begin, end) appended to the relation
+    void append(const Relation &relation, uint64_t begin, uint64_t end);
+
+    /// Whether sampled row i passes the filters (all on this relation)
+    bool passes(uint64_t i, const std::vector<FilterInfo> &filters) const;
+};
+
+/// The statistics of all relations, by relation id. The statistics of a
+/// relation are shared between copies and replaced as a whole when rows are
+/// appended, so a copy is a cheap, consistent snapshot.
+class Statistics {
+public:
+    /// A sample join with fewer matches is too noisy, the distinct counts are used instead
+    static constexpr uint64_t kMinSampleMatches = 16;
+
+private:
+    /// The statistics of every relation
+    std::vector<std::shared_ptr<const RelationStatistics>> relations_;
+
+public:
+    /// Add the statistics of the next relation
+    void addRelation(const Relation &relation) {
+        relations_.push_back(std::make_shared<const RelationStatistics>(relation));
+    }
+    /// Replace the statistics of a relation, copies taken before keep the old ones
+    void replace(RelationId rel_id, std::shared_ptr<const RelationStatistics> stats) {
+        relations_[rel_id] = std::move(stats);
+    }
+    /// The statistics of a relation
+    const RelationStatistics &relation(RelationId rel_id) const {
+        return *relations_[rel_id];
+    }
+    /// The number of relations
+    size_t size() const {
+        return relations_.size();
+    }
+
+    /// Estimated fraction of the rows of a relation passing the filters
+    double filterSelectivity(RelationId rel_id, const std::vector<FilterInfo> &filters) const;
+    /// Estimated fraction of the pairs of filtered rows of two relations (the
+    /// same one for a self join) for which all column pairs (left column,
+    /// right column) are equal, from a join of the filtered samples. Negative
+    /// if the samples have fewer than kMinSampleMatches matches, the caller
+    /// falls back to distinct counts.
+    double joinSelectivity(RelationId left, const std::vector<FilterInfo> &left_filters,
+                           RelationId right, const std::vector<FilterInfo> &right_filters,
+                           const std::vector<std::pair<unsigned, unsigned>> &columns) const;
+};
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <functional>
+
+/// Runs functions on the worker threads, lets a query hand parts of its work
+/// to idle workers
+class TaskRunner {
+public:
+    /// The destructor
+    virtual ~TaskRunner() = default;
+    /// Run a function on some worker thread
+    virtual void submit(std::function<void()> task) = 0;
+};
+
+/// Call f(chunk) for all chunks in [0, num_chunks) on up to parallelism
+/// threads. The calling thread works on the chunks as well, so this never
+/// waits for a busy worker to pick up its task. Without a runner all chunks
+/// run on the calling thread.
+void parallelFor(TaskRunner *runner, unsigned parallelism, unsigned num_chunks,
+                 const std::function<void(unsigned)> &f);
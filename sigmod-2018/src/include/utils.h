@@ -9,6 +9,12 @@ public:
     /// Create a dummy relation
     static Relation createRelation(uint64_t size, uint64_t num_columns);
 
+    /// Create a relation with random values in [0, key_domain), Zipf distributed
+    /// with the given skew (0 means uniform)
+    static Relation createZipfRelation(uint64_t size, uint64_t num_columns,
+                                       uint64_t key_domain, double skew,
+                                       uint64_t seed = 42);
+
     /// Store a relation in all formats
     static void storeRelation(std::ofstream &out, Relation &r, unsigned i);
 };
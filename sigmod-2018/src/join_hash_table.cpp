@@ -0,0 +1,31 @@
+#include "join_hash_table.h"
+
+// Build the table with a counting sort of the entries by bucket
+void JoinHashTable::build(const std::vector<Entry> &entries) {
+    // About one entry per bucket
+    bits_ = 1;
+    while ((uint64_t(1) << bits_) < entries.size() && bits_ < 63) {
+        ++bits_;
+    }
+    uint64_t num_buckets = uint64_t(1) << bits_;
+
+    // Count, then turn the counts into the start of every bucket
+    bucket_starts_.assign(num_buckets + 1, 0);
+    for (auto &entry: entries) {
+        ++bucket_starts_[bucket(entry.key) + 1];
+    }
+    for (uint64_t b = 1; b <= num_buckets; ++b) {
+        bucket_starts_[b] += bucket_starts_[b - 1];
+    }
+
+    // Scatter, using the starts as cursors. Afterwards bucket_starts_[b] is
+    // the end of bucket b, shifting by one gives the starts again.
+    entries_.resize(entries.size());
+    for (auto &entry: entries) {
+        entries_[bucket_starts_[bucket(entry.key)]++] = entry;
+    }
+    for (uint64_t b = num_buckets; b > 0; --b) {
+        bucket_starts_[b] = bucket_starts_[b - 1];
+    }
+    bucket_starts_[0] = 0;
+}
@@ -1,5 +1,6 @@
 #include "joiner.h"
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <string>
@@ -7,57 +8,136 @@
 #include <utility>
 #include <set>
 #include <sstream>
+#include <stdexcept>
+#include <tuple>
 #include <vector>
 
 #include "parser.h"
-
-namespace {
-
-// Left表示左边的关系表已经用过了，Right表示右边的关系表已经用过了
-    enum QueryGraphProvides {
-        Left, Right, Both, None
-    };
-
-// Analyzes inputs of join
-    QueryGraphProvides analyzeInputOfJoin(std::set<unsigned> &usedRelations,
-                                          SelectInfo &leftInfo,
-                                          SelectInfo &rightInfo) {
-        bool used_left = usedRelations.count(leftInfo.binding);
-        bool used_right = usedRelations.count(rightInfo.binding);
-
-        if (used_left ^ used_right)
-            return used_left ? QueryGraphProvides::Left : QueryGraphProvides::Right;
-        if (used_left && used_right)
-            return QueryGraphProvides::Both;
-        return QueryGraphProvides::None;
-    }
-}
+#include "planner.h"
+#include "rewriter.h"
 
 // Loads a relation_ from disk
 void Joiner::addRelation(const char *file_name) {
     relations_.emplace_back(file_name);
     relations_.back().storeRelationCSV("r" + std::to_string(relations_.size() - 1) + ".csv");
+    placeRelation(relations_.back());
+    statistics_.addRelation(relations_.back());
 }
 
 void Joiner::addRelation(Relation &&relation) {
     relations_.emplace_back(std::move(relation));
+    relations_.back().makeAppendable();
+    placeRelation(relations_.back());
+    statistics_.addRelation(relations_.back());
+}
+
+void Joiner::addSharedRelation(Relation &&relation) {
+    relations_.emplace_back(std::move(relation));
+    statistics_.addRelation(relations_.back());
+}
+
+// Append rows to a relation
+void Joiner::appendRows(RelationId relation_id, const std::vector<const uint64_t *> &columns, uint64_t count) {
+    std::lock_guard<std::mutex> lk(append_mutex_);
+    auto &relation = relations_.at(relation_id);
+    uint64_t begin = relation.size();
+    relation.append(columns, count);
+    // The shards are copies, they are made again by the next batch
+    if (sharding_) {
+        sharding_->stop();
+    }
+    // The new statistics are computed aside, queries only wait for the swap
+    auto stats = std::make_shared<RelationStatistics>(statistics_.relation(relation_id));
+    stats->append(relation, begin, begin + count);
+    std::unique_lock<std::shared_mutex> swap(statistics_mutex_);
+    statistics_.replace(relation_id, std::move(stats));
+}
+
+// A snapshot of the statistics
+Statistics Joiner::currentStatistics() {
+    std::shared_lock<std::shared_mutex> lk(statistics_mutex_);
+    return statistics_;
+}
+
+// Place a relation according to the NUMA policy
+void Joiner::placeRelation(Relation &relation) {
+    switch (numa_policy_) {
+        case NumaPolicy::None:
+            break;
+        case NumaPolicy::Interleave:
+            relation.place(-1, topology_);
+            break;
+        case NumaPolicy::PerNode: {
+            // The node with the fewest bytes so far
+            auto node = std::min_element(node_bytes_.begin(), node_bytes_.end()) - node_bytes_.begin();
+            relation.place(node, topology_);
+            node_bytes_[node] += relation.size() * relation.columns().size() * sizeof(uint64_t);
+            break;
+        }
+    }
+}
+
+// Enable NUMA awareness
+void Joiner::enableNuma(NumaPolicy policy, NumaTopology topology) {
+    numa_policy_ = policy;
+    topology_ = std::move(topology);
+    node_bytes_.assign(topology_.numNodes(), 0);
+    request_queue_.Resize(policy == NumaPolicy::None ? 1 : topology_.numNodes() + 1);
+    for (auto &relation: relations_) {
+        placeRelation(relation);
+    }
+}
+
+// The node holding the largest relation of the query
+int Joiner::homeNode(const QueryInfo &query) const {
+    if (numa_policy_ == NumaPolicy::None) {
+        return -1;
+    }
+    const Relation *largest = nullptr;
+    for (auto rel_id: query.relation_ids()) {
+        if (largest == nullptr || relations_[rel_id].size() > largest->size()) {
+            largest = &relations_[rel_id];
+        }
+    }
+    return largest == nullptr ? -1 : largest->home_node();
 }
 
 // Loads a relation from disk
 const Relation &Joiner::getRelation(unsigned relation_id) {
     if (relation_id >= relations_.size()) {
-        std::cerr << "Relation with id: " << relation_id << " does not exist"
-                  << std::endl;
-        throw;
+        throw std::out_of_range("relation with id " + std::to_string(relation_id) + " does not exist");
     }
     return relations_[relation_id];
 }
 
+// Check the relations and columns of a query
+void Joiner::checkQuery(const QueryInfo &query) const {
+    for (auto rel_id: query.relation_ids()) {
+        if (rel_id >= relations_.size()) {
+            throw std::invalid_argument("relation with id " + std::to_string(rel_id) + " does not exist");
+        }
+    }
+    auto check = [&](const SelectInfo &info) {
+        if (info.col_id >= relations_[info.rel_id].columns().size()) {
+            throw std::invalid_argument("relation " + std::to_string(info.rel_id) + " has no column "
+                                        + std::to_string(info.col_id));
+        }
+    };
+    for (auto &p: query.predicates()) {
+        check(p.left);
+        check(p.right);
+    }
+    for (auto &f: query.filters()) {
+        check(f.filter_column);
+    }
+    for (auto &s: query.selections()) {
+        check(s);
+    }
+}
+
 // Add scan to query
-std::unique_ptr<Operator> Joiner::addScan(std::set<unsigned> &used_relations,
-                                          const SelectInfo &info,
+std::unique_ptr<Operator> Joiner::addScan(const SelectInfo &info,
                                           QueryInfo &query, std::shared_ptr<Context> context) {
-    used_relations.emplace(info.binding);
     std::vector<FilterInfo> filters;
     for (auto &f: query.filters()) {
         if (f.filter_column.binding == info.binding) { // filter所作用的关系表和info的关系表一致
@@ -71,8 +151,41 @@ std::unique_ptr<Operator> Joiner::addScan(std::set<unsigned> &used_relations,
                                                      info.binding, context);
 }
 
+// The cache key of the scan of a binding
+std::string Joiner::scanKey(unsigned binding, const QueryInfo &query, uint64_t rows) {
+    // The filters are in a canonical order, so equal scans get equal keys
+    std::vector<std::tuple<unsigned, char, uint64_t>> filters;
+    for (auto &f: query.filters()) {
+        if (f.filter_column.binding == binding) {
+            filters.emplace_back(f.filter_column.col_id, f.comparison, f.constant);
+        }
+    }
+    std::sort(filters.begin(), filters.end());
+    // Queries that see different snapshots of the relation do not share tables
+    std::string key = std::to_string(query.relation_ids()[binding]) + "@" + std::to_string(rows);
+    for (auto &[col_id, comparison, constant]: filters) {
+        key += "&" + std::to_string(col_id) + comparison + std::to_string(constant);
+    }
+    return key;
+}
+
 // Executes a join query
 std::string Joiner::join(QueryInfo &query) {
+    QueryResult result;
+    join(query, result);
+    std::string out;
+    result.format(out);
+    return out;
+}
+
+// Executes a join query into a result record
+void Joiner::join(QueryInfo &query, QueryResult &result, unsigned parallelism) {
+    result.resize(query.selections().size());
+    if (!Rewriter::rewrite(query)) {
+        result.empty = true;
+        return;
+    }
+
     // 创建一个vector，用于存储需要用到的关系表
     std::vector<const Relation *> relations;
     for (const auto &rel_id: query.relation_ids()) {
@@ -80,97 +193,382 @@ std::string Joiner::join(QueryInfo &query) {
     }
     auto q = std::make_shared<QueryInfo>(query);
     auto context = std::make_shared<Context>(relations, q);
+    context->memory_.reset(query_memory_limit_, &memory_);
+    context->build_cache_ = &build_cache_;
+    if (parallelism > 1) {
+        context->tasks_ = this;
+        context->parallelism_ = parallelism;
+    }
+    // A hot template runs its compiled pipeline
+    std::string template_key;
+    if (compiler_ && parallelism <= 1) {
+        template_key = QueryCompiler::templateKey(query);
+        if (compiler_->run(template_key, query, *context, result)) {
+            return;
+        }
+    }
 
-    // 创建一个set，用于存储已经用过的关系表
-    std::set<unsigned> used_relations;
-
-    // We always start with the first join predicate and append the other joins
-    // to it (--> left-deep join trees). You might want to choose a smarter
-    // join ordering ...
-    const auto &firstJoin = query.predicates()[0];
-    std::unique_ptr<Operator> left, right;
-    left = addScan(used_relations, firstJoin.left, query, context);
-    right = addScan(used_relations, firstJoin.right, query, context);
-    std::unique_ptr<Operator>
-            root = std::make_unique<Join>(move(left), move(right), firstJoin, context);
-
-    auto predicates_copy = query.predicates();
-    for (unsigned i = 1; i < predicates_copy.size(); ++i) {
-        auto &p_info = predicates_copy[i];
-        auto &left_info = p_info.left;
-        auto &right_info = p_info.right;
-
-        switch (analyzeInputOfJoin(used_relations, left_info, right_info)) {
-            case QueryGraphProvides::Left:
-                left = move(root);
-                right = addScan(used_relations, right_info, query, context);
-                root = std::make_unique<Join>(move(left), move(right), p_info, context);
-                break;
-            case QueryGraphProvides::Right:
-                left = addScan(used_relations,
-                               left_info,
-                               query, context);
-                right = move(root);
-                root = std::make_unique<Join>(move(left), move(right), p_info, context);
-                break;
-            case QueryGraphProvides::Both:
-                // All relations of this join are already used somewhere else in the
-                // query. Thus, we have either a cycle in our join graph or more than
-                // one join predicate per join.
-                root = std::make_unique<SelfJoin>(move(root), p_info, context);
-                break;
-            case QueryGraphProvides::None:
-                // Process this predicate later when we can connect it to the other
-                // joins. We never have cross products.
-                predicates_copy.push_back(p_info);
-                break;
-        };
+    // Run the scans of all joined bindings first, so the plan starts from
+    // their exact sizes
+    std::vector<std::unique_ptr<Operator>> inputs(relations.size());
+    std::vector<double> input_sizes(relations.size(), 0);
+    std::vector<SelectInfo> scanned;
+    for (auto &p_info: query.predicates()) {
+        scanned.push_back(p_info.left);
+        scanned.push_back(p_info.right);
+    }
+    // The rewriter drops predicates like 0.0=0.0, the query is a filtered scan
+    if (scanned.empty()) {
+        scanned.push_back(query.selections()[0]);
+    }
+    for (auto &info: scanned) {
+        if (inputs[info.binding]) continue;
+        inputs[info.binding] = addScan(info, query, context);
+        inputs[info.binding]->run();
+        if (inputs[info.binding]->result_size() == 0) {
+            result.empty = true;
+            return;
+        }
+        input_sizes[info.binding] = inputs[info.binding]->result_size();
+    }
+
+    auto statistics = currentStatistics();
+    Planner planner(query, relations, use_statistics_ ? &statistics : nullptr);
+    if (estimate_observer_) {
+        for (unsigned binding = 0; binding < relations.size(); ++binding) {
+            if (inputs[binding]) {
+                estimate_observer_(false, planner.estimateScan(binding), inputs[binding]->result_size());
+            }
+        }
+    }
+    std::unique_ptr<Operator> root;
+    if (planner.isCyclic()) {
+        // Binary joins would build the large pairwise results of the cycle
+        std::vector<std::unique_ptr<Operator>> materialized(relations.size());
+        for (unsigned binding = 0; binding < relations.size(); ++binding) {
+            if (inputs[binding]) {
+                materialized[binding] = std::make_unique<Materialized>(move(inputs[binding]), context);
+            }
+        }
+        root = std::make_unique<MultiwayJoin>(move(materialized), query.predicates(), context);
+        checksum(move(root), query, context, result);
+        return;
+    }
+
+    // Left-deep plan, executed one join at a time. After every join the
+    // observed size is compared with the estimate, and the rest of the plan
+    // is redone from the materialized intermediate if they diverge.
+    auto plan = planner.plan(input_sizes);
+    if (plan.empty()) {
+        auto binding = scanned[0].binding;
+        plan.push_back({binding, input_sizes[binding]});
+    }
+    if (!template_key.empty()) {
+        std::vector<unsigned> order;
+        for (auto &step: plan) order.push_back(step.binding);
+        compiler_->interpreted(template_key, query, order);
     }
 
+    std::set<unsigned> joined;
+    std::vector<bool> applied(query.predicates().size(), false);
+    // The cache key of root while it is a plain scan
+    std::string root_key;
+    for (size_t step = 0; step < plan.size(); ++step) {
+        auto binding = plan[step].binding;
+        joined.insert(binding);
+
+        // The predicates between the new binding and the joined ones
+        std::vector<PredicateInfo> predicates;
+        for (unsigned i = 0; i < query.predicates().size(); ++i) {
+            auto &p_info = query.predicates()[i];
+            if (applied[i]) continue;
+            if ((p_info.left.binding == binding && joined.count(p_info.right.binding))
+                || (p_info.right.binding == binding && joined.count(p_info.left.binding))) {
+                predicates.push_back(p_info);
+                applied[i] = true;
+            }
+        }
+
+        std::unique_ptr<Operator> input = std::make_unique<Materialized>(move(inputs[binding]), context);
+        if (!root) {
+            root = move(input);
+            if (predicates.empty()) {
+                root_key = scanKey(binding, query, context->sizes_[binding]);
+            }
+        } else {
+            // Join on the composite key of all predicates to the joined bindings,
+            // predicates within the new binding are checked on its result
+            std::vector<PredicateInfo> join_predicates, self_predicates;
+            std::set<std::pair<std::pair<unsigned, unsigned>, std::pair<unsigned, unsigned>>> key_columns;
+            for (auto p_info: predicates) {
+                if (p_info.left.binding == p_info.right.binding) {
+                    self_predicates.push_back(p_info);
+                    continue;
+                }
+                // The left side of the predicate belongs to the left input
+                if (p_info.left.binding == binding) {
+                    std::swap(p_info.left, p_info.right);
+                }
+                // The same predicate written twice is only one key column
+                if (key_columns.emplace(std::make_pair(p_info.left.binding, p_info.left.col_id),
+                                        std::make_pair(p_info.right.binding, p_info.right.col_id)).second) {
+                    join_predicates.push_back(p_info);
+                }
+            }
+            auto join = std::make_unique<Join>(move(root), move(input), join_predicates, context);
+            join->setScanKeys(move(root_key), scanKey(binding, query, context->sizes_[binding]));
+            root = move(join);
+            root_key.clear();
+            predicates = move(self_predicates);
+        }
+        for (auto &p_info: predicates) {
+            root = std::make_unique<SelfJoin>(move(root), p_info, context);
+        }
+        root->run();
+        if (step > 0 && estimate_observer_) {
+            estimate_observer_(true, plan[step].estimate, root->result_size());
+        }
+        if (root->result_size() == 0) {
+            result.empty = true;
+            return;
+        }
+        if (step + 1 < plan.size() && Planner::needsReplan(plan[step].estimate, root->result_size())) {
+            auto rest = planner.plan(joined, root->result_size(), input_sizes);
+            plan.resize(step + 1);
+            plan.insert(plan.end(), rest.begin(), rest.end());
+        }
+        root = std::make_unique<Materialized>(move(root), context);
+    }
+    checksum(move(root), query, context, result);
+}
+
+// Computes the checksums of the query result
+void Joiner::checksum(std::unique_ptr<Operator> root, QueryInfo &query,
+                      std::shared_ptr<Context> context, QueryResult &result) {
     Checksum checksum(move(root), query.selections(), context);
     checksum.run();
 
-    std::stringstream out;
-    auto &results = checksum.check_sums();
-    for (unsigned i = 0; i < results.size(); ++i) {
-        out << (checksum.result_size() == 0 ? "NULL" : std::to_string(results[i]));
-        if (i < results.size() - 1)
-            out << " ";
-    }
-    out << "\n";
-    return out.str();
+    result.empty = checksum.result_size() == 0;
+    std::copy(checksum.check_sums().begin(), checksum.check_sums().end(), result.data());
 }
 
 void Joiner::scheduleQuery(std::optional<QueryInfo> query) {
-    request_queue_.Put(*query);
+    Task task;
+    task.result = batch_->add(query->selections().size());
+    task.batch = batch_.get();
+    task.query = std::move(*query);
+    if (query_observer_) {
+        task.enqueued_ns = QueryTrace::now();
+    }
+    pending_.push_back(std::move(task));
+}
+
+// The estimated cost of a query
+double Joiner::estimateCost(const QueryInfo &query) {
+    std::vector<const Relation *> relations;
+    for (auto rel_id: query.relation_ids()) {
+        relations.push_back(&getRelation(rel_id));
+    }
+    auto statistics = currentStatistics();
+    return Planner(query, relations, use_statistics_ ? &statistics : nullptr).estimateCost();
+}
+
+// Run the copies of a query once
+void Joiner::deduplicate(std::vector<Task> &tasks) {
+    if (!deduplicate_ || tasks.size() < 2) {
+        return;
+    }
+    std::vector<CanonicalQuery> canonical;
+    std::unordered_map<std::string, std::vector<size_t>> copies;
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        canonical.push_back(Canonicalizer::canonicalize(tasks[i].query));
+        copies[canonical.back().key].push_back(i);
+    }
+    if (copies.size() == tasks.size()) {
+        return;
+    }
+    // The first copy of a query takes its place in the batch
+    std::vector<Task> deduplicated;
+    for (size_t i = 0; i < tasks.size(); ++i) {
+        auto &indexes = copies[canonical[i].key];
+        if (indexes.size() == 1) {
+            deduplicated.push_back(std::move(tasks[i]));
+            continue;
+        }
+        if (indexes[0] != i) continue;
+        Task task;
+        task.query = std::move(canonical[i].query);
+        task.query.query_id_ = tasks[i].query.query_id_;
+        task.batch = tasks[i].batch;
+        task.enqueued_ns = tasks[i].enqueued_ns;
+        task.canonical_result = std::make_shared<QueryResult>();
+        task.canonical_result->resize(task.query.selections().size());
+        task.result = task.canonical_result.get();
+        for (auto copy: indexes) {
+            task.answers.push_back({tasks[copy].result, std::move(canonical[copy].selections),
+                                    tasks[copy].query.query_id_, tasks[copy].enqueued_ns});
+        }
+        deduplicated.push_back(std::move(task));
+    }
+    tasks = std::move(deduplicated);
+}
+
+// Write the records of a finished task
+void Joiner::complete(Task &task, unsigned worker) {
+    QueryTrace trace;
+    if (query_observer_) {
+        trace.worker = worker;
+        trace.started_ns = task.started_ns;
+        trace.finished_ns = QueryTrace::now();
+    }
+    if (task.answers.empty()) {
+        if (query_observer_) {
+            trace.query_id = task.query.query_id_;
+            trace.enqueued_ns = task.enqueued_ns;
+            query_observer_(trace);
+        }
+        task.batch->complete();
+        return;
+    }
+    for (auto &answer: task.answers) {
+        answer.result->empty = task.result->empty;
+        for (unsigned i = 0; i < answer.selections.size(); ++i) {
+            answer.result->data()[i] = task.result->data()[answer.selections[i]];
+        }
+        if (query_observer_) {
+            trace.query_id = answer.query_id;
+            trace.enqueued_ns = answer.enqueued_ns;
+            query_observer_(trace);
+        }
+        task.batch->complete();
+    }
 }
 
-void Joiner::StartWorkerThread() {
-    std::optional<QueryInfo> request;
+// Start the queries of a batch
+void Joiner::dispatch(std::vector<Task> &tasks) {
+    // Longest processing time first: the expensive queries start right away
+    // and the cheap ones fill the gaps at the end of the batch
+    double total_cost = 0;
+    for (auto &task: tasks) {
+        task.cost = estimateCost(task.query);
+        total_cost += task.cost;
+    }
+    std::stable_sort(tasks.begin(), tasks.end(), [](const Task &a, const Task &b) {
+        return a.cost > b.cost;
+    });
+    for (auto &task: tasks) {
+        // A query with more than a worker's share of the batch would be the
+        // tail of the batch alone, it is split over the workers
+        if (num_t_ > 1 && task.cost > total_cost / num_t_) {
+            task.parallelism = num_t_;
+        }
+        // Queries without a home node go to the shared queue
+        int node = homeNode(task.query);
+        request_queue_.Put(std::move(task), node < 0 ? topology_.numNodes() : node);
+    }
+    tasks.clear();
+}
+
+// Run a part of a query on some worker
+void Joiner::submit(std::function<void()> work) {
+    Task task;
+    task.work = std::move(work);
+    if (query_observer_) {
+        task.enqueued_ns = QueryTrace::now();
+    }
+    request_queue_.Put(std::move(task), topology_.numNodes());
+}
+
+void Joiner::StartWorkerThread(unsigned worker_id) {
+    unsigned node = 0;
+    if (numa_policy_ != NumaPolicy::None) {
+        node = worker_id % topology_.numNodes();
+        auto &cpus = topology_.cpus(node);
+        numa::pinThread(cpus[(worker_id / topology_.numNodes()) % cpus.size()]);
+    }
+    std::optional<Task> request;
     do {
-        request = request_queue_.Get();  // thread waits for new request if request_queue_ is empty
-        if (request != std::nullopt) {
-            auto res = join(*request);
-            response_queue_.Put(std::make_pair(request.value().query_id_, res));
+        request = request_queue_.Get(node);  // thread waits for new request if request_queue_ is empty
+        if (request != std::nullopt && query_observer_) {
+            request->started_ns = QueryTrace::now();
+        }
+        if (request != std::nullopt && request->work) {
+            request->work();
+            if (query_observer_) {
+                QueryTrace trace;
+                trace.worker = worker_id;
+                trace.enqueued_ns = request->enqueued_ns;
+                trace.started_ns = request->started_ns;
+                trace.finished_ns = QueryTrace::now();
+                query_observer_(trace);
+            }
+        } else if (request != std::nullopt) {
+            join(request->query, *request->result, request->parallelism);
+            complete(*request, worker_id);
         }
     } while (request != std::nullopt);
-    response_queue_.Put(std::nullopt);
 }
 
-void Joiner::printCheckSum() {
-    std::vector<Response> results;
-    std::optional<Response> res;
-    do {
-        res = response_queue_.Get();
-        if (res.has_value()) {
-            results.emplace_back(res.value());
+// Run a batch and write its results
+void Joiner::finishBatch(Batch &batch, std::vector<Task> &tasks, std::ostream &out) {
+    active_batches_.fetch_add(1);
+    deduplicate(tasks);
+    if (!sharding_ || !runSharded(tasks)) {
+        dispatch(tasks);
+    }
+    batch.print(out);
+    // The cached tables are dropped once no batch runs. A batch starting
+    // meanwhile only loses the tables it has not got yet.
+    if (active_batches_.fetch_sub(1) == 1) {
+        build_cache_.clear();
+    }
+}
+
+// Run a batch on the shard workers
+bool Joiner::runSharded(std::vector<Task> &tasks) {
+    std::vector<QueryInfo> queries;
+    std::vector<QueryResult *> results;
+    for (auto &task: tasks) {
+        queries.push_back(task.query);
+        results.push_back(task.result);
+    }
+    if (query_observer_) {
+        auto started = QueryTrace::now();
+        for (auto &task: tasks) {
+            task.started_ns = started;
         }
-    } while (res != std::nullopt && results.size() < batch_size_);
+    }
+    try {
+        sharding_->run(relations_, queries, results);
+    } catch (const std::exception &e) {
+        std::cerr << "running the batch on the threads: " << e.what() << std::endl;
+        return false;
+    }
+    for (auto &task: tasks) {
+        complete(task, num_t_);
+    }
+    tasks.clear();
+    return true;
+}
 
-    sort(results.begin(), results.end(), [](const Response &a, const Response &b) {
-        return a.first < b.first;
-    });
-    for (const auto &r: results) {
-        std::cout << r.second;
+void Joiner::printCheckSum(std::ostream &out) {
+    finishBatch(*batch_, pending_, out);
+    batch_ = std::make_unique<Batch>();
+}
+
+// Run the batch of a session
+void Joiner::runBatch(std::vector<QueryInfo> queries, std::ostream &out) {
+    Batch batch;
+    std::vector<Task> tasks;
+    for (auto &query: queries) {
+        Task task;
+        task.result = batch.add(query.selections().size());
+        task.batch = &batch;
+        task.query = std::move(query);
+        if (query_observer_) {
+            task.enqueued_ns = QueryTrace::now();
+        }
+        tasks.push_back(std::move(task));
     }
-}
\ No newline at end of file
+    finishBatch(batch, tasks, out);
+}
@@ -0,0 +1,483 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <dirent.h>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <iterator>
+#include <map>
+#include <sstream>
+#include <string>
+#include <sys/resource.h>
+#include <vector>
+
+#include "bulk_loader.h"
+#include "joiner.h"
+#include "parser.h"
+#include "relation.h"
+
+// Benchmark driver: loads every workload directory once, replays its batches
+// several times and reports latency percentiles, throughput and peak RSS.
+// Results are written as CSV (workload,metric,value) and can be compared
+// against a previously saved run to decide whether a change regressed.
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Options {
+    std::vector<std::string> workloads;
+    unsigned num_threads = 8;
+    unsigned repeat = 3;
+    unsigned warmup = 1;
+    std::string output;
+    std::string baseline;
+    double tolerance = 0.10;
+    /// Report the accuracy of the cardinality estimates instead of timings
+    bool accuracy = false;
+    /// Load the relations with the bulk loader instead of one stream per file
+    bool bulk_load = false;
+    BulkLoader::Options loader;
+    /// Compile query templates after this many runs, 0 to only interpret
+    unsigned compile = 0;
+    /// Run the batches on this many worker processes, 0 to run them on the threads
+    unsigned shards = 0;
+};
+
+struct Workload {
+    std::string name;
+    std::string dir;
+    std::vector<std::string> relation_files;
+    /// The queries of every batch
+    std::vector<std::vector<std::string>> batches;
+    /// The expected result lines of every batch
+    std::vector<std::vector<std::string>> results;
+};
+
+/// workload -> metric -> value
+using Metrics = std::map<std::string, std::map<std::string, double>>;
+
+void usage() {
+    std::cerr << "Usage: bench [--threads N] [--repeat N] [--warmup N] [--output <csv>]\n"
+                 "             [--baseline <csv>] [--tolerance <percent>] [--accuracy]\n"
+                 "             [--loader auto|uring|threads] [--queue_depth N] [--compile <runs>]\n"
+                 "             [--shards N] <workload-dir>..."
+              << std::endl;
+}
+
+bool parseOptions(int argc, char *argv[], Options &options) {
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        auto next = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                usage();
+                exit(EXIT_FAILURE);
+            }
+            return argv[++i];
+        };
+        if (arg == "--threads") {
+            options.num_threads = std::stoul(next());
+        } else if (arg == "--repeat") {
+            options.repeat = std::max(1ul, std::stoul(next()));
+        } else if (arg == "--warmup") {
+            options.warmup = std::stoul(next());
+        } else if (arg == "--output") {
+            options.output = next();
+        } else if (arg == "--baseline") {
+            options.baseline = next();
+        } else if (arg == "--tolerance") {
+            options.tolerance = std::stod(next()) / 100.0;
+        } else if (arg == "--accuracy") {
+            options.accuracy = true;
+        } else if (arg == "--loader") {
+            options.bulk_load = true;
+            options.loader.backend = parseLoadBackend(next());
+        } else if (arg == "--queue_depth") {
+            options.bulk_load = true;
+            options.loader.queue_depth = std::max(1ul, std::stoul(next()));
+        } else if (arg == "--compile") {
+            options.compile = std::stoul(next());
+        } else if (arg == "--shards") {
+            options.shards = std::stoul(next());
+        } else if (arg == "-h" || arg == "--help") {
+            return false;
+        } else {
+            options.workloads.push_back(arg);
+        }
+    }
+    return !options.workloads.empty();
+}
+
+// Finds the single file with the given extension in a directory
+std::string findFile(const std::string &dir, const std::string &extension) {
+    DIR *d = opendir(dir.c_str());
+    if (d == nullptr) {
+        return "";
+    }
+    std::string found;
+    while (auto *entry = readdir(d)) {
+        std::string name = entry->d_name;
+        if (name.size() > extension.size()
+            && name.compare(name.size() - extension.size(), extension.size(), extension) == 0) {
+            found = dir + "/" + name;
+            break;
+        }
+    }
+    closedir(d);
+    return found;
+}
+
+bool loadWorkload(std::string dir, Workload &workload) {
+    if (char *resolved = realpath(dir.c_str(), nullptr)) {
+        dir = resolved;
+        free(resolved);
+    }
+    workload.dir = dir;
+    workload.name = dir.substr(dir.find_last_of('/') + 1);
+
+    std::ifstream init_file(findFile(dir, ".init"));
+    std::ifstream work_file(findFile(dir, ".work"));
+    std::ifstream result_file(findFile(dir, ".result"));
+    if (!init_file || !work_file || !result_file) {
+        std::cerr << "Cannot open init/work/result files in " << dir << std::endl;
+        return false;
+    }
+
+    std::string line;
+    while (getline(init_file, line)) {
+        if (!line.empty()) {
+            workload.relation_files.push_back(dir + "/" + line);
+        }
+    }
+
+    std::vector<std::string> batch, result;
+    while (getline(work_file, line)) {
+        if (line.empty()) continue;
+        if (line[0] == 'F') {
+            workload.batches.push_back(std::move(batch));
+            workload.results.push_back(std::move(result));
+            batch.clear();
+            result.clear();
+            continue;
+        }
+        std::string expected;
+        getline(result_file, expected);
+        batch.push_back(line);
+        result.push_back(expected);
+    }
+    return true;
+}
+
+double percentile(std::vector<double> values, double p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    auto rank = static_cast<size_t>(p * (values.size() - 1) + 0.5);
+    return values[std::min(rank, values.size() - 1)];
+}
+
+double elapsedMs(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+long peakRssKb() {
+    struct rusage usage{};
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+void addLatencyMetrics(std::map<std::string, double> &metrics,
+                       const std::string &prefix,
+                       const std::vector<double> &values) {
+    metrics[prefix + "_p50_ms"] = percentile(values, 0.50);
+    metrics[prefix + "_p90_ms"] = percentile(values, 0.90);
+    metrics[prefix + "_p99_ms"] = percentile(values, 0.99);
+    metrics[prefix + "_max_ms"] = values.empty() ? 0 : *std::max_element(values.begin(), values.end());
+}
+
+// The q-error of an estimate, max(estimate / actual, actual / estimate)
+// with both at least 1
+double qError(double estimate, double actual) {
+    estimate = std::max(estimate, 1.0);
+    actual = std::max(actual, 1.0);
+    return std::max(estimate / actual, actual / estimate);
+}
+
+// Runs every query once and compares the estimated with the real sizes of
+// its scans and joins, with the statistics and with default selectivities
+void measureAccuracy(Joiner &joiner, const Workload &workload, std::map<std::string, double> &metrics) {
+    for (bool statistics: {true, false}) {
+        std::vector<double> scan_errors, join_errors;
+        joiner.useStatistics(statistics);
+        joiner.setEstimateObserver([&](bool join, double estimate, uint64_t actual) {
+            (join ? join_errors : scan_errors).push_back(qError(estimate, actual));
+        });
+        for (auto &batch: workload.batches) {
+            for (auto &raw: batch) {
+                QueryInfo query(raw);
+                joiner.join(query);
+            }
+        }
+        std::string prefix = statistics ? "" : "default_";
+        for (auto &[kind, errors]: {std::make_pair("scan", &scan_errors), std::make_pair("join", &join_errors)}) {
+            auto name = prefix + kind + "_qerror";
+            metrics[name + "_p50"] = percentile(*errors, 0.50);
+            metrics[name + "_p90"] = percentile(*errors, 0.90);
+            metrics[name + "_p99"] = percentile(*errors, 0.99);
+            metrics[name + "_max"] = errors->empty() ? 0 : *std::max_element(errors->begin(), errors->end());
+        }
+    }
+    joiner.setEstimateObserver(nullptr);
+    joiner.useStatistics(true);
+}
+
+// Runs one workload and returns its metrics, or false if a result was wrong
+bool runWorkload(const Workload &workload, const Options &options,
+                 std::map<std::string, double> &metrics) {
+    Joiner joiner;
+    auto load_start = Clock::now();
+    if (options.bulk_load) {
+        BulkLoader loader(options.loader);
+        for (auto &relation: loader.load(workload.relation_files)) {
+            joiner.addRelation(std::move(relation));
+        }
+        metrics["load_mb_per_s"] = loader.report().megabytesPerSecond();
+        std::cerr << workload.name << ": " << loader.report().summary() << std::endl;
+    } else {
+        for (auto &file: workload.relation_files) {
+            joiner.addRelation(Relation(file.c_str()));
+        }
+    }
+    metrics["load_ms"] = elapsedMs(load_start, Clock::now());
+    if (options.accuracy) {
+        measureAccuracy(joiner, workload, metrics);
+        return true;
+    }
+    joiner.setNumThreads(options.num_threads);
+    if (options.compile > 0) {
+        QueryCompiler::Options compiler;
+        compiler.hot_threshold = options.compile;
+        joiner.enableCompilation(compiler);
+    }
+    if (options.shards > 0) {
+        ShardedExecutor::Options sharding;
+        sharding.workers = options.shards;
+        joiner.enableSharding(sharding);
+    }
+
+    bool correct = true;
+    size_t num_queries = 0;
+    for (auto &batch: workload.batches) {
+        num_queries += batch.size();
+    }
+
+    // Per-query latency, every query in isolation on the calling thread
+    std::vector<double> query_latencies;
+    for (unsigned rep = 0; rep < options.warmup + options.repeat; ++rep) {
+        // The templates that got hot during the warmup are measured compiled
+        if (rep == options.warmup && joiner.compiler() != nullptr) {
+            joiner.compiler()->wait();
+        }
+        for (size_t b = 0; b < workload.batches.size(); ++b) {
+            for (size_t q = 0; q < workload.batches[b].size(); ++q) {
+                auto raw = workload.batches[b][q];
+                auto start = Clock::now();
+                QueryInfo query(raw);
+                auto result = joiner.join(query);
+                auto end = Clock::now();
+                if (rep < options.warmup) continue;
+                query_latencies.push_back(elapsedMs(start, end));
+                if (rep == options.warmup && result != workload.results[b][q] + "\n") {
+                    std::cerr << workload.name << ": result mismatch for batch " << b
+                              << " query " << q << ", expected: " << workload.results[b][q]
+                              << ", actual: " << result;
+                    correct = false;
+                }
+            }
+        }
+    }
+
+    // Per-batch latency through the worker threads
+    std::vector<double> batch_latencies;
+    double total_batch_ms = 0;
+    size_t query_id = 0;
+    for (unsigned rep = 0; rep < options.warmup + options.repeat; ++rep) {
+        for (size_t b = 0; b < workload.batches.size(); ++b) {
+            std::ostringstream out;
+            QueryInfo query;
+            auto start = Clock::now();
+            for (auto raw: workload.batches[b]) {
+                query.parseQuery(raw, query_id++);
+                joiner.scheduleQuery(query);
+            }
+            joiner.printCheckSum(out);
+            auto end = Clock::now();
+            if (rep < options.warmup) continue;
+            batch_latencies.push_back(elapsedMs(start, end));
+            total_batch_ms += batch_latencies.back();
+
+            std::istringstream lines(out.str());
+            std::string line;
+            for (size_t q = 0; q < workload.batches[b].size(); ++q) {
+                getline(lines, line);
+                if (line != workload.results[b][q]) {
+                    std::cerr << workload.name << ": batch result mismatch for batch " << b
+                              << " query " << q << ", expected: " << workload.results[b][q]
+                              << ", actual: " << line << std::endl;
+                    correct = false;
+                }
+            }
+        }
+    }
+
+    metrics["queries"] = num_queries;
+    metrics["batches"] = workload.batches.size();
+    addLatencyMetrics(metrics, "query", query_latencies);
+    addLatencyMetrics(metrics, "batch", batch_latencies);
+    metrics["batch_total_ms"] = total_batch_ms / options.repeat;
+    metrics["throughput_qps"] = total_batch_ms > 0 ? num_queries * options.repeat / (total_batch_ms / 1000.0) : 0;
+    metrics["peak_rss_kb"] = peakRssKb();
+    if (joiner.compiler() != nullptr) {
+        metrics["compiled_templates"] = joiner.compiler()->compiledTemplates();
+        metrics["compiled_runs"] = joiner.compiler()->compiledRuns();
+    }
+    return correct;
+}
+
+void writeMetrics(std::ostream &out, const Metrics &metrics) {
+    out << "workload,metric,value\n";
+    for (auto &[workload, values]: metrics) {
+        for (auto &[metric, value]: values) {
+            out << workload << "," << metric << "," << std::fixed << std::setprecision(3) << value << "\n";
+        }
+    }
+}
+
+bool readMetrics(const std::string &file_name, Metrics &metrics) {
+    std::ifstream in(file_name);
+    if (!in) return false;
+    std::string line;
+    getline(in, line);  // header
+    while (getline(in, line)) {
+        auto first = line.find(',');
+        auto second = line.find(',', first + 1);
+        if (first == std::string::npos || second == std::string::npos) continue;
+        metrics[line.substr(0, first)][line.substr(first + 1, second - first - 1)] =
+                std::stod(line.substr(second + 1));
+    }
+    return true;
+}
+
+// How a metric is compared against the baseline
+struct MetricRule {
+    enum Direction {
+        LowerIsBetter,
+        HigherIsBetter,
+        /// Counts what the run did, not compared
+        Counter,
+    };
+    /// The end of the metric names the rule applies to
+    const char *suffix;
+    Direction direction;
+    /// The tolerance as a multiple of --tolerance, 0 if a regression is only
+    /// reported: single samples and short timings are too noisy to gate on
+    double tolerance;
+};
+
+// The rules, the first one whose suffix matches applies
+const MetricRule kMetricRules[] = {
+        {"queries", MetricRule::Counter, 0},
+        {"batches", MetricRule::Counter, 0},
+        {"compiled_templates", MetricRule::Counter, 0},
+        {"compiled_runs", MetricRule::Counter, 0},
+        {"throughput_qps", MetricRule::HigherIsBetter, 1},
+        {"batch_total_ms", MetricRule::LowerIsBetter, 1},
+        {"_p50_ms", MetricRule::LowerIsBetter, 1},
+        {"_p90_ms", MetricRule::LowerIsBetter, 1.5},
+        {"peak_rss_kb", MetricRule::LowerIsBetter, 1},
+        {"_p99_ms", MetricRule::LowerIsBetter, 0},
+        {"_max_ms", MetricRule::LowerIsBetter, 0},
+        {"load_ms", MetricRule::LowerIsBetter, 0},
+        {"load_mb_per_s", MetricRule::HigherIsBetter, 0},
+        // Anything else is reported only
+        {"", MetricRule::LowerIsBetter, 0},
+};
+
+// The rule of a metric
+const MetricRule &metricRule(const std::string &metric) {
+    for (auto &rule: kMetricRules) {
+        std::string suffix = rule.suffix;
+        if (metric.size() >= suffix.size() && metric.compare(metric.size() - suffix.size(), suffix.size(), suffix) == 0) {
+            return rule;
+        }
+    }
+    return kMetricRules[std::size(kMetricRules) - 1];
+}
+
+// Compares against the baseline, returns false if any gated metric regressed
+bool compareMetrics(const Metrics &baseline, const Metrics &current, double tolerance) {
+    bool ok = true;
+    std::cout << std::left << std::setw(12) << "workload" << std::setw(18) << "metric"
+              << std::right << std::setw(14) << "baseline" << std::setw(14) << "current"
+              << std::setw(10) << "change" << std::endl;
+    for (auto &[workload, values]: current) {
+        auto base = baseline.find(workload);
+        if (base == baseline.end()) continue;
+        for (auto &[metric, value]: values) {
+            auto it = base->second.find(metric);
+            if (it == base->second.end() || it->second == 0) continue;
+            auto &rule = metricRule(metric);
+            if (rule.direction == MetricRule::Counter) continue;
+            double change = (value - it->second) / it->second;
+            // Ungated metrics are flagged at the plain tolerance
+            double limit = tolerance * (rule.tolerance > 0 ? rule.tolerance : 1);
+            bool regressed = rule.direction == MetricRule::HigherIsBetter ? change < -limit : change > limit;
+            bool gated = rule.tolerance > 0;
+            std::cout << std::left << std::setw(12) << workload << std::setw(18) << metric
+                      << std::right << std::fixed << std::setprecision(3)
+                      << std::setw(14) << it->second << std::setw(14) << value
+                      << std::setw(9) << std::setprecision(1) << change * 100 << "%"
+                      << (regressed ? (gated ? "  REGRESSION" : "  regressed (not gated)") : "") << std::endl;
+            ok &= !(regressed && gated);
+        }
+    }
+    return ok;
+}
+
+}
+
+int main(int argc, char *argv[]) {
+    Options options;
+    if (!parseOptions(argc, argv, options)) {
+        usage();
+        return EXIT_FAILURE;
+    }
+
+    Metrics metrics;
+    bool correct = true;
+    for (auto &dir: options.workloads) {
+        Workload workload;
+        if (!loadWorkload(dir, workload)) {
+            return EXIT_FAILURE;
+        }
+        std::cerr << "bench " << workload.name << " ..." << std::endl;
+        correct &= runWorkload(workload, options, metrics[workload.name]);
+    }
+
+    writeMetrics(std::cout, metrics);
+    if (!options.output.empty()) {
+        std::ofstream out(options.output);
+        writeMetrics(out, metrics);
+    }
+
+    bool ok = correct;
+    if (!options.baseline.empty()) {
+        Metrics baseline;
+        if (!readMetrics(options.baseline, baseline)) {
+            std::cerr << "Cannot open baseline " << options.baseline << std::endl;
+            return EXIT_FAILURE;
+        }
+        ok &= compareMetrics(baseline, metrics, options.tolerance);
+    }
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
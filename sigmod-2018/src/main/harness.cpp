@@ -1,12 +1,19 @@
+#include <algorithm>
 #include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
 #include <cstdlib>
 #include <fcntl.h>
 #include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <map>
 #include <sstream>
 #include <string>
 #include <sys/time.h>
+#include <sys/wait.h>
 #include <thread>
 #include <unistd.h>
 #include <vector>
@@ -19,10 +26,133 @@ const unsigned long WAITING_TIME_SECS = 60;
 static void usage() {
     std::cerr
             << "Usage: "
-            "harness <init-file> <workload-file> <result-file> <test-executable>"
+            "harness [--trace <trace-json>] <init-file> <workload-file> <result-file> <test-executable>"
             << std::endl;
 }
 
+// The steady clock in nanoseconds, the clock of the driver's trace
+static int64_t monotonic_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+// An interval of the driver's trace
+struct TraceSpan {
+    // Query id, -1 for a part of a query run by a helping worker
+    long long query_id;
+    unsigned worker;
+    int64_t enqueued, started, finished;
+};
+
+// The nearest-rank percentile of sorted values
+static double percentile(const std::vector<double> &sorted, double p) {
+    if (sorted.empty()) return 0;
+    size_t rank = (size_t) std::ceil(p * sorted.size());
+    return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+}
+
+// Print the percentiles of durations in milliseconds
+static void print_percentiles(const char *name, std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    std::cout << std::fixed << std::setprecision(3) << name << ": n=" << values.size()
+              << " p50=" << percentile(values, 0.50) << "ms p95=" << percentile(values, 0.95)
+              << "ms p99=" << percentile(values, 0.99) << "ms max=" << (values.empty() ? 0 : values.back())
+              << "ms" << std::endl;
+}
+
+// Read the driver's trace, report the latencies and the worker utilization
+// and write them as a Chrome trace (chrome://tracing, Perfetto)
+static bool report_trace(const std::string &trace_path, const std::string &json_path,
+                         const std::vector<std::pair<int64_t, int64_t>> &batch_times) {
+    std::ifstream in(trace_path);
+    if (!in) {
+        std::cerr << "Cannot open the driver trace" << std::endl;
+        return false;
+    }
+    std::vector<TraceSpan> spans;
+    std::string kind;
+    while (in >> kind) {
+        TraceSpan span{-1, 0, 0, 0, 0};
+        if (kind == "Q") {
+            in >> span.query_id;
+        } else if (kind == "B") {
+            // The driver's view of the batches, the harness measures its own
+            std::string rest;
+            getline(in, rest);
+            continue;
+        } else if (kind != "P") {
+            std::cerr << "Malformed driver trace" << std::endl;
+            return false;
+        }
+        in >> span.worker >> span.enqueued >> span.started >> span.finished;
+        spans.push_back(span);
+    }
+
+    std::vector<double> latencies, waits, batches;
+    int64_t origin = batch_times.empty() ? 0 : batch_times.front().first, last = origin;
+    std::map<unsigned, int64_t> busy;
+    for (auto &span: spans) {
+        if (span.query_id >= 0) {
+            latencies.push_back((span.finished - span.enqueued) / 1e6);
+            waits.push_back((span.started - span.enqueued) / 1e6);
+        }
+        busy[span.worker] += span.finished - span.started;
+        origin = std::min(origin, span.enqueued);
+        last = std::max(last, span.finished);
+    }
+    for (auto &[begin, end]: batch_times) {
+        batches.push_back((end - begin) / 1e6);
+        last = std::max(last, end);
+    }
+    print_percentiles("query latency", latencies);
+    print_percentiles("queue wait", waits);
+    print_percentiles("batch time", batches);
+    for (auto &[worker, ns]: busy) {
+        std::cout << "worker " << worker << " busy " << std::setprecision(1)
+                  << (last > origin ? 100.0 * ns / (last - origin) : 0) << "%" << std::endl;
+    }
+
+    std::ofstream json(json_path);
+    if (!json) {
+        std::cerr << "Cannot write the trace " << json_path << std::endl;
+        return false;
+    }
+    auto us = [&](int64_t ns) { return (ns - origin) / 1000.0; };
+    json << std::fixed << std::setprecision(3) << "{\"traceEvents\":[\n"
+         << R"({"name":"process_name","ph":"M","pid":1,"args":{"name":"harness"}},)" << "\n"
+         << R"({"name":"process_name","ph":"M","pid":2,"args":{"name":"driver"}},)" << "\n"
+         << R"({"name":"thread_name","ph":"M","pid":1,"tid":0,"args":{"name":"batches"}})";
+    for (auto &[worker, ns]: busy) {
+        json << ",\n" << R"({"name":"thread_name","ph":"M","pid":2,"tid":)" << worker
+             << R"(,"args":{"name":"worker )" << worker << "\"}}";
+    }
+    for (size_t b = 0; b < batch_times.size(); ++b) {
+        json << ",\n" << R"({"name":"batch )" << b << R"(","ph":"X","pid":1,"tid":0,"ts":)"
+             << us(batch_times[b].first) << ",\"dur\":" << (batch_times[b].second - batch_times[b].first) / 1000.0
+             << "}";
+    }
+    // The number of busy workers over time
+    std::vector<std::pair<int64_t, int>> changes;
+    for (auto &span: spans) {
+        json << ",\n{\"name\":\""
+             << (span.query_id >= 0 ? "query " + std::to_string(span.query_id) : std::string("part"))
+             << R"(","cat":"query","ph":"X","pid":2,"tid":)" << span.worker << ",\"ts\":" << us(span.started)
+             << ",\"dur\":" << (span.finished - span.started) / 1000.0 << R"(,"args":{"wait_us":)"
+             << (span.started - span.enqueued) / 1000.0 << "}}";
+        changes.emplace_back(span.started, 1);
+        changes.emplace_back(span.finished, -1);
+    }
+    std::sort(changes.begin(), changes.end());
+    int running = 0;
+    for (auto &[ns, change]: changes) {
+        running += change;
+        json << ",\n" << R"({"name":"busy workers","ph":"C","pid":2,"ts":)" << us(ns)
+             << R"(,"args":{"busy":)" << running << "}}";
+    }
+    json << "\n]}\n";
+    return true;
+}
+
 // Set a file descriptor to be non-blocking
 static int set_nonblocking(int fd) {
     int flags = fcntl(fd, F_GETFL, 0);
@@ -63,11 +193,29 @@ static ssize_t write_bytes(int fd, const void *buffer, size_t num_bytes) {
 }
 
 int main(int argc, char *argv[]) {
+    // --trace <json> has the driver trace every query (SIGMOD_TRACE) and
+    // reports the latencies
+    std::string trace_json, trace_path;
+    if (argc == 7 && std::string(argv[1]) == "--trace") {
+        trace_json = argv[2];
+        argv += 2;
+        argc -= 2;
+    }
     // Check for the correct number of arguments
     if (argc != 5) {
         usage();
         exit(EXIT_FAILURE);
     }
+    if (!trace_json.empty()) {
+        char path[] = "/tmp/sigmod-trace-XXXXXX";
+        int fd = mkstemp(path);
+        if (fd == -1) {
+            perror("mkstemp");
+            exit(EXIT_FAILURE);
+        }
+        close(fd);
+        trace_path = path;
+    }
 
     std::vector<std::string> input_batches;
     std::vector<std::vector<std::string>> result_batches;
@@ -134,6 +282,9 @@ int main(int argc, char *argv[]) {
         dup2(stdout_pipe[1], STDOUT_FILENO);
         close(stdout_pipe[0]);
         close(stdout_pipe[1]);
+        if (!trace_path.empty()) {
+            setenv("SIGMOD_TRACE", trace_path.c_str(), 1);
+        }
         execlp(argv[4], argv[4], (char *) nullptr);
         perror("execlp");
         exit(EXIT_FAILURE);
@@ -196,6 +347,8 @@ int main(int argc, char *argv[]) {
 
     unsigned long query_no = 0;
     unsigned long failure_cnt = 0;
+    // When the first query of every batch was sent and its last result read
+    std::vector<std::pair<int64_t, int64_t>> batch_times;
 
     // Loop over all batches
     for (unsigned long batch = 0;
@@ -206,6 +359,7 @@ int main(int argc, char *argv[]) {
 
         size_t input_ofs = 0;    // byte position in the input_ batch
         size_t output_read = 0;  // number of lines read from the child output
+        int64_t batch_start = monotonic_ns();
 
         while (input_ofs != input_batches[batch].length()
                 || output_read < result_batches[batch].size()) {
@@ -262,6 +416,8 @@ int main(int argc, char *argv[]) {
             }
         }
 
+        batch_times.emplace_back(batch_start, monotonic_ns());
+
         // Parse and compare the batch result
         std::stringstream result(output);
 
@@ -302,6 +458,14 @@ int main(int argc, char *argv[]) {
             static_cast<double>(end.tv_sec - start.tv_sec)
             + (end.tv_usec - start.tv_usec) / 1000000.0;
         std::cout << (long) (elapsed_sec * 1000) << std::endl;
+        if (!trace_path.empty()) {
+            // The driver writes the rest of its trace when it exits
+            close(stdin_pipe[1]);
+            waitpid(pid, nullptr, 0);
+            bool traced = report_trace(trace_path, trace_json, batch_times);
+            unlink(trace_path.c_str());
+            return traced ? EXIT_SUCCESS : EXIT_FAILURE;
+        }
         return EXIT_SUCCESS;
     }
 
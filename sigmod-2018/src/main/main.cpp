@@ -2,13 +2,68 @@
 #include <csignal>
 #include <fcntl.h>
 #include <fstream>
+#include <mutex>
 
+#include "bulk_loader.h"
 #include "joiner.h"
 #include "parser.h"
+#include "server.h"
 
 int main(int argc, char *argv[]) {
+    // The trace outlives the workers of the joiner
+    std::ofstream trace;
+    std::mutex trace_mutex;
     // argv[1] is the number of threads
     Joiner joiner;
+    // SIGMOD_NUMA=interleave|node enables NUMA aware placement and scheduling
+    if (const char *numa_policy = getenv("SIGMOD_NUMA")) {
+        joiner.enableNuma(parseNumaPolicy(numa_policy), NumaTopology::detect());
+    }
+    // SIGMOD_QUERY_MEMORY_MB and SIGMOD_MEMORY_MB limit the memory of a query
+    // and of all queries, joins above the limit spill to disk
+    if (getenv("SIGMOD_QUERY_MEMORY_MB") || getenv("SIGMOD_MEMORY_MB")) {
+        auto limit = [](const char *variable) {
+            const char *mb = getenv(variable);
+            return mb ? std::stoull(mb) << 20 : MemoryBudget::kUnlimited;
+        };
+        joiner.setMemoryLimits(limit("SIGMOD_QUERY_MEMORY_MB"), limit("SIGMOD_MEMORY_MB"));
+    }
+    // SIGMOD_COMPILE=<runs> compiles query templates to native code once they
+    // ran that often, with the compiler SIGMOD_COMPILER (c++ by default)
+    if (const char *hot_threshold = getenv("SIGMOD_COMPILE")) {
+        QueryCompiler::Options options;
+        options.hot_threshold = std::stoul(hot_threshold);
+        if (const char *compiler = getenv("SIGMOD_COMPILER")) {
+            options.compiler = compiler;
+        }
+        joiner.enableCompilation(options);
+    }
+    // SIGMOD_SHARDS=<workers> runs the batches on that many worker processes,
+    // each joining one hash partition of the relations
+    if (const char *workers = getenv("SIGMOD_SHARDS")) {
+        ShardedExecutor::Options options;
+        options.workers = std::stoul(workers);
+        joiner.enableSharding(options);
+    }
+    // SIGMOD_TRACE=<path> writes when every query was scheduled, started and
+    // finished and when every batch began and was answered (steady clock
+    // nanoseconds), for the tracing mode of the harness
+    if (const char *trace_path = getenv("SIGMOD_TRACE")) {
+        trace.open(trace_path);
+        if (!trace) {
+            std::cerr << "cannot open the trace file " << trace_path << std::endl;
+            return EXIT_FAILURE;
+        }
+        joiner.setQueryObserver([&](const QueryTrace &t) {
+            std::lock_guard<std::mutex> lk(trace_mutex);
+            if (t.query_id == QueryTrace::kPart) {
+                trace << "P";
+            } else {
+                trace << "Q " << t.query_id;
+            }
+            trace << ' ' << t.worker << ' ' << t.enqueued_ns << ' ' << t.started_ns << ' ' << t.finished_ns << '\n';
+        });
+    }
     if (argc > 1) {
         joiner.setNumThreads(std::stoi(argv[1]));
     } else {
@@ -16,25 +71,62 @@ int main(int argc, char *argv[]) {
     }
     // Read join relations
     std::string line;
-    while (getline(std::cin, line)) {
-        if (line == "Done") break;
-        joiner.addRelation(line.c_str());
+    // SIGMOD_LOADER=auto|uring|threads reads all relation files at once with
+    // large asynchronous reads, SIGMOD_LOADER_QUEUE_DEPTH reads in flight
+    if (const char *loader_backend = getenv("SIGMOD_LOADER")) {
+        std::vector<std::string> files;
+        while (getline(std::cin, line)) {
+            if (line == "Done") break;
+            files.push_back(line);
+        }
+        BulkLoader::Options options;
+        options.backend = parseLoadBackend(loader_backend);
+        if (const char *depth = getenv("SIGMOD_LOADER_QUEUE_DEPTH")) {
+            options.queue_depth = std::stoul(depth);
+        }
+        BulkLoader loader(options);
+        for (auto &relation: loader.load(files)) {
+            joiner.addRelation(std::move(relation));
+        }
+        std::cerr << loader.report().summary() << std::endl;
+    } else {
+        while (getline(std::cin, line)) {
+            if (line == "Done") break;
+            joiner.addRelation(line.c_str());
+        }
+    }
+
+    // SIGMOD_SOCKET=<path> serves the queries of several clients over a Unix
+    // domain socket instead of reading them from stdin, until stdin is closed
+    if (const char *socket_path = getenv("SIGMOD_SOCKET")) {
+        Server server(joiner, socket_path);
+        server.start();
+        while (getline(std::cin, line)) {}
+        server.stop();
+        return 0;
     }
 
     QueryInfo i;
     size_t query_id = 0;
-    size_t batch_size = 0;
+    size_t batch = 0;
+    int64_t batch_begin = -1;
     std::map<size_t, std::string> responses;
     while (getline(std::cin, line)) {
         if (line == "F") {
-            joiner.setBatchSize(batch_size);
-            batch_size = 0;
             joiner.printCheckSum();
+            if (trace.is_open()) {
+                std::lock_guard<std::mutex> lk(trace_mutex);
+                trace << "B " << batch << ' ' << batch_begin << ' ' << QueryTrace::now() << std::endl;
+            }
+            ++batch;
+            batch_begin = -1;
             continue;
         }
+        if (trace.is_open() && batch_begin < 0) {
+            batch_begin = QueryTrace::now();
+        }
         i.parseQuery(line, query_id++);
         joiner.scheduleQuery(i);
-        batch_size++;
     }
     return 0;
 }
@@ -0,0 +1,437 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <numeric>
+#include <random>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "column_sums.h"
+#include "join_hash_table.h"
+#include "operators.h"
+#include "parser.h"
+#include "relation.h"
+#include "utils.h"
+
+// Microbenchmarks for the operators in isolation on synthetic relations.
+//
+// Every operator is measured over a range of relation sizes, from L1
+// resident up to --max_rows (raise it above your LLC size / 8 bytes per value
+// to get out-of-cache numbers). Each benchmark is registered once per
+// implementation variant (see the *_variants tables below), so a new
+// implementation only has to add an entry there to be compared head-to-head:
+//
+//   operators_bench --benchmark_filter='Join(Build|Probe)/.*' --max_rows=16777216
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+uint64_t max_rows = 1ull << 22;
+
+/// Relations are expensive to generate, so they are shared between benchmarks
+const Relation &syntheticRelation(uint64_t rows, uint64_t num_columns,
+                                  uint64_t key_domain, double skew,
+                                  uint64_t seed = 42) {
+    using Key = std::tuple<uint64_t, uint64_t, uint64_t, double, uint64_t>;
+    static std::map<Key, std::unique_ptr<Relation>> cache;
+    auto &relation = cache[Key(rows, num_columns, key_domain, skew, seed)];
+    if (!relation) {
+        relation = std::make_unique<Relation>(
+                Utils::createZipfRelation(rows, num_columns, key_domain, skew, seed));
+    }
+    return *relation;
+}
+
+std::shared_ptr<Context> makeContext(std::vector<const Relation *> relations) {
+    return std::make_shared<Context>(relations, std::make_shared<QueryInfo>());
+}
+
+double seconds(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double>(end - start).count();
+}
+
+/// A named implementation of an operator phase
+template<class Fn>
+struct Variant {
+    std::string name;
+    Fn run;
+};
+
+// -- FilterScan --------------------------------------------------------------
+
+using FilterFn = std::function<uint64_t(const Relation &, std::vector<FilterInfo> &,
+                                        std::shared_ptr<Context>)>;
+
+/// Evaluates the filters one row at a time with a switch per comparison,
+/// like FilterScan without its specialized kernels
+uint64_t genericFilterScan(const Relation &r, const std::vector<FilterInfo> &filters) {
+    std::vector<TupleId> result;
+    for (uint64_t i = 0; i < r.size(); ++i) {
+        bool pass = true;
+        for (auto &f: filters) {
+            auto value = r.columns()[f.filter_column.col_id][i];
+            switch (f.comparison) {
+                case FilterInfo::Comparison::Equal:
+                    pass = value == f.constant;
+                    break;
+                case FilterInfo::Comparison::Greater:
+                    pass = value > f.constant;
+                    break;
+                case FilterInfo::Comparison::Less:
+                    pass = value < f.constant;
+                    break;
+            }
+            if (!pass) break;
+        }
+        if (pass) result.push_back(i);
+    }
+    return result.size();
+}
+
+const std::vector<Variant<FilterFn>> filter_variants{
+        {"Generic", [](const Relation &r, std::vector<FilterInfo> &filters, std::shared_ptr<Context>) {
+            return genericFilterScan(r, filters);
+        }},
+        {"FilterScan", [](const Relation &r, std::vector<FilterInfo> &filters,
+                          std::shared_ptr<Context> context) {
+            FilterScan scan(r, filters, std::move(context));
+            scan.run();
+            return scan.result_size();
+        }},
+};
+
+// args: rows, selectivity in percent, number of filters (the ones after the
+// first pass almost every row)
+void BM_FilterScan(benchmark::State &state, const FilterFn &run) {
+    auto rows = static_cast<uint64_t>(state.range(0));
+    auto selectivity = static_cast<uint64_t>(state.range(1));
+    auto num_filters = static_cast<unsigned>(state.range(2));
+    auto &relation = syntheticRelation(rows, 3, rows, 0);
+    std::vector<FilterInfo> filters{
+            FilterInfo(SelectInfo(0, 0, 0), rows * selectivity / 100, FilterInfo::Comparison::Less)};
+    if (num_filters > 1) filters.emplace_back(SelectInfo(0, 0, 1), rows, FilterInfo::Comparison::Less);
+    if (num_filters > 2) filters.emplace_back(SelectInfo(0, 0, 2), 0, FilterInfo::Comparison::Greater);
+
+    uint64_t result_size = 0;
+    for (auto _: state) {
+        // A fresh context, so the arena does not grow across iterations
+        result_size = run(relation, filters, makeContext({&relation}));
+        benchmark::DoNotOptimize(result_size);
+    }
+    state.counters["result_rows"] = result_size;
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+
+// -- Join ----------------------------------------------------------------------
+
+/// Runs the build (probe == false) or the probe phase of a join, returns its
+/// elapsed time and the result size
+using JoinFn = std::function<std::pair<double, uint64_t>(std::unique_ptr<Operator> &&,
+                                                         std::unique_ptr<Operator> &&,
+                                                         const PredicateInfo &,
+                                                         std::shared_ptr<Context>, bool)>;
+
+const std::vector<Variant<JoinFn>> join_variants{
+        {"HashJoin", [](std::unique_ptr<Operator> &&left, std::unique_ptr<Operator> &&right,
+                        const PredicateInfo &p_info, std::shared_ptr<Context> context,
+                        bool probe) {
+            Join join(std::move(left), std::move(right), p_info, std::move(context));
+            join.prepare();
+            auto start = Clock::now();
+            join.build();
+            auto end = Clock::now();
+            if (!probe) return std::make_pair(seconds(start, end), join.result_size());
+            start = Clock::now();
+            join.probe();
+            end = Clock::now();
+            return std::make_pair(seconds(start, end), join.result_size());
+        }},
+};
+
+// args: rows, skew of the build side in 1/100 (the probe side is uniform)
+void BM_Join(benchmark::State &state, const JoinFn &run, bool probe) {
+    auto rows = static_cast<uint64_t>(state.range(0));
+    double skew = state.range(1) / 100.0;
+    auto &build_side = syntheticRelation(rows, 1, rows, skew, 1);
+    auto &probe_side = syntheticRelation(rows, 1, rows, 0, 2);
+    auto context = makeContext({&build_side, &probe_side});
+    PredicateInfo p_info(SelectInfo(0, 0, 0), SelectInfo(1, 1, 0));
+
+    uint64_t result_size = 0;
+    for (auto _: state) {
+        auto result = run(std::make_unique<Scan>(build_side, 0, context),
+                          std::make_unique<Scan>(probe_side, 1, context),
+                          p_info, context, probe);
+        state.SetIterationTime(result.first);
+        result_size = result.second;
+    }
+    state.counters["result_rows"] = result_size;
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+
+// -- Hash table probe ----------------------------------------------------------
+
+/// Builds a hash table over (key, row) entries and returns a function that
+/// probes it with a list of keys and returns the number of matches
+using ProbeFn = std::function<std::function<uint64_t(const std::vector<uint64_t> &)>(
+        const std::vector<JoinHashTable::Entry> &)>;
+
+const std::vector<Variant<ProbeFn>> probe_variants{
+        // The table Join used before JoinHashTable, one dependent miss after another
+        {"UnorderedMultimap", [](const std::vector<JoinHashTable::Entry> &entries) {
+            auto table = std::make_shared<std::unordered_multimap<uint64_t, uint64_t>>();
+            table->reserve(entries.size() * 2);
+            for (auto &entry: entries) table->emplace(entry.key, entry.row);
+            return std::function<uint64_t(const std::vector<uint64_t> &)>([table](const std::vector<uint64_t> &keys) {
+                uint64_t matches = 0;
+                for (auto key: keys) {
+                    auto range = table->equal_range(key);
+                    for (auto iter = range.first; iter != range.second; ++iter) matches += iter->second != ~0ull;
+                }
+                return matches;
+            });
+        }},
+        {"JoinHashTable", [](const std::vector<JoinHashTable::Entry> &entries) {
+            auto table = std::make_shared<JoinHashTable>();
+            table->build(entries);
+            return std::function<uint64_t(const std::vector<uint64_t> &)>([table](const std::vector<uint64_t> &keys) {
+                uint64_t matches = 0;
+                for (auto key: keys) {
+                    table->probe(key, [&](uint64_t row) { matches += row != ~0ull; });
+                }
+                return matches;
+            });
+        }},
+        {"JoinHashTableBatched", [](const std::vector<JoinHashTable::Entry> &entries) {
+            auto table = std::make_shared<JoinHashTable>();
+            table->build(entries);
+            return std::function<uint64_t(const std::vector<uint64_t> &)>([table](const std::vector<uint64_t> &keys) {
+                uint64_t matches = 0;
+                table->probeBatch(keys.data(), keys.size(), [&](size_t, uint64_t row) { matches += row != ~0ull; });
+                return matches;
+            });
+        }},
+};
+
+// args: rows of the build side, the probe side is as large and hits half of the time
+void BM_HashTableProbe(benchmark::State &state, const ProbeFn &make) {
+    auto rows = static_cast<uint64_t>(state.range(0));
+    auto &build_side = syntheticRelation(rows, 1, rows, 0, 1);
+    auto &probe_side = syntheticRelation(rows, 1, rows * 2, 0, 2);
+    std::vector<JoinHashTable::Entry> entries;
+    for (uint64_t i = 0; i < rows; ++i) {
+        entries.push_back({build_side.columns()[0][i], i});
+    }
+    std::vector<uint64_t> keys(probe_side.columns()[0], probe_side.columns()[0] + rows);
+    auto probe = make(entries);
+
+    uint64_t matches = 0;
+    for (auto _: state) {
+        matches = probe(keys);
+        benchmark::DoNotOptimize(matches);
+    }
+    state.counters["matches"] = matches;
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+
+// -- SelfJoin ------------------------------------------------------------------
+
+using SelfJoinFn = std::function<uint64_t(std::unique_ptr<Operator> &&, PredicateInfo &,
+                                          std::shared_ptr<Context>)>;
+
+const std::vector<Variant<SelfJoinFn>> self_join_variants{
+        {"SelfJoin", [](std::unique_ptr<Operator> &&input, PredicateInfo &p_info,
+                        std::shared_ptr<Context> context) {
+            SelfJoin self_join(std::move(input), p_info, std::move(context));
+            self_join.run();
+            return self_join.result_size();
+        }},
+};
+
+// args: rows, key domain of both columns
+void BM_SelfJoin(benchmark::State &state, const SelfJoinFn &run) {
+    auto rows = static_cast<uint64_t>(state.range(0));
+    auto key_domain = static_cast<uint64_t>(state.range(1));
+    auto &relation = syntheticRelation(rows, 2, key_domain, 0);
+    auto context = makeContext({&relation});
+    PredicateInfo p_info(SelectInfo(0, 0, 0), SelectInfo(0, 0, 1));
+
+    uint64_t result_size = 0;
+    for (auto _: state) {
+        result_size = run(std::make_unique<Scan>(relation, 0, context), p_info, context);
+        benchmark::DoNotOptimize(result_size);
+    }
+    state.counters["result_rows"] = result_size;
+    state.SetItemsProcessed(state.iterations() * rows);
+}
+
+// -- Checksum ------------------------------------------------------------------
+
+using ChecksumFn = std::function<uint64_t(std::unique_ptr<Operator> &&, std::vector<SelectInfo>,
+                                          std::shared_ptr<Context>)>;
+
+/// The ids of a late-materialized result of binding 0, in order like after a
+/// scan or in random order like after a join
+class SelectedIds : public Operator {
+public:
+    /// The constructor
+    SelectedIds(uint64_t rows, bool shuffled, std::shared_ptr<Context> context) {
+        context_ = std::move(context);
+        allocateResults();
+        auto &ids = tmp_results_[0];
+        for (uint64_t i = 0; i < rows; ++i) {
+            ids.push_back(i);
+        }
+        if (shuffled) {
+            std::shuffle(ids.begin(), ids.end(), std::mt19937_64(7));
+        }
+        result_size_ = rows;
+    }
+
+    /// Require a column and add it to results
+    bool require(SelectInfo info) override {
+        return true;
+    }
+
+    /// Run, nothing to do
+    void run() override {}
+};
+
+/// Sums every selected column in its own pass, like Checksum did before
+uint64_t perColumnChecksum(Operator &input, const std::vector<SelectInfo> &columns, Context &context) {
+    input.run();
+    uint64_t check_sum = 0;
+    for (auto &column: columns) {
+        auto values = context.getColumn(column);
+        uint64_t sum = 0;
+        for (auto id: (*input.getResults())[column.binding]) {
+            sum += values[id];
+        }
+        check_sum += sum;
+    }
+    return check_sum;
+}
+
+/// Sums with one kernel in one pass
+uint64_t kernelChecksum(Operator &input, const std::vector<SelectInfo> &columns, Context &context,
+                        ColumnSums::Kernel kernel) {
+    input.run();
+    auto &ids = (*input.getResults())[0];
+    std::vector<const uint64_t *> values;
+    for (auto &column: columns) {
+        values.push_back(context.getColumn(column));
+    }
+    std::vector<uint64_t> sums(columns.size(), 0);
+    kernel(ids.data(), ids.size(), values.data(), values.size(), sums.data());
+    return std::accumulate(sums.begin(), sums.end(), uint64_t(0));
+}
+
+const std::vector<Variant<ChecksumFn>> checksum_variants{
+        {"PerColumn", [](std::unique_ptr<Operator> &&input, std::vector<SelectInfo> columns,
+                         std::shared_ptr<Context> context) {
+            return perColumnChecksum(*input, columns, *context);
+        }},
+        {"FusedScalar", [](std::unique_ptr<Operator> &&input, std::vector<SelectInfo> columns,
+                           std::shared_ptr<Context> context) {
+            return kernelChecksum(*input, columns, *context, ColumnSums::sumScalar);
+        }},
+        {"FusedAvx2", [](std::unique_ptr<Operator> &&input, std::vector<SelectInfo> columns,
+                         std::shared_ptr<Context> context) {
+            return kernelChecksum(*input, columns, *context,
+                                  ColumnSums::hasAvx2() ? ColumnSums::sumAvx2 : ColumnSums::sumScalar);
+        }},
+        {"Checksum", [](std::unique_ptr<Operator> &&input, std::vector<SelectInfo> columns,
+                        std::shared_ptr<Context> context) {
+            Checksum checksum(std::move(input), std::move(columns), std::move(context));
+            checksum.run();
+            return std::accumulate(checksum.check_sums().begin(), checksum.check_sums().end(), uint64_t(0));
+        }},
+};
+
+// args: rows, number of selected columns (all of the same binding), whether the ids are shuffled
+void BM_Checksum(benchmark::State &state, const ChecksumFn &run) {
+    auto rows = static_cast<uint64_t>(state.range(0));
+    auto num_columns = static_cast<uint64_t>(state.range(1));
+    bool shuffled = state.range(2) != 0;
+    auto &relation = syntheticRelation(rows, 4, rows, 0);
+    std::vector<SelectInfo> columns;
+    for (unsigned c = 0; c < num_columns; ++c) {
+        columns.emplace_back(0, 0, c % 4);
+    }
+
+    for (auto _: state) {
+        // The selection is materialized up front so only the summation is timed,
+        // in a fresh context so the arena does not grow across iterations
+        state.PauseTiming();
+        auto context = makeContext({&relation});
+        auto input = std::make_unique<SelectedIds>(rows, shuffled, context);
+        state.ResumeTiming();
+        benchmark::DoNotOptimize(run(std::move(input), columns, context));
+    }
+    state.SetItemsProcessed(state.iterations() * rows * num_columns);
+}
+
+std::vector<int64_t> sizes() {
+    // L1 resident (32KB) up to max_rows, in steps of 8x
+    std::vector<int64_t> result;
+    for (uint64_t rows = 1ull << 12; rows <= max_rows; rows <<= 3) {
+        result.push_back(static_cast<int64_t>(rows));
+    }
+    return result;
+}
+
+void registerBenchmarks() {
+    auto rows = sizes();
+    for (auto &variant: filter_variants) {
+        benchmark::RegisterBenchmark(("FilterScan/" + variant.name).c_str(), BM_FilterScan, variant.run)
+                ->ArgsProduct({rows, {1, 50, 90}, {1, 3}})->ArgNames({"rows", "sel%", "filters"});
+    }
+    for (auto &variant: join_variants) {
+        benchmark::RegisterBenchmark(("JoinBuild/" + variant.name).c_str(), BM_Join, variant.run, false)
+                ->ArgsProduct({rows, {0, 100}})->ArgNames({"rows", "skew%"})->UseManualTime();
+        benchmark::RegisterBenchmark(("JoinProbe/" + variant.name).c_str(), BM_Join, variant.run, true)
+                ->ArgsProduct({rows, {0, 100}})->ArgNames({"rows", "skew%"})->UseManualTime();
+    }
+    for (auto &variant: probe_variants) {
+        benchmark::RegisterBenchmark(("HashTableProbe/" + variant.name).c_str(), BM_HashTableProbe, variant.run)
+                ->ArgsProduct({rows})->ArgNames({"rows"});
+    }
+    for (auto &variant: self_join_variants) {
+        benchmark::RegisterBenchmark(("SelfJoin/" + variant.name).c_str(), BM_SelfJoin, variant.run)
+                ->ArgsProduct({rows, {16, 1 << 20}})->ArgNames({"rows", "domain"});
+    }
+    for (auto &variant: checksum_variants) {
+        benchmark::RegisterBenchmark(("Checksum/" + variant.name).c_str(), BM_Checksum, variant.run)
+                ->ArgsProduct({rows, {1, 3}, {0, 1}})->ArgNames({"rows", "columns", "shuffled"});
+    }
+}
+
+}
+
+int main(int argc, char **argv) {
+    // Our own flags are consumed before google benchmark sees the rest
+    int out = 1;
+    for (int i = 1; i < argc; ++i) {
+        if (strncmp(argv[i], "--max_rows=", 11) == 0) {
+            max_rows = std::stoull(argv[i] + 11);
+        } else {
+            argv[out++] = argv[i];
+        }
+    }
+    argc = out;
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    registerBenchmarks();
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
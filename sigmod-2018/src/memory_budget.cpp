@@ -0,0 +1,83 @@
+#include "memory_budget.h"
+
+#include <algorithm>
+#include <stdexcept>
+
+// Give everything back to the parent
+MemoryBudget::~MemoryBudget() {
+    if (parent_ != nullptr) {
+        parent_->release(used());
+    }
+}
+
+// Set the limit and the parent
+void MemoryBudget::reset(uint64_t limit, MemoryBudget *parent) {
+    limit_ = limit;
+    parent_ = parent;
+}
+
+// Reserve memory if it fits
+bool MemoryBudget::tryReserve(uint64_t bytes) {
+    uint64_t used = used_.load(std::memory_order_relaxed);
+    do {
+        if (bytes > limit_ || used > limit_ - bytes) {
+            return false;
+        }
+    } while (!used_.compare_exchange_weak(used, used + bytes, std::memory_order_relaxed));
+    if (parent_ != nullptr && !parent_->tryReserve(bytes)) {
+        used_.fetch_sub(bytes, std::memory_order_relaxed);
+        return false;
+    }
+    return true;
+}
+
+// Account memory without a limit
+void MemoryBudget::charge(uint64_t bytes) {
+    used_.fetch_add(bytes, std::memory_order_relaxed);
+    if (parent_ != nullptr) {
+        parent_->charge(bytes);
+    }
+}
+
+// Return memory
+void MemoryBudget::release(uint64_t bytes) {
+    used_.fetch_sub(bytes, std::memory_order_relaxed);
+    if (parent_ != nullptr) {
+        parent_->release(bytes);
+    }
+}
+
+// The bytes that can still be reserved
+uint64_t MemoryBudget::available() const {
+    uint64_t used = this->used();
+    uint64_t available = used >= limit_ ? 0 : limit_ - used;
+    return parent_ != nullptr ? std::min(available, parent_->available()) : available;
+}
+
+// Close the file
+SpillFile::~SpillFile() {
+    if (file_ != nullptr) {
+        fclose(file_);
+    }
+}
+
+// Write the buffer to the file
+void SpillFile::flush() {
+    if (buffer_.empty()) {
+        return;
+    }
+    if (file_ == nullptr) {
+        // tmpfile is unlinked right away, nothing is left behind on a crash
+        file_ = tmpfile();
+        if (file_ == nullptr) {
+            throw std::runtime_error("cannot create a spill file");
+        }
+    }
+    // A read may have moved the position, and C requires a seek between
+    // reading and writing an update stream
+    if (fseek(file_, 0, SEEK_END) != 0
+        || fwrite(buffer_.data(), sizeof(Record), buffer_.size(), file_) != buffer_.size()) {
+        throw std::runtime_error("cannot write a spill file");
+    }
+    buffer_.clear();
+}
@@ -0,0 +1,149 @@
+#include "numa.h"
+
+#include <algorithm>
+#include <atomic>
+#include <dirent.h>
+#include <fstream>
+#include <iostream>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+namespace {
+
+// Memory policies of mbind(2), see <numaif.h>
+constexpr int kMpolPreferred = 1;
+constexpr int kMpolInterleave = 3;
+
+// Parse a cpu list like "0-3,8,10-11"
+std::vector<unsigned> parseCpuList(const std::string &list) {
+    std::vector<unsigned> cpus;
+    size_t pos = 0;
+    while (pos < list.size()) {
+        auto end = list.find(',', pos);
+        if (end == std::string::npos) end = list.size();
+        auto range = list.substr(pos, end - pos);
+        auto dash = range.find('-');
+        if (!range.empty() && range != "\n") {
+            unsigned first = std::stoul(range.substr(0, dash));
+            unsigned last = dash == std::string::npos ? first : std::stoul(range.substr(dash + 1));
+            for (unsigned cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+        pos = end + 1;
+    }
+    return cpus;
+}
+
+}
+
+// Parse a NUMA policy
+NumaPolicy parseNumaPolicy(const std::string &policy) {
+    if (policy == "interleave") return NumaPolicy::Interleave;
+    if (policy == "node") return NumaPolicy::PerNode;
+    return NumaPolicy::None;
+}
+
+// Read the topology from sysfs
+NumaTopology NumaTopology::detect() {
+    unsigned num_cpus = std::max(1u, std::thread::hardware_concurrency());
+    if (const char *simulated = getenv("SIGMOD_NUMA_NODES")) {
+        return simulate(std::max(1, atoi(simulated)), num_cpus);
+    }
+
+    NumaTopology topology;
+    if (DIR *dir = opendir("/sys/devices/system/node")) {
+        std::vector<std::pair<unsigned, std::vector<unsigned>>> nodes;
+        while (auto *entry = readdir(dir)) {
+            std::string name = entry->d_name;
+            if (name.compare(0, 4, "node") != 0 || name.size() == 4
+                || !isdigit(static_cast<unsigned char>(name[4]))) {
+                continue;
+            }
+            std::ifstream cpulist("/sys/devices/system/node/" + name + "/cpulist");
+            std::string list;
+            getline(cpulist, list);
+            nodes.emplace_back(std::stoul(name.substr(4)), parseCpuList(list));
+        }
+        closedir(dir);
+        std::sort(nodes.begin(), nodes.end());
+        for (auto &node: nodes) {
+            // Nodes are numbered densely on every machine we run on, memory
+            // only nodes (no cpus) cannot run workers and are skipped
+            if (!node.second.empty() && node.first == topology.node_cpus_.size()) {
+                topology.node_cpus_.push_back(std::move(node.second));
+            }
+        }
+    }
+    if (topology.node_cpus_.empty()) {
+        return simulate(1, num_cpus);
+    }
+    return topology;
+}
+
+// Simulate a topology
+NumaTopology NumaTopology::simulate(unsigned num_nodes, unsigned num_cpus) {
+    NumaTopology topology;
+    topology.simulated_ = num_nodes > 1;
+    topology.node_cpus_.resize(num_nodes);
+    for (unsigned i = 0; i < std::max(num_cpus, num_nodes); ++i) {
+        topology.node_cpus_[i % num_nodes].push_back(i % num_cpus);
+    }
+    return topology;
+}
+
+// Allocate memory on a node
+void *numa::allocate(size_t bytes, int node, const NumaTopology &topology) {
+    if (bytes == 0) {
+        return nullptr;
+    }
+    void *memory = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+    bind(memory, bytes, node, topology);
+    return memory;
+}
+
+// Set the node of a mapping
+void numa::bind(void *memory, size_t bytes, int node, const NumaTopology &topology) {
+    if (topology.numNodes() > 1 && !topology.simulated()) {
+        // The policy is applied when the pages are first touched. The node
+        // mask has one bit per node in as many words as it takes, plus one
+        // bit: the kernel only reads maxnode - 1 bits.
+        constexpr unsigned kWordBits = sizeof(unsigned long) * 8;
+        std::vector<unsigned long> mask(topology.numNodes() / kWordBits + 1, 0);
+        for (unsigned n = 0; n < topology.numNodes(); ++n) {
+            if (node < 0 || n == unsigned(node)) {
+                mask[n / kWordBits] |= 1ul << (n % kWordBits);
+            }
+        }
+        int mode = node < 0 ? kMpolInterleave : kMpolPreferred;
+        if (syscall(SYS_mbind, memory, bytes, mode, mask.data(), mask.size() * kWordBits, 0) != 0) {
+            // Every column of every relation is bound, only tell once
+            static std::atomic<bool> warned{false};
+            if (!warned.exchange(true)) {
+                std::cerr << "mbind failed, falling back to first-touch placement\n";
+            }
+        }
+    }
+}
+
+// Release memory
+void numa::release(void *memory, size_t bytes) {
+    if (memory != nullptr) {
+        munmap(memory, bytes);
+    }
+}
+
+// Pin the calling thread
+bool numa::pinThread(unsigned cpu) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
@@ -1,7 +1,15 @@
 #include "operators.h"
 
+#include <algorithm>
+#include <functional>
+#include <map>
+
+#include "build_cache.h"
+#include "column_sums.h"
+#include "filter_kernels.h"
+
 // Get late-materialized results
-std::vector<std::vector<TupleId>>* Operator::getResults() {
+std::vector<TupleIds>* Operator::getResults() {
     return &tmp_results_;
 }
 
@@ -13,12 +21,12 @@ bool Scan::require(SelectInfo info) {
 // Run
 void Scan::run() {
     // Nothing to do
-    result_size_ = relation_.size();
+    result_size_ = rows_;
 }
 
 // Get late-materialized results
-std::vector<std::vector<TupleId>>* Scan::getResults() {
-    for (uint64_t i = 0; i < relation_.size(); i++) {
+std::vector<TupleIds>* Scan::getResults() {
+    for (uint64_t i = 0; i < rows_; i++) {
         tmp_results_[relation_binding_].push_back(i);
     }
     return Operator::getResults();
@@ -54,90 +62,437 @@ bool FilterScan::applyFilter(uint64_t i, FilterInfo &f) {
 
 // Run
 void FilterScan::run() {
-    for (uint64_t i = 0; i < relation_.size(); ++i) {
-        bool pass = true;
+    // Tuple ids are collected until they would take more memory than a
+    // bitmap, the rest of the relation is filtered into a bitmap
+    uint64_t max_ids = rows_ / kSparseFraction;
+    uint64_t begin = 0;
+    auto kernel = FilterKernels::select(filters_);
+    if (kernel != nullptr) {
+        std::vector<const uint64_t *> columns;
+        std::vector<uint64_t> constants;
         for (auto &f: filters_) {
-            pass &= applyFilter(i, f);
+            columns.push_back(relation_.columns()[f.filter_column.col_id]);
+            constants.push_back(f.constant);
+        }
+        // The kernel writes a block of candidates right into the result,
+        // which is cut back to the rows that passed
+        auto &out = tmp_results_[filters_[0].filter_column.binding];
+        for (; begin < rows_ && result_size_ <= max_ids; begin += kFilterBlock) {
+            uint64_t end = std::min<uint64_t>(rows_, begin + kFilterBlock);
+            out.resize(result_size_ + end - begin);
+            result_size_ += kernel(columns.data(), constants.data(), begin, end, out.data() + result_size_);
+        }
+        out.resize(result_size_);
+    } else {
+        for (; begin < rows_ && result_size_ <= max_ids; begin += kFilterBlock) {
+            for (uint64_t i = begin, end = std::min<uint64_t>(rows_, begin + kFilterBlock); i != end; ++i) {
+                // The most selective filters come first, see Rewriter::rewrite
+                bool pass = true;
+                for (auto &f: filters_) {
+                    if (!applyFilter(i, f)) {
+                        pass = false;
+                        break;
+                    }
+                }
+                if (pass)
+                    copy2Result(i);
+            }
+        }
+    }
+    if (begin < rows_) {
+        runBitmap(begin);
+    }
+}
+
+// Continue with a bitmap
+void FilterScan::runBitmap(uint64_t begin) {
+    auto &ids = tmp_results_[relation_binding_];
+    bitmap_ = std::make_unique<Bitmap>(rows_, &context_->arena_);
+    for (auto id: ids) {
+        bitmap_->set(id);
+    }
+    TupleIds().swap(ids);
+
+    // The first filter sets the bits of a block, the others AND theirs into
+    // them while the block is in the cache
+    std::vector<FilterKernels::BitmapKernel> kernels;
+    for (unsigned f = 0; f < filters_.size(); ++f) {
+        kernels.push_back(FilterKernels::selectBitmap(filters_[f].comparison, f > 0));
+    }
+    for (; begin < rows_; begin += kFilterBlock) {
+        uint64_t end = std::min<uint64_t>(rows_, begin + kFilterBlock);
+        for (unsigned f = 0; f < filters_.size(); ++f) {
+            kernels[f](relation_.columns()[filters_[f].filter_column.col_id], filters_[f].constant,
+                       begin, end, bitmap_->words());
         }
-        if (pass)
-            copy2Result(i);
+        result_size_ += bitmap_->count(begin, end);
     }
 }
 
+// Get late-materialized results
+std::vector<TupleIds>* FilterScan::getResults() {
+    // For consumers that need tuple ids
+    if (bitmap_) {
+        auto &ids = tmp_results_[relation_binding_];
+        ids.reserve(result_size_);
+        bitmap_->forEach(0, rows_, [&](uint64_t row) {
+            ids.push_back(row);
+        });
+        bitmap_.reset();
+    }
+    return Operator::getResults();
+}
+
 // Require a column and add it to results
 bool Join::require(SelectInfo info) {
     return true;
 }
 
 // Copy to result
-void Join::copy2Result(uint64_t left_id, uint64_t right_id) {
+void Join::copy2Result(uint64_t left_id, uint64_t right_id, std::vector<TupleIds> &out) {
     // left_id和right_id是左右两个late-materialized结果的行号
+    // 这里需要保证左表包含的binding与右表包含的binding不会重复
+    for (auto &column: left_columns_) {
+        out[column.binding].push_back(tupleId(column.ids, left_id));
+    }
+    for (auto &column: right_columns_) {
+        out[column.binding].push_back(tupleId(column.ids, right_id));
+    }
+}
 
-    // 先把left input中的tuple id放到tmp_results_中
-    unsigned max_binding = context_->relations_.size();
-    for(unsigned binding = 0; binding < max_binding; binding++) {
-        if((*left_input_)[binding].empty()) {
-            continue;
+// Copy the matches of a heavy-hitter key to result
+void Join::copy2Result(const std::vector<uint64_t> &left_ids, uint64_t right_id, std::vector<TupleIds> &out) {
+    for (auto &column: left_columns_) {
+        auto &output = out[column.binding];
+        output.reserve(output.size() + left_ids.size());
+        for (auto left_id: left_ids) {
+            output.push_back(tupleId(column.ids, left_id));
         }
-        const auto& input = (*left_input_)[binding];
-        tmp_results_[binding].push_back(input[left_id]);
     }
-    // 这里需要保证左表包含的binding与右表包含的binding不会重复
-    for(unsigned binding = 0; binding < max_binding; binding++) {
-        if((*right_input_)[binding].empty()) {
-            continue;
+    for (auto &column: right_columns_) {
+        auto &output = out[column.binding];
+        output.insert(output.end(), left_ids.size(), tupleId(column.ids, right_id));
+    }
+}
+
+// Copy matching pairs to result, one binding at a time
+void Join::copy2Result(const std::vector<uint64_t> &left_ids, const std::vector<uint64_t> &right_ids,
+                       std::vector<TupleIds> &out) {
+    if (left_ids.empty()) {
+        return;
+    }
+    for (auto [columns, ids]: {std::make_pair(&left_columns_, &left_ids),
+                               std::make_pair(&right_columns_, &right_ids)}) {
+        for (auto &column: *columns) {
+            auto &output = out[column.binding];
+            auto size = output.size();
+            output.resize(size + ids->size());
+            if (column.ids == nullptr) {
+                std::copy(ids->begin(), ids->end(), output.begin() + size);
+                continue;
+            }
+            for (size_t i = 0; i < ids->size(); ++i) {
+                output[size + i] = column.ids[(*ids)[i]];
+            }
+        }
+    }
+}
+
+// Sample the build side and mark keys that dominate the sample as heavy hitters
+void Join::detectHeavyHitters(JoinTable &table) {
+    uint64_t build_size = left_->result_size();
+    if (build_size < kSkewSampleSize * 4) {
+        return;
+    }
+    std::unordered_map<uint64_t, uint64_t> sample_counts;
+    uint64_t step = build_size / kSkewSampleSize;
+    if (left_bitmap_ == nullptr) {
+        for (uint64_t i = 0; i < build_size; i += step) {
+            ++sample_counts[key(left_keys_, i)];
+        }
+    } else {
+        // Every step-th row set in the bitmap
+        uint64_t skip = 0;
+        left_bitmap_->forEach(0, left_bitmap_->size(), [&](uint64_t i) {
+            if (skip-- == 0) {
+                ++sample_counts[key(left_keys_, i)];
+                skip = step - 1;
+            }
+        });
+    }
+    uint64_t threshold = kSkewSampleSize / kHeavyHitterFraction;
+    for (auto &[key, count]: sample_counts) {
+        if (count >= threshold) {
+            table.heavy_hitters[key].reserve(count * step);
         }
-        const auto& input = (*right_input_)[binding];
-        tmp_results_[binding].push_back(input[right_id]);
     }
-    result_size_++;
 }
 
 // Run
 void Join::run() {
+    prepare();
+    build();
+    probe();
+}
+
+// Run the inputs
+void Join::prepare() {
     left_->run();
     right_->run();
 
-
     // Use smaller input_ for build
     if (left_->result_size() > right_->result_size()) {
         std::swap(left_, right_);
-        std::swap(p_info_.left, p_info_.right);
+        for (auto &p_info: p_infos_) {
+            std::swap(p_info.left, p_info.right);
+        }
         std::swap(requested_columns_left_, requested_columns_right_);
+        std::swap(left_scan_key_, right_scan_key_);
     }
 
-    left_input_ = left_->getResults();
-    right_input_ = right_->getResults();
+    // A scan that selected many rows is joined on its bitmap, the tuple ids
+    // are never materialized
+    left_bitmap_ = left_->bitmap();
+    right_bitmap_ = right_->bitmap();
+    left_columns_ = inputColumns(*left_, left_bitmap_, p_infos_[0].left.binding);
+    right_columns_ = inputColumns(*right_, right_bitmap_, p_infos_[0].right.binding);
+
+    // The tuple ids of a binding in the result columns of an input
+    auto ids = [](const std::vector<InputColumn> &columns, unsigned binding) -> const TupleId * {
+        for (auto &column: columns) {
+            if (column.binding == binding) return column.ids;
+        }
+        return nullptr;
+    };
+    left_keys_.clear();
+    right_keys_.clear();
+    for (auto &p_info: p_infos_) {
+        left_keys_.push_back({ids(left_columns_, p_info.left.binding), context_->getColumn(p_info.left)});
+        right_keys_.push_back({ids(right_columns_, p_info.right.binding), context_->getColumn(p_info.right)});
+    }
+}
 
-    // Build phase
-    auto left_key_column = context_->getColumn(p_info_.left);
-    hash_table_.reserve(left_->result_size() * 2);
-    for (uint64_t i = 0, limit = i + left_->result_size(); i != limit; ++i) {
-        TupleId id = (*left_input_)[p_info_.left.binding][i];
-        hash_table_.emplace(left_key_column[id], i);
+// The result columns of an input
+std::vector<Join::InputColumn> Join::inputColumns(Operator &input, const Bitmap *bitmap, unsigned binding) {
+    if (bitmap != nullptr) {
+        return {{binding, nullptr}};
     }
-    // Probe phase
-    auto right_key_column = context_->getColumn(p_info_.right);
-    for (uint64_t i = 0, limit = i + right_->result_size(); i != limit; ++i) {
-        auto tuple_id = (*right_input_)[p_info_.right.binding][i];
-        auto rightKey = right_key_column[tuple_id];
-        auto range = hash_table_.equal_range(rightKey);
-        for (auto iter = range.first; iter != range.second; ++iter) {
-            copy2Result(iter->second, i);
+    std::vector<InputColumn> columns;
+    auto &results = *input.getResults();
+    for (unsigned b = 0; b < results.size(); ++b) {
+        if (!results[b].empty()) {
+            columns.push_back({b, results[b].data()});
         }
     }
+    return columns;
 }
 
-// Copy to result
-void SelfJoin::copy2Result(uint64_t id) {
-    size_t max_binding = context_->relations_.size();
-    for(int binding = 0; binding < max_binding; binding++) {
-        if((*input_data_)[binding].empty()){
+// Build phase
+void Join::build() {
+    uint64_t bytes = left_->result_size() * kHashTableEntryBytes;
+    if (context_->build_cache_ != nullptr && !left_scan_key_.empty()) {
+        // The same scan joined on the same columns gives the same table
+        std::string key = left_scan_key_;
+        for (auto &p_info: p_infos_) {
+            key += "|" + std::to_string(p_info.left.col_id);
+        }
+        table_ = context_->build_cache_->get(key, bytes, [&]() {
+            auto table = std::make_shared<JoinTable>();
+            fillTable(*table);
+            return table;
+        });
+        if (table_) {
+            return;
+        }
+    }
+    if (!context_->memory_.tryReserve(bytes)) {
+        spilled_ = true;
+        return;
+    }
+    auto table = std::make_shared<JoinTable>(&context_->arena_);
+    fillTable(*table);
+    table_ = std::move(table);
+}
+
+// Fill a hash table with the build side
+void Join::fillTable(JoinTable &table) {
+    detectHeavyHitters(table);
+    auto &heavy_hitters = table.heavy_hitters;
+    std::vector<JoinHashTable::Entry> entries;
+    entries.reserve(left_->result_size());
+    withNumKeys([&](auto num_keys) {
+        forEachRow(left_bitmap_, 0, numRows(*left_, left_bitmap_), [&](uint64_t i) {
+            auto left_key = key<num_keys>(left_keys_, i);
+            if (!heavy_hitters.empty()) {
+                auto heavy = heavy_hitters.find(left_key);
+                if (heavy != heavy_hitters.end()) {
+                    heavy->second.push_back(i);
+                    return;
+                }
+            }
+            entries.push_back({left_key, i});
+        });
+    });
+    table.hash_table.build(entries);
+}
+
+// Probe phase
+void Join::probe() {
+    uint64_t probe_size = numRows(*right_, right_bitmap_);
+    if (spilled_) {
+        graceJoin();
+    } else if (context_->parallelism_ <= 1 || right_->result_size() < kMinParallelProbe) {
+        result_size_ += withNumKeys([&](auto num_keys) {
+            return probeRange<num_keys>(0, probe_size, tmp_results_);
+        });
+    } else {
+        // Split the probe side over the workers helping with the query. The
+        // chunks collect their results on the heap, the arena belongs to
+        // this thread.
+        unsigned num_chunks = context_->parallelism_ * 4;
+        uint64_t chunk_size = (probe_size + num_chunks - 1) / num_chunks;
+        std::vector<std::vector<TupleIds>> chunk_results(num_chunks,
+                                                         std::vector<TupleIds>(tmp_results_.size()));
+        std::vector<uint64_t> chunk_sizes(num_chunks, 0);
+        parallelFor(context_->tasks_, context_->parallelism_, num_chunks, [&](unsigned chunk) {
+            uint64_t begin = std::min(probe_size, chunk * chunk_size);
+            uint64_t end = std::min(probe_size, begin + chunk_size);
+            chunk_sizes[chunk] = withNumKeys([&](auto num_keys) {
+                return probeRange<num_keys>(begin, end, chunk_results[chunk]);
+            });
+        });
+        for (unsigned binding = 0; binding < tmp_results_.size(); ++binding) {
+            uint64_t size = 0;
+            for (auto &results: chunk_results) size += results[binding].size();
+            if (size == 0) continue;
+            tmp_results_[binding].reserve(size);
+            for (auto &results: chunk_results) {
+                tmp_results_[binding].insert(tmp_results_[binding].end(),
+                                             results[binding].begin(), results[binding].end());
+            }
+        }
+        for (auto size: chunk_sizes) result_size_ += size;
+    }
+    // The result cannot spill, but accounting it lets the following joins spill instead
+    context_->memory_.charge(result_size_ * context_->relations_.size() * sizeof(TupleId));
+}
+
+// Probe the in-memory hash table with a range of the probe side
+template<unsigned NumKeys>
+uint64_t Join::probeRange(uint64_t begin, uint64_t end, std::vector<TupleIds> &out) {
+    // A single key column is compared exactly by the hash table, composite
+    // keys are hashed and have to be checked
+    bool composite = NumKeys != 1;
+    auto &heavy_hitters = table_->heavy_hitters;
+    uint64_t count = 0;
+    uint64_t keys[kProbeBlock], rows[kProbeBlock];
+    std::vector<uint64_t> left_ids, right_ids, matches;
+    for (uint64_t block = begin; block < end; block += kProbeBlock) {
+        size_t n = 0;
+        forEachRow(right_bitmap_, block, std::min(end, block + kProbeBlock), [&](uint64_t i) {
+            auto right_key = key<NumKeys>(right_keys_, i);
+            if (!heavy_hitters.empty()) {
+                auto heavy = heavy_hitters.find(right_key);
+                if (heavy != heavy_hitters.end()) {
+                    if (!composite) {
+                        copy2Result(heavy->second, i, out);
+                        count += heavy->second.size();
+                        return;
+                    }
+                    matches.clear();
+                    for (auto left_id: heavy->second) {
+                        if (keysEqual<NumKeys>(left_id, i)) matches.push_back(left_id);
+                    }
+                    copy2Result(matches, i, out);
+                    count += matches.size();
+                    return;
+                }
+            }
+            keys[n] = right_key;
+            rows[n] = i;
+            ++n;
+        });
+
+        left_ids.clear();
+        right_ids.clear();
+        table_->hash_table.probeBatch(keys, n, [&](size_t k, uint64_t left_id) {
+            if (!composite || keysEqual<NumKeys>(left_id, rows[k])) {
+                left_ids.push_back(left_id);
+                right_ids.push_back(rows[k]);
+            }
+        });
+        copy2Result(left_ids, right_ids, out);
+        count += left_ids.size();
+    }
+    return count;
+}
+
+// Grace hash join
+void Join::graceJoin() {
+    // Enough partitions that the hash table of one fits into the memory left
+    uint64_t build_bytes = left_->result_size() * kHashTableEntryBytes;
+    uint64_t partition_bytes = std::max<uint64_t>(context_->memory_.available(), 1 << 20);
+    unsigned bits = 1;
+    while ((1u << bits) < kMaxSpillPartitions && build_bytes >> bits > partition_bytes) {
+        ++bits;
+    }
+    // Not the hash of the tables, or every partition would use a fraction of its buckets
+    auto partition = [bits](uint64_t key) {
+        return ((key ^ (key >> 33)) * 0xff51afd7ed558ccdull) >> (64 - bits);
+    };
+
+    std::vector<SpillFile> left_partitions(1u << bits), right_partitions(1u << bits);
+    forEachRow(left_bitmap_, 0, numRows(*left_, left_bitmap_), [&](uint64_t i) {
+        auto left_key = key(left_keys_, i);
+        left_partitions[partition(left_key)].append(left_key, i);
+    });
+    forEachRow(right_bitmap_, 0, numRows(*right_, right_bitmap_), [&](uint64_t i) {
+        auto right_key = key(right_keys_, i);
+        right_partitions[partition(right_key)].append(right_key, i);
+    });
+
+    bool composite = p_infos_.size() > 1;
+    for (unsigned p = 0; p < left_partitions.size(); ++p) {
+        if (left_partitions[p].size() == 0 || right_partitions[p].size() == 0) continue;
+        // A partition has to be built, even if it is still too large (a single key)
+        uint64_t bytes = left_partitions[p].size() * kHashTableEntryBytes;
+        context_->memory_.charge(bytes);
+        // On the heap, the memory of a partition is given back before the next one
+        JoinHashTable table;
+        {
+            std::vector<JoinHashTable::Entry> entries;
+            entries.reserve(left_partitions[p].size());
+            left_partitions[p].read([&](uint64_t left_key, uint64_t left_id) {
+                entries.push_back({left_key, left_id});
+            });
+            table.build(entries);
+        }
+        right_partitions[p].read([&](uint64_t right_key, uint64_t right_id) {
+            table.probe(right_key, [&](uint64_t left_id) {
+                if (!composite || keysEqual(left_id, right_id)) {
+                    copy2Result(left_id, right_id, tmp_results_);
+                    ++result_size_;
+                }
+            });
+        });
+        context_->memory_.release(bytes);
+    }
+}
+
+// Copy the matching rows to result, one binding at a time
+void SelfJoin::copy2Result(const std::vector<uint64_t> &rows) {
+    for (unsigned binding = 0; binding < tmp_results_.size(); ++binding) {
+        const auto &input = (*input_data_)[binding];
+        if (input.empty()) {
             continue;
         }
-        tmp_results_[binding].push_back((*input_data_)[binding][id]);
+        auto &output = tmp_results_[binding];
+        output.resize(rows.size());
+        for (size_t i = 0; i < rows.size(); ++i) {
+            output[i] = input[rows[i]];
+        }
     }
-    ++result_size_;
+    result_size_ = rows.size();
 }
 
 // Require a column and add it to results
@@ -152,28 +507,251 @@ void SelfJoin::run() {
 
     auto left_col = context_->getColumn(p_info_.left);
     auto right_col = context_->getColumn(p_info_.right);
-    for (uint64_t i = 0; i < input_->result_size(); ++i) {
-        auto right_tuple_id = (*input_data_)[p_info_.right.binding][i];
-        auto left_tuple_id = (*input_data_)[p_info_.left.binding][i];
+    auto left_ids = (*input_data_)[p_info_.left.binding].data();
+    auto right_ids = (*input_data_)[p_info_.right.binding].data();
+    // Collect the matching rows without a branch, then copy them in bulk
+    std::vector<uint64_t> rows(input_->result_size());
+    uint64_t count = 0;
+    for (uint64_t i = 0; i < rows.size(); ++i) {
+        rows[count] = i;
+        count += left_col[left_ids[i]] == right_col[right_ids[i]];
+    }
+    rows.resize(count);
+    copy2Result(rows);
+}
+
+// Sort the inputs by their join variables
+void MultiwayJoin::buildTries() {
+    // Union-find over the join columns, every class is one variable
+    std::map<std::pair<unsigned, unsigned>, unsigned> column_ids;
+    std::vector<unsigned> parent;
+    auto columnId = [&](const SelectInfo &info) {
+        auto inserted = column_ids.emplace(std::make_pair(info.binding, info.col_id), parent.size());
+        if (inserted.second) parent.push_back(parent.size());
+        return inserted.first->second;
+    };
+    std::function<unsigned(unsigned)> find = [&](unsigned x) {
+        return parent[x] == x ? x : parent[x] = find(parent[x]);
+    };
+    for (auto &p_info: predicates_) {
+        auto l = find(columnId(p_info.left)), r = find(columnId(p_info.right));
+        parent[l] = r;
+    }
+
+    // The columns of every variable per binding
+    std::map<unsigned, std::map<unsigned, std::vector<unsigned>>> variable_columns;
+    for (auto &[column, id]: column_ids) {
+        variable_columns[find(id)][column.first].push_back(column.second);
+    }
+    // Variables shared by many bindings first, they prune the most
+    std::vector<unsigned> order;
+    for (auto &v: variable_columns) order.push_back(v.first);
+    std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b) {
+        return variable_columns[a].size() > variable_columns[b].size();
+    });
+
+    unsigned num_bindings = context_->relations_.size();
+    tries_.assign(num_bindings, Trie());
+    std::vector<std::vector<const uint64_t *>> level_columns(num_bindings);
+    variables_.clear();
+    for (auto v: order) {
+        variables_.emplace_back();
+        for (auto &[binding, columns]: variable_columns[v]) {
+            variables_.back().emplace_back(binding, level_columns[binding].size());
+            level_columns[binding].push_back(context_->getColumn(SelectInfo(binding, columns[0])));
+        }
+    }
+
+    for (unsigned binding = 0; binding < num_bindings; ++binding) {
+        if (!inputs_[binding]) continue;
+        bindings_.push_back(binding);
+        inputs_[binding]->run();
+        auto &input = (*inputs_[binding]->getResults())[binding];
+        auto &trie = tries_[binding];
 
-        if (left_col[left_tuple_id] == right_col[right_tuple_id])
-            copy2Result(i);
+        // Columns of one binding in the same variable have to be equal
+        std::vector<std::pair<const uint64_t *, const uint64_t *>> equalities;
+        for (auto &[v, bindings]: variable_columns) {
+            auto it = bindings.find(binding);
+            if (it == bindings.end()) continue;
+            for (unsigned i = 1; i < it->second.size(); ++i) {
+                equalities.emplace_back(context_->getColumn(SelectInfo(binding, it->second[0])),
+                                        context_->getColumn(SelectInfo(binding, it->second[i])));
+            }
+        }
+        trie.rows.reserve(input.size());
+        for (auto id: input) {
+            bool pass = true;
+            for (auto &[a, b]: equalities) {
+                pass &= a[id] == b[id];
+            }
+            if (pass) trie.rows.push_back(id);
+        }
+
+        auto &columns = level_columns[binding];
+        std::sort(trie.rows.begin(), trie.rows.end(), [&](TupleId a, TupleId b) {
+            for (auto column: columns) {
+                if (column[a] != column[b]) return column[a] < column[b];
+            }
+            return a < b;
+        });
+        trie.values.resize(columns.size());
+        for (unsigned level = 0; level < columns.size(); ++level) {
+            trie.values[level].reserve(trie.rows.size());
+            for (auto id: trie.rows) {
+                trie.values[level].push_back(columns[level][id]);
+            }
+        }
+    }
+}
+
+// Copy the cross product of the ranges to result
+void MultiwayJoin::copy2Result(const std::vector<Range> &ranges) {
+    uint64_t total = 1;
+    for (auto binding: bindings_) {
+        total *= ranges[binding].end - ranges[binding].begin;
+    }
+    // Every binding repeats each of its rows `inner` times, and its whole range `total / (inner * size)` times
+    uint64_t inner = total;
+    for (auto binding: bindings_) {
+        auto &range = ranges[binding];
+        auto &rows = tries_[binding].rows;
+        auto &output = tmp_results_[binding];
+        uint64_t size = range.end - range.begin;
+        inner /= size;
+        output.reserve(output.size() + total);
+        for (uint64_t outer = 0, repeat = total / (inner * size); outer < repeat; ++outer) {
+            for (uint64_t i = range.begin; i < range.end; ++i) {
+                output.insert(output.end(), inner, rows[i]);
+            }
+        }
+    }
+    result_size_ += total;
+}
+
+// Bind the variable at depth by leapfrogging over the sorted values of all bindings containing it
+void MultiwayJoin::join(unsigned depth, std::vector<Range> &ranges) {
+    if (depth == variables_.size()) {
+        copy2Result(ranges);
+        return;
+    }
+    auto &participants = variables_[depth];
+    std::vector<uint64_t> positions;
+    for (auto &[binding, level]: participants) {
+        positions.push_back(ranges[binding].begin);
+    }
+    while (true) {
+        uint64_t target = 0;
+        for (unsigned i = 0; i < participants.size(); ++i) {
+            auto &[binding, level] = participants[i];
+            target = std::max(target, tries_[binding].values[level][positions[i]]);
+        }
+        bool match = true;
+        for (unsigned i = 0; i < participants.size(); ++i) {
+            auto &[binding, level] = participants[i];
+            auto &values = tries_[binding].values[level];
+            positions[i] = std::lower_bound(values.begin() + positions[i],
+                                            values.begin() + ranges[binding].end, target) - values.begin();
+            if (positions[i] == ranges[binding].end) return;
+            match &= values[positions[i]] == target;
+        }
+        if (!match) continue;
+
+        // All inputs agree on target, narrow them down to it and bind the next variable
+        std::vector<Range> saved;
+        for (unsigned i = 0; i < participants.size(); ++i) {
+            auto &[binding, level] = participants[i];
+            auto &values = tries_[binding].values[level];
+            saved.push_back(ranges[binding]);
+            auto end = std::upper_bound(values.begin() + positions[i],
+                                        values.begin() + ranges[binding].end, target) - values.begin();
+            ranges[binding] = {positions[i], static_cast<uint64_t>(end)};
+        }
+        join(depth + 1, ranges);
+        bool done = false;
+        for (unsigned i = 0; i < participants.size(); ++i) {
+            auto binding = participants[i].first;
+            positions[i] = ranges[binding].end;
+            ranges[binding] = saved[i];
+            done |= positions[i] == ranges[binding].end;
+        }
+        if (done) return;
     }
 }
 
+// Run
+void MultiwayJoin::run() {
+    buildTries();
+    std::vector<Range> ranges(tries_.size(), Range{0, 0});
+    for (auto binding: bindings_) {
+        ranges[binding] = {0, tries_[binding].rows.size()};
+        if (tries_[binding].rows.empty()) return;
+    }
+    join(0, ranges);
+}
+
 // Run
 void Checksum::run() {
     input_->run();
-    auto results = input_->getResults();
+    // The result of a scan may be a bitmap, its rows are summed without
+    // materializing their tuple ids
+    auto bitmap = input_->bitmap();
+    auto results = bitmap != nullptr ? nullptr : input_->getResults();
+    result_size_ = input_->result_size();
+    check_sums_.assign(col_info_.size(), 0);
 
-    for (auto &sInfo: col_info_) {
-        auto result_col = context_->getColumn(sInfo);
-        uint64_t sum = 0;
-        result_size_ = input_->result_size();
-        for(const TupleId id: (*results)[sInfo.binding]) {
-            sum += result_col[id];
+    // All selections of a binding are summed in one pass over its tuple ids
+    std::map<unsigned, std::vector<unsigned>> bindings;
+    for (unsigned i = 0; i < col_info_.size(); ++i) {
+        bindings[col_info_[i].binding].push_back(i);
+    }
+    for (auto &[binding, selections]: bindings) {
+        std::vector<const uint64_t *> columns;
+        for (auto i: selections) {
+            columns.push_back(context_->getColumn(col_info_[i]));
+        }
+        // Sum the columns over the rows [begin, end) of the input
+        auto sumRows = [&, binding = binding](uint64_t begin, uint64_t end, uint64_t *sums) {
+            if (bitmap == nullptr) {
+                auto &ids = (*results)[binding];
+                ColumnSums::sum(ids.data() + begin, end - begin, columns.data(), columns.size(), sums);
+                return;
+            }
+            // The rows of a bitmap are summed a block of tuple ids at a time
+            std::vector<TupleId> ids;
+            ids.reserve(std::min(ColumnSums::kBlockSize, end - begin));
+            bitmap->forEach(begin, end, [&](uint64_t row) {
+                ids.push_back(row);
+                if (ids.size() == ColumnSums::kBlockSize) {
+                    ColumnSums::sum(ids.data(), ids.size(), columns.data(), columns.size(), sums);
+                    ids.clear();
+                }
+            });
+            ColumnSums::sum(ids.data(), ids.size(), columns.data(), columns.size(), sums);
+        };
+        uint64_t rows = bitmap != nullptr ? bitmap->size() : (*results)[binding].size();
+        std::vector<uint64_t> sums(columns.size(), 0);
+        if (context_->parallelism_ <= 1 || result_size_ < kMinParallelChecksum) {
+            sumRows(0, rows, sums.data());
+        } else {
+            // Sums wrap around, so the chunks can be added up in any order
+            unsigned num_chunks = context_->parallelism_ * 4;
+            uint64_t chunk_size = (rows + num_chunks - 1) / num_chunks;
+            std::vector<std::vector<uint64_t>> chunk_sums(num_chunks, sums);
+            parallelFor(context_->tasks_, context_->parallelism_, num_chunks, [&](unsigned chunk) {
+                uint64_t begin = std::min<uint64_t>(rows, chunk * chunk_size);
+                uint64_t end = std::min<uint64_t>(rows, begin + chunk_size);
+                sumRows(begin, end, chunk_sums[chunk].data());
+            });
+            for (auto &chunk: chunk_sums) {
+                for (unsigned c = 0; c < sums.size(); ++c) {
+                    sums[c] += chunk[c];
+                }
+            }
+        }
+        for (unsigned c = 0; c < selections.size(); ++c) {
+            check_sums_[selections[c]] = sums[c];
         }
-        check_sums_.push_back(sum);
     }
 }
 
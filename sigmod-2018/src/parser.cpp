@@ -1,7 +1,12 @@
 #include "parser.h"
 
+#include <algorithm>
 #include <cassert>
+#include <charconv>
+#include <cstdint>
+#include <functional>
 #include <iostream>
+#include <stdexcept>
 #include <utility>
 #include <sstream>
 
@@ -137,6 +142,85 @@ void QueryInfo::parseQuery(std::string &raw_query, size_t query_id) {
     resolveRelationIds();
 }
 
+// Check the syntax of a query
+void QueryInfo::checkSyntax(const std::string &raw_query) {
+    auto fail = [&](const std::string &what) {
+        throw std::invalid_argument(what + " in query \"" + raw_query + "\"");
+    };
+    // A number that fits an unsigned
+    auto number = [&](const std::string &raw, uint64_t max) {
+        uint64_t value = 0;
+        auto [end, error] = std::from_chars(raw.data(), raw.data() + raw.size(), value);
+        if (raw.empty() || error != std::errc() || end != raw.data() + raw.size() || value > max) {
+            fail("bad number \"" + raw + "\"");
+        }
+        return value;
+    };
+    std::vector<std::string> parts;
+    std::string raw = raw_query;
+    splitString(raw, parts, '|');
+    if (std::count(raw_query.begin(), raw_query.end(), '|') != 2 || parts.size() != 3) {
+        fail("expected three parts separated by |");
+    }
+    std::vector<std::string> relations;
+    splitString(parts[0], relations, ' ');
+    if (relations.empty()) {
+        fail("no relations");
+    }
+    for (auto &relation: relations) {
+        number(relation, UINT32_MAX);
+    }
+    // binding.column, the binding one of the relations
+    auto column = [&](const std::string &raw) {
+        auto dot = raw.find('.');
+        if (dot == std::string::npos) fail("expected binding.column, got \"" + raw + "\"");
+        auto binding = number(raw.substr(0, dot), UINT32_MAX);
+        if (binding >= relations.size()) fail("no binding " + raw.substr(0, dot));
+        number(raw.substr(dot + 1), UINT32_MAX);
+        return binding;
+    };
+    // The bindings connected by the join predicates, the joiner never builds
+    // cross products
+    std::vector<uint64_t> component(relations.size());
+    for (unsigned i = 0; i < component.size(); ++i) component[i] = i;
+    std::function<uint64_t(uint64_t)> find = [&](uint64_t x) {
+        return component[x] == x ? x : component[x] = find(component[x]);
+    };
+    bool joined = false;
+    std::vector<std::string> predicates;
+    splitString(parts[1], predicates, '&');
+    for (auto &predicate: predicates) {
+        auto position = predicate.find_first_of("<>=");
+        if (position == std::string::npos || predicate.find_first_of("<>=", position + 1) != std::string::npos) {
+            fail("expected one comparison in \"" + predicate + "\"");
+        }
+        column(predicate.substr(0, position));
+        auto right = predicate.substr(position + 1);
+        if (isConstant(right)) {
+            number(right, UINT64_MAX);
+        } else if (predicate[position] != '=') {
+            fail("only equality joins columns in \"" + predicate + "\"");
+        } else {
+            component[find(column(predicate.substr(0, position)))] = find(column(right));
+            joined = true;
+        }
+    }
+    if (!joined) {
+        fail("no join predicate");
+    }
+    for (unsigned binding = 1; binding < relations.size(); ++binding) {
+        if (find(binding) != find(0)) fail("binding " + std::to_string(binding) + " is not joined");
+    }
+    std::vector<std::string> selections;
+    splitString(parts[2], selections, ' ');
+    if (selections.empty()) {
+        fail("no selections");
+    }
+    for (auto &selection: selections) {
+        column(selection);
+    }
+}
+
 // Reset query info
 void QueryInfo::clear() {
     relation_ids_.clear();
@@ -0,0 +1,201 @@
+#include "planner.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <map>
+#include <utility>
+
+namespace {
+
+// Default selectivities of System R. Only the fallback when the planner runs
+// without statistics (useStatistics(false)), and the order of the filters of
+// the rewriter, which does not look at the relations
+constexpr double kEqualSelectivity = 0.1;
+constexpr double kRangeSelectivity = 1.0 / 3.0;
+
+}
+
+// Estimated fraction of the tuples passing a filter
+double Planner::filterSelectivity(const FilterInfo &filter) {
+    return filter.comparison == FilterInfo::Comparison::Equal ? kEqualSelectivity : kRangeSelectivity;
+}
+
+// The filters of a binding
+std::vector<FilterInfo> Planner::filters(unsigned binding) const {
+    std::vector<FilterInfo> result;
+    for (auto &f: query_.filters()) {
+        if (f.filter_column.binding == binding) result.push_back(f);
+    }
+    return result;
+}
+
+// Estimated number of tuples of a binding after its filters
+double Planner::estimateScan(unsigned binding) const {
+    double size = relations_[binding]->size();
+    if (statistics_ != nullptr) {
+        return size * statistics_->filterSelectivity(query_.relation_ids()[binding], filters(binding));
+    }
+    for (auto &f: query_.filters()) {
+        if (f.filter_column.binding != binding) continue;
+        size *= filterSelectivity(f);
+    }
+    return size;
+}
+
+// Estimated selectivity of the join predicates between two bindings
+double Planner::joinSelectivity(unsigned binding, double binding_size, unsigned other, double other_size,
+                                const std::vector<std::pair<unsigned, unsigned>> &columns) const {
+    auto rel_id = query_.relation_ids()[binding], other_rel_id = query_.relation_ids()[other];
+    // The samples are joined once per query, the planner asks many times
+    auto memo = join_selectivities_.find({binding, other});
+    if (memo == join_selectivities_.end()) {
+        double sampled = statistics_->joinSelectivity(rel_id, filters(binding), other_rel_id, filters(other),
+                                                      columns);
+        memo = join_selectivities_.emplace(std::make_pair(binding, other), sampled).first;
+    }
+    double selectivity = memo->second;
+    if (selectivity < 0) {
+        // Too rare for the samples: 1 / max(distinct(l), distinct(r)) per
+        // column pair, an input has at most as many distinct values as rows
+        selectivity = 1;
+        for (auto &[col_id, other_col_id]: columns) {
+            double distinct = std::max(std::min(statistics_->relation(rel_id).distinct(col_id), binding_size),
+                                       std::min(statistics_->relation(other_rel_id).distinct(other_col_id),
+                                                other_size));
+            selectivity /= std::max(distinct, 1.0);
+        }
+    }
+    return selectivity;
+}
+
+// Estimated size of a join, |L| * |R| / max(distinct(l), distinct(r)) per
+// join column pair. Without statistics the relation size bounds the number
+// of distinct values.
+double Planner::estimateJoin(const std::set<unsigned> &joined, double joined_size,
+                             unsigned binding, double binding_size) const {
+    std::set<std::pair<std::pair<unsigned, unsigned>, std::pair<unsigned, unsigned>>> column_pairs;
+    for (auto &p: query_.predicates()) {
+        auto left = p.left, right = p.right;
+        if (right.binding == binding && joined.count(left.binding)) {
+            std::swap(left, right);
+        }
+        if (left.binding != binding || !joined.count(right.binding)) continue;
+        // The same pair written twice only counts once
+        column_pairs.emplace(std::make_pair(left.binding, left.col_id),
+                             std::make_pair(right.binding, right.col_id));
+    }
+    if (column_pairs.empty()) {
+        return std::numeric_limits<double>::infinity();
+    }
+    double size = joined_size * binding_size;
+    if (statistics_ != nullptr) {
+        // The predicates to one joined binding are estimated together, they
+        // may be correlated
+        std::map<unsigned, std::vector<std::pair<unsigned, unsigned>>> columns;
+        for (auto &pair: column_pairs) {
+            columns[pair.second.first].emplace_back(pair.first.second, pair.second.second);
+        }
+        for (auto &[other, other_columns]: columns) {
+            size *= joinSelectivity(binding, binding_size, other, joined_size, other_columns);
+        }
+        return size;
+    }
+    for (auto &pair: column_pairs) {
+        double distinct = std::max(relations_[pair.first.first]->size(),
+                                   relations_[pair.second.first]->size());
+        size /= std::max(distinct, 1.0);
+    }
+    return size;
+}
+
+// Greedy left-deep plan
+std::vector<PlanStep> Planner::plan(const std::vector<double> &input_sizes) const {
+    // Start with the join predicate with the smallest estimated result
+    double best = std::numeric_limits<double>::infinity();
+    std::vector<PlanStep> steps;
+    for (auto &p: query_.predicates()) {
+        if (p.left.binding == p.right.binding) continue;
+        for (auto [first, second]: {std::make_pair(p.left.binding, p.right.binding),
+                                    std::make_pair(p.right.binding, p.left.binding)}) {
+            double estimate = estimateJoin({first}, input_sizes[first], second, input_sizes[second]);
+            // Ties go to the smaller start, it is the first build side
+            if (steps.empty() || estimate < best
+                || (estimate == best && input_sizes[first] < steps[0].estimate)) {
+                best = estimate;
+                steps = {{first, input_sizes[first]}, {second, estimate}};
+            }
+        }
+    }
+    if (steps.empty()) {
+        return steps;
+    }
+    auto rest = plan({steps[0].binding, steps[1].binding}, best, input_sizes);
+    steps.insert(steps.end(), rest.begin(), rest.end());
+    return steps;
+}
+
+// Continue a plan from an intermediate
+std::vector<PlanStep> Planner::plan(std::set<unsigned> joined, double joined_size,
+                                    const std::vector<double> &input_sizes) const {
+    std::vector<PlanStep> steps;
+    while (true) {
+        PlanStep next{0, std::numeric_limits<double>::infinity()};
+        for (auto &p: query_.predicates()) {
+            for (auto binding: {p.left.binding, p.right.binding}) {
+                if (joined.count(binding)) continue;
+                double estimate = estimateJoin(joined, joined_size, binding, input_sizes[binding]);
+                if (estimate < next.estimate) {
+                    next = {binding, estimate};
+                }
+            }
+        }
+        // Everything reachable is joined, we never build cross products
+        if (next.estimate == std::numeric_limits<double>::infinity()) {
+            return steps;
+        }
+        steps.push_back(next);
+        joined.insert(next.binding);
+        joined_size = next.estimate;
+    }
+}
+
+// Estimated cost of the query
+double Planner::estimateCost() const {
+    std::vector<double> input_sizes(relations_.size());
+    double cost = 0;
+    for (unsigned binding = 0; binding < relations_.size(); ++binding) {
+        input_sizes[binding] = estimateScan(binding);
+        cost += relations_[binding]->size();
+    }
+    for (auto &step: plan(input_sizes)) {
+        cost += step.estimate;
+    }
+    return cost;
+}
+
+// Whether the query graph has a cycle
+bool Planner::isCyclic() const {
+    std::vector<unsigned> component(relations_.size());
+    for (unsigned i = 0; i < component.size(); ++i) component[i] = i;
+    std::function<unsigned(unsigned)> find = [&](unsigned x) {
+        return component[x] == x ? x : component[x] = find(component[x]);
+    };
+    std::set<std::pair<unsigned, unsigned>> edges;
+    for (auto &p: query_.predicates()) {
+        auto edge = std::minmax(p.left.binding, p.right.binding);
+        if (edge.first == edge.second || !edges.insert(edge).second) continue;
+        auto a = find(edge.first), b = find(edge.second);
+        // A new edge between bindings that are already connected closes a cycle
+        if (a == b) return true;
+        component[a] = b;
+    }
+    return false;
+}
+
+// Whether the estimate is off by more than kReplanThreshold in either direction
+bool Planner::needsReplan(double estimate, double actual) {
+    estimate = std::max(estimate, 1.0);
+    actual = std::max(actual, 1.0);
+    return std::max(estimate / actual, actual / estimate) > kReplanThreshold;
+}
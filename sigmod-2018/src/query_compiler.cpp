@@ -0,0 +1,419 @@
+#include "query_compiler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <spawn.h>
+#include <sstream>
+#include <stdexcept>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+namespace {
+
+// The start of every pipeline: a chained hash table over the rows of a scan
+const char *kPreamble = R"(#include <cstdint>
+#include <vector>
+
+namespace {
+
+// The rows of a scan by the value of their key column
+class Table {
+private:
+    static constexpr uint64_t kEnd = ~uint64_t(0);
+    const std::vector<uint64_t> &rows_;
+    std::vector<uint64_t> keys_, next_, heads_;
+    unsigned shift_;
+
+    uint64_t bucket(uint64_t key) const {
+        return (key * 0x9e3779b97f4a7c15ull) >> shift_;
+    }
+
+public:
+    Table(const uint64_t *column, const std::vector<uint64_t> &rows)
+            : rows_(rows), keys_(rows.size()), next_(rows.size()) {
+        unsigned bits = 1;
+        while ((uint64_t(1) << bits) < rows.size() * 2) ++bits;
+        shift_ = 64 - bits;
+        heads_.assign(uint64_t(1) << bits, kEnd);
+        for (uint64_t i = 0; i < rows.size(); ++i) {
+            keys_[i] = column[rows[i]];
+            auto &head = heads_[bucket(keys_[i])];
+            next_[i] = head;
+            head = i;
+        }
+    }
+
+    template<typename F>
+    void probe(uint64_t key, F &&f) const {
+        for (uint64_t i = heads_[bucket(key)]; i != kEnd; i = next_[i]) {
+            if (keys_[i] == key) f(rows_[i]);
+        }
+    }
+};
+
+}
+)";
+
+// The text of a column
+std::string columnText(const SelectInfo &info) {
+    return std::to_string(info.binding) + "." + std::to_string(info.col_id);
+}
+
+// The C++ operator of a comparison
+const char *comparisonOperator(FilterInfo::Comparison comparison) {
+    switch (comparison) {
+        case FilterInfo::Comparison::Equal:
+            return "==";
+        case FilterInfo::Comparison::Greater:
+            return ">";
+        case FilterInfo::Comparison::Less:
+            return "<";
+    }
+    return "==";
+}
+
+}
+
+// The constructor
+QueryCompiler::QueryCompiler(Options options) : options_(std::move(options)) {
+    if (options_.directory.empty()) {
+        const char *tmp = getenv("TMPDIR");
+        std::string pattern = std::string(tmp != nullptr ? tmp : "/tmp") + "/sigmod-compile-XXXXXX";
+        // Without a directory every compilation fails, the queries stay interpreted
+        if (mkdtemp(pattern.data()) != nullptr) {
+            options_.directory = pattern;
+            own_directory_ = true;
+        }
+    }
+    thread_ = std::thread([this] { compileLoop(); });
+}
+
+// The destructor
+QueryCompiler::~QueryCompiler() {
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    thread_.join();
+    for (auto handle: handles_) {
+        dlclose(handle);
+    }
+    if (own_directory_) {
+        std::error_code error;
+        std::filesystem::remove_all(options_.directory, error);
+    }
+}
+
+// The template key of a query
+std::string QueryCompiler::templateKey(const QueryInfo &query) {
+    std::string key;
+    for (auto rel_id: query.relation_ids()) {
+        key += std::to_string(rel_id) + " ";
+    }
+    key += "|";
+    for (auto &p: query.predicates()) {
+        key += columnText(p.left) + "=" + columnText(p.right) + "&";
+    }
+    key += "|";
+    for (auto &f: query.filters()) {
+        key += columnText(f.filter_column) + static_cast<char>(f.comparison) + "&";
+    }
+    key += "|";
+    for (auto &s: query.selections()) {
+        key += columnText(s) + " ";
+    }
+    return key;
+}
+
+// The source of the pipeline of a query
+std::string QueryCompiler::generate(const QueryInfo &query, const std::vector<unsigned> &order,
+                                    std::vector<std::pair<unsigned, unsigned>> &slots) {
+    unsigned num_bindings = query.relation_ids().size();
+    if (order.size() != num_bindings || std::set<unsigned>(order.begin(), order.end()).size() != num_bindings) {
+        return "";
+    }
+    slots.clear();
+    std::map<std::pair<unsigned, unsigned>, unsigned> slot_ids;
+    // The variable of a column
+    auto slot = [&](const SelectInfo &info) {
+        auto inserted = slot_ids.emplace(std::make_pair(info.binding, info.col_id), slots.size());
+        if (inserted.second) slots.emplace_back(info.binding, info.col_id);
+        return "c" + std::to_string(inserted.first->second);
+    };
+    // A value of a column in a row
+    auto value = [&](const SelectInfo &info, const std::string &row) {
+        return slot(info) + "[" + row + "]";
+    };
+    auto name = [](const char *prefix, unsigned binding) {
+        return prefix + std::to_string(binding);
+    };
+
+    std::ostringstream body;
+    // The scans, the filters and the predicates within a binding
+    auto &filters = query.filters();
+    for (unsigned binding = 0; binding < num_bindings; ++binding) {
+        std::string condition;
+        auto add = [&](const std::string &term) {
+            condition += (condition.empty() ? "(" : " & (") + term + ")";
+        };
+        for (unsigned f = 0; f < filters.size(); ++f) {
+            if (filters[f].filter_column.binding != binding) continue;
+            add(value(filters[f].filter_column, "i") + " " + comparisonOperator(filters[f].comparison)
+                + " k" + std::to_string(f));
+        }
+        for (auto &p: query.predicates()) {
+            if (p.left.binding != binding || p.right.binding != binding) continue;
+            add(value(p.left, "i") + " == " + value(p.right, "i"));
+        }
+        auto scan = name("scan", binding);
+        body << "    std::vector<uint64_t> " << scan << ";\n"
+             << "    for (uint64_t i = 0; i != rows[" << binding << "]; ++i) {\n";
+        if (condition.empty()) {
+            body << "        " << scan << ".push_back(i);\n";
+        } else {
+            body << "        if (" << condition << ") " << scan << ".push_back(i);\n";
+        }
+        body << "    }\n"
+             << "    if (" << scan << ".empty()) return 0;\n";
+    }
+
+    // The joins, the intermediate result holds the rows of every joined binding
+    body << "    std::vector<uint64_t>";
+    for (unsigned binding = 0; binding < num_bindings; ++binding) {
+        body << (binding == 0 ? " " : ", ") << name("t", binding);
+    }
+    body << ";\n"
+         << "    " << name("t", order[0]) << ".swap(" << name("scan", order[0]) << ");\n"
+         << "    uint64_t size = " << name("t", order[0]) << ".size();\n";
+    std::vector<unsigned> joined{order[0]};
+    for (unsigned step = 1; step < order.size(); ++step) {
+        auto binding = order[step];
+        // The predicates to the joined bindings, the first one is the key
+        std::vector<PredicateInfo> predicates;
+        for (auto p: query.predicates()) {
+            if (p.left.binding == binding) std::swap(p.left, p.right);
+            if (p.right.binding != binding
+                || std::find(joined.begin(), joined.end(), p.left.binding) == joined.end()) {
+                continue;
+            }
+            predicates.push_back(p);
+        }
+        if (predicates.empty()) {
+            return "";
+        }
+        auto &key = predicates[0];
+        body << "    {\n"
+             << "        Table table(" << slot(key.right) << ", " << name("scan", binding) << ");\n";
+        joined.push_back(binding);
+        body << "        std::vector<uint64_t>";
+        for (unsigned i = 0; i < joined.size(); ++i) {
+            body << (i == 0 ? " " : ", ") << name("n", joined[i]);
+        }
+        body << ";\n"
+             << "        for (uint64_t i = 0; i != size; ++i) {\n"
+             << "            table.probe(" << value(key.left, name("t", key.left.binding) + "[i]")
+             << ", [&](uint64_t row) {\n";
+        for (unsigned p = 1; p < predicates.size(); ++p) {
+            body << "                if (" << value(predicates[p].left, name("t", predicates[p].left.binding) + "[i]")
+                 << " != " << value(predicates[p].right, "row") << ") return;\n";
+        }
+        for (auto b: joined) {
+            body << "                " << name("n", b) << ".push_back("
+                 << (b == binding ? std::string("row") : name("t", b) + "[i]") << ");\n";
+        }
+        body << "            });\n"
+             << "        }\n";
+        for (auto b: joined) {
+            body << "        " << name("t", b) << ".swap(" << name("n", b) << ");\n";
+        }
+        body << "    }\n"
+             << "    size = " << name("t", binding) << ".size();\n"
+             << "    if (size == 0) return 0;\n";
+    }
+
+    // The checksums
+    auto &selections = query.selections();
+    body << "    for (unsigned s = 0; s < " << selections.size() << "; ++s) sums[s] = 0;\n"
+         << "    for (uint64_t i = 0; i != size; ++i) {\n";
+    for (unsigned s = 0; s < selections.size(); ++s) {
+        body << "        sums[" << s << "] += " << value(selections[s], name("t", selections[s].binding) + "[i]")
+             << ";\n";
+    }
+    body << "    }\n"
+         << "    return size;\n";
+
+    std::ostringstream source;
+    source << "// The pipeline of the query template " << templateKey(query) << "\n"
+           << kPreamble << "\n"
+           << "extern \"C\" uint64_t sigmod_query(const uint64_t *const *columns, const uint64_t *rows,\n"
+           << "                                   const uint64_t *constants, uint64_t *sums) {\n";
+    for (unsigned slot = 0; slot < slots.size(); ++slot) {
+        source << "    const uint64_t *c" << slot << " = columns[" << slot << "];\n";
+    }
+    for (unsigned f = 0; f < filters.size(); ++f) {
+        source << "    const uint64_t k" << f << " = constants[" << f << "];\n";
+    }
+    source << body.str() << "}\n";
+    return source.str();
+}
+
+// Compile a source file and load its pipeline
+QueryCompiler::Function QueryCompiler::compile(const std::string &source) {
+    std::string base;
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        base = options_.directory + "/query" + std::to_string(num_files_++);
+    }
+    std::string source_path = base + ".cpp", library = base + ".so", log = base + ".log";
+    {
+        std::ofstream out(source_path);
+        out << source;
+        if (!out) return nullptr;
+    }
+
+    // Out of process, the diagnostics go to the log next to the source
+    std::vector<std::string> args{options_.compiler, "-std=c++17", "-O2", "-shared", "-fPIC",
+                                  "-o", library, source_path};
+    std::vector<char *> argv;
+    for (auto &arg: args) {
+        argv.push_back(arg.data());
+    }
+    argv.push_back(nullptr);
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, log.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    posix_spawn_file_actions_adddup2(&actions, STDOUT_FILENO, STDERR_FILENO);
+    pid_t pid;
+    int error = posix_spawnp(&pid, options_.compiler.c_str(), &actions, nullptr, argv.data(), environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (error != 0) {
+        return nullptr;
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return nullptr;
+    }
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        return nullptr;
+    }
+
+    void *handle = dlopen(library.c_str(), RTLD_NOW | RTLD_LOCAL);
+    if (handle == nullptr) {
+        return nullptr;
+    }
+    auto function = reinterpret_cast<Function>(dlsym(handle, "sigmod_query"));
+    if (function == nullptr) {
+        dlclose(handle);
+        return nullptr;
+    }
+    std::lock_guard<std::mutex> lk(m_);
+    handles_.push_back(handle);
+    return function;
+}
+
+// Compile the jobs until stopped
+void QueryCompiler::compileLoop() {
+    std::unique_lock<std::mutex> lk(m_);
+    while (true) {
+        cv_.wait(lk, [&] { return stop_ || !jobs_.empty(); });
+        if (stop_) return;
+        auto job = std::move(jobs_.front());
+        jobs_.pop_front();
+        compiling_ = true;
+        lk.unlock();
+        auto function = compile(job.source);
+        lk.lock();
+        auto &compiled = templates_[job.key];
+        compiled.function = function;
+        compiled.state = function != nullptr ? State::Compiled : State::Failed;
+        compiling_ = false;
+        cv_.notify_all();
+    }
+}
+
+// Run a query with its compiled pipeline
+bool QueryCompiler::run(const std::string &key, const QueryInfo &query, const Context &context,
+                        QueryResult &result) {
+    const Template *compiled;
+    {
+        std::lock_guard<std::mutex> lk(m_);
+        auto it = templates_.find(key);
+        if (it == templates_.end() || it->second.state != State::Compiled) return false;
+        // Its slots and function do not change any more
+        compiled = &it->second;
+    }
+    std::vector<const uint64_t *> columns;
+    for (auto [binding, col_id]: compiled->slots) {
+        columns.push_back(context.relations_[binding]->columns()[col_id]);
+    }
+    std::vector<uint64_t> constants;
+    for (auto &f: query.filters()) {
+        constants.push_back(f.constant);
+    }
+    uint64_t size;
+    try {
+        size = compiled->function(columns.data(), context.sizes_.data(), constants.data(), result.data());
+    } catch (const std::exception &) {
+        // Out of memory, the interpreter may still make it (it can spill)
+        return false;
+    }
+    result.empty = size == 0;
+    std::lock_guard<std::mutex> lk(m_);
+    ++compiled_runs_;
+    return true;
+}
+
+// Count an interpreted run of a template
+void QueryCompiler::interpreted(const std::string &key, const QueryInfo &query, const std::vector<unsigned> &order) {
+    std::lock_guard<std::mutex> lk(m_);
+    auto &hot = templates_[key];
+    if (hot.state != State::Interpreted || ++hot.runs < options_.hot_threshold) {
+        return;
+    }
+    auto source = generate(query, order, hot.slots);
+    if (source.empty()) {
+        hot.state = State::Failed;
+        return;
+    }
+    hot.state = State::Compiling;
+    jobs_.push_back({key, std::move(source)});
+    cv_.notify_all();
+}
+
+// Wait for the compilations
+void QueryCompiler::wait() {
+    std::unique_lock<std::mutex> lk(m_);
+    cv_.wait(lk, [&] { return jobs_.empty() && !compiling_; });
+}
+
+// The number of compiled templates
+unsigned QueryCompiler::compiledTemplates() {
+    std::lock_guard<std::mutex> lk(m_);
+    return std::count_if(templates_.begin(), templates_.end(), [](auto &t) {
+        return t.second.state == State::Compiled;
+    });
+}
+
+// The number of failed templates
+unsigned QueryCompiler::failedTemplates() {
+    std::lock_guard<std::mutex> lk(m_);
+    return std::count_if(templates_.begin(), templates_.end(), [](auto &t) {
+        return t.second.state == State::Failed;
+    });
+}
+
+// The number of queries that ran compiled
+uint64_t QueryCompiler::compiledRuns() {
+    std::lock_guard<std::mutex> lk(m_);
+    return compiled_runs_;
+}
@@ -1,17 +1,56 @@
 #include "relation.h"
 
+#include <algorithm>
 #include <fcntl.h>
 #include <iostream>
 #include <fstream>
 #include <sys/mman.h>
 #include <sys/stat.h>
 #include <csignal>
+#include <cstring>
+#include <stdexcept>
+
+/// The page size, reserved ranges are committed in whole pages
+static constexpr uint64_t kPageBytes = 4096;
+/// Columns start at one of kColours offsets within their first page, apart by
+/// kColourBytes. Without that the same row of all columns would always map to
+/// the same cache sets.
+static constexpr uint64_t kColours = 16, kColourBytes = kPageBytes / kColours;
+static std::atomic<unsigned> next_colour{0};
+
+// Reserve the address range of a column, memory is only committed by commitRange
+static uint64_t *reserveColumn() {
+    void *memory = mmap(nullptr, Relation::kMaxRows * sizeof(uint64_t) + kPageBytes, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (memory == MAP_FAILED) {
+        return nullptr;
+    }
+    auto offset = next_colour.fetch_add(1) % kColours * kColourBytes;
+    return reinterpret_cast<uint64_t *>(static_cast<char *>(memory) + offset);
+}
+
+// Make the rows [begin, end) of a reserved column accessible
+static bool commitRange(uint64_t *column, uint64_t begin, uint64_t end) {
+    if (end <= begin) {
+        return true;
+    }
+    auto first = reinterpret_cast<uintptr_t>(column + begin) / kPageBytes * kPageBytes;
+    auto last = reinterpret_cast<uintptr_t>(column + end);
+    return mprotect(reinterpret_cast<void *>(first), last - first, PROT_READ | PROT_WRITE) == 0;
+}
+
+// Release a reserved column
+static void releaseColumn(uint64_t *column) {
+    auto base = reinterpret_cast<uintptr_t>(column) / kPageBytes * kPageBytes;
+    munmap(reinterpret_cast<void *>(base), Relation::kMaxRows * sizeof(uint64_t) + kPageBytes);
+}
 
 // Stores a relation into a binary file
 void Relation::storeRelation(const std::string &file_name) {
     std::ofstream out_file;
     out_file.open(file_name, std::ios::out | std::ios::binary);
-    out_file.write((char *) &size_, sizeof(size_));
+    uint64_t size = size_;
+    out_file.write((char *) &size, sizeof(size));
     auto numColumns = columns_.size();
     out_file.write((char *) &numColumns, sizeof(size_t));
     for (auto c : columns_) {
@@ -70,15 +109,16 @@ void Relation::loadRelation(const char *file_name) {
     }
 
     // 首先读取size_和numColumns
-    is.read((char *) &size_, sizeof(size_));
+    uint64_t size;
+    is.read((char *) &size, sizeof(size));
+    size_ = size;
     // 然后读取关系表属性的数量
     size_t numColumns;
     is.read((char *) &numColumns, sizeof(size_t));
-    // 读取每一列的数据
-    for (unsigned i = 0; i < numColumns; ++i) {
-        auto *column = new uint64_t[size_];
-        is.read((char *) column, size_ * sizeof(uint64_t));
-        columns_.push_back(column);
+    // 读取每一列的数据, straight into appendable columns if possible
+    allocateColumns(numColumns, size);
+    for (auto column : columns_) {
+        is.read((char *) column, size * sizeof(uint64_t));
     }
 }
 
@@ -87,14 +127,160 @@ Relation::Relation(const char *file_name) : owns_memory_(true), size_(0) {
     loadRelation(file_name);
 }
 
+// A relation with uninitialized columns, appendable if the address space allows
+Relation Relation::allocate(uint64_t size, unsigned num_columns) {
+    Relation relation(0, {});
+    relation.allocateColumns(num_columns, size);
+    relation.size_ = size;
+    return relation;
+}
+
+// A relation on columns owned by someone else
+Relation Relation::view(uint64_t size, std::vector<uint64_t *> columns) {
+    Relation relation(size, std::move(columns));
+    relation.owns_memory_ = false;
+    return relation;
+}
+
+// Move constructor
+Relation::Relation(Relation &&other) noexcept
+        : owns_memory_(other.owns_memory_), reserved_(other.reserved_), committed_(other.committed_),
+          home_node_(other.home_node_), size_(other.size_.load()),
+          columns_(std::move(other.columns_)), indexes_(std::move(other.indexes_)) {
+    other.columns_.clear();
+    other.owns_memory_ = false;
+    other.reserved_ = false;
+}
+
 // Destructor
 Relation::~Relation() {
-    if (owns_memory_) {
+    if (reserved_) {
+        for (auto c : columns_)
+            releaseColumn(c);
+    } else if (owns_memory_) {
         for (auto c : columns_)
             delete[] c;
     }
 }
 
+// Allocate uninitialized columns, reserved ones if the address space allows
+void Relation::allocateColumns(unsigned num_columns, uint64_t rows) {
+    reserved_ = true;
+    for (unsigned i = 0; i < num_columns; ++i) {
+        auto *column = reserveColumn();
+        if (column == nullptr) {
+            break;
+        }
+        columns_.push_back(column);
+    }
+    try {
+        if (columns_.size() == num_columns) {
+            commit(rows);
+            return;
+        }
+    } catch (const std::bad_alloc &) {
+    }
+    // E.g. under RLIMIT_AS: plain columns, the relation is not appendable
+    for (auto c : columns_)
+        releaseColumn(c);
+    columns_.clear();
+    reserved_ = false;
+    committed_ = 0;
+    for (unsigned i = 0; i < num_columns; ++i) {
+        columns_.push_back(new uint64_t[rows]);
+    }
+}
+
+// Commit the reserved columns
+void Relation::commit(uint64_t rows) {
+    if (rows <= committed_) {
+        return;
+    }
+    uint64_t end = std::min(kMaxRows, (rows + kSegmentRows - 1) / kSegmentRows * kSegmentRows);
+    for (auto c : columns_) {
+        if (!commitRange(c, committed_, end)) {
+            throw std::bad_alloc();
+        }
+    }
+    committed_ = end;
+}
+
+// Move the columns to a NUMA node
+void Relation::place(int node, const NumaTopology &topology) {
+    uint64_t size = size_;
+    uint64_t committed = std::max(committed_, (size + kSegmentRows - 1) / kSegmentRows * kSegmentRows);
+    std::vector<uint64_t *> placed;
+    for (auto c : columns_) {
+        // The pages committed by later appends follow the policy as well
+        auto column = reserveColumn();
+        if (column != nullptr) {
+            numa::bind(column, kMaxRows * sizeof(uint64_t), node, topology);
+        }
+        if (column == nullptr || !commitRange(column, 0, committed)) {
+            // Keep what we have, the relation just stays where it is
+            if (column != nullptr)
+                releaseColumn(column);
+            for (auto p : placed)
+                releaseColumn(p);
+            return;
+        }
+        memcpy(column, c, size * sizeof(uint64_t));
+        placed.push_back(column);
+    }
+    for (auto c : columns_) {
+        if (reserved_)
+            releaseColumn(c);
+        else if (owns_memory_)
+            delete[] c;
+    }
+    columns_ = std::move(placed);
+    reserved_ = true;
+    committed_ = committed;
+    owns_memory_ = true;
+    home_node_ = node;
+}
+
+// Move the columns into reserved address ranges
+bool Relation::makeAppendable() {
+    if (reserved_) {
+        return true;
+    }
+    // Placing on no particular node moves the columns without binding them,
+    // it keeps them as they are if they cannot be reserved
+    place(-1, NumaTopology::simulate(1, 1));
+    if (!reserved_) {
+        return false;
+    }
+    home_node_ = -1;
+    return true;
+}
+
+// Append rows
+void Relation::append(const std::vector<const uint64_t *> &columns, uint64_t count) {
+    if (!reserved_) {
+        throw std::logic_error("relation is not appendable");
+    }
+    if (columns.size() != columns_.size()) {
+        throw std::invalid_argument("appended rows have the wrong number of columns");
+    }
+    uint64_t begin = size_.load(std::memory_order_relaxed);
+    if (count > kMaxRows - begin) {
+        throw std::length_error("relation grows beyond kMaxRows");
+    }
+    // Readers only look at rows below the size they read, the new rows are
+    // written behind it and then published
+    commit(begin + count);
+    for (unsigned c = 0; c < columns_.size(); ++c) {
+        memcpy(columns_[c] + begin, columns[c], count * sizeof(uint64_t));
+        if (!indexes_.empty()) {
+            for (uint64_t i = 0; i < count; ++i) {
+                indexes_[c][columns[c][i]].push_back(begin + i);
+            }
+        }
+    }
+    size_.store(begin + count, std::memory_order_release);
+}
+
 // Build an index for all column
 void Relation::buildIndex() {
     for(auto & column : columns_) {
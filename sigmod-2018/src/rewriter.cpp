@@ -0,0 +1,110 @@
+#include "rewriter.h"
+
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <map>
+#include <utility>
+#include <vector>
+
+#include "planner.h"
+
+namespace {
+
+// The values of an equivalence class allowed by its filters, both bounds inclusive
+struct Range {
+    uint64_t low = 0;
+    uint64_t high = std::numeric_limits<uint64_t>::max();
+    bool filtered = false;
+
+    // Intersect with a filter, false if the range became empty
+    bool apply(const FilterInfo &f) {
+        filtered = true;
+        switch (f.comparison) {
+            case FilterInfo::Comparison::Equal:
+                low = std::max(low, f.constant);
+                high = std::min(high, f.constant);
+                break;
+            case FilterInfo::Comparison::Greater:
+                if (f.constant == std::numeric_limits<uint64_t>::max()) return false;
+                low = std::max(low, f.constant + 1);
+                break;
+            case FilterInfo::Comparison::Less:
+                if (f.constant == 0) return false;
+                high = std::min(high, f.constant - 1);
+                break;
+        }
+        return low <= high;
+    }
+};
+
+}
+
+// Rewrite a query
+bool Rewriter::rewrite(QueryInfo &query) {
+    // Number the columns of the query
+    std::map<std::pair<unsigned, unsigned>, unsigned> ids;
+    std::vector<SelectInfo> columns;
+    auto id = [&](const SelectInfo &info) {
+        auto inserted = ids.emplace(std::make_pair(info.binding, info.col_id), columns.size());
+        if (inserted.second) columns.push_back(info);
+        return inserted.first->second;
+    };
+    for (auto &p: query.predicates_) {
+        id(p.left);
+        id(p.right);
+    }
+    for (auto &f: query.filters_) {
+        id(f.filter_column);
+    }
+
+    // The equivalence classes, a predicate between columns that are already
+    // equal follows from the others
+    std::vector<unsigned> component(columns.size());
+    for (unsigned i = 0; i < component.size(); ++i) component[i] = i;
+    std::function<unsigned(unsigned)> find = [&](unsigned x) {
+        return component[x] == x ? x : component[x] = find(component[x]);
+    };
+    std::vector<PredicateInfo> predicates;
+    for (auto &p: query.predicates_) {
+        auto a = find(id(p.left)), b = find(id(p.right));
+        if (a == b) continue;
+        component[a] = b;
+        predicates.push_back(p);
+    }
+
+    // One range per class
+    std::vector<Range> ranges(columns.size());
+    for (auto &f: query.filters_) {
+        if (!ranges[find(id(f.filter_column))].apply(f)) {
+            return false;
+        }
+    }
+
+    // Every column of a filtered class gets the filters of the class. The
+    // columns are in the order of the map, which keeps the rewrite stable.
+    std::vector<FilterInfo> filters;
+    for (auto &[key, column]: ids) {
+        auto &range = ranges[find(column)];
+        if (!range.filtered) continue;
+        auto &info = columns[column];
+        if (range.low == range.high) {
+            filters.emplace_back(info, range.low, FilterInfo::Comparison::Equal);
+            continue;
+        }
+        if (range.low > 0) {
+            filters.emplace_back(info, range.low - 1, FilterInfo::Comparison::Greater);
+        }
+        if (range.high < std::numeric_limits<uint64_t>::max()) {
+            filters.emplace_back(info, range.high + 1, FilterInfo::Comparison::Less);
+        }
+    }
+    // Most selective first, FilterScan stops at the first failing filter
+    std::stable_sort(filters.begin(), filters.end(), [](const FilterInfo &a, const FilterInfo &b) {
+        return Planner::filterSelectivity(a) < Planner::filterSelectivity(b);
+    });
+
+    query.predicates_ = std::move(predicates);
+    query.filters_ = std::move(filters);
+    return true;
+}
@@ -0,0 +1,178 @@
+#include "server.h"
+
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+// Write all bytes to a socket, false if the client is gone
+static bool sendAll(int fd, const std::string &data) {
+    size_t done = 0;
+    while (done < data.size()) {
+        ssize_t res = send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+        if (res < 0) {
+            if (errno == EINTR) continue;
+            return false;
+        }
+        done += res;
+    }
+    return true;
+}
+
+// The destructor
+Server::~Server() {
+    stop();
+}
+
+// Listen on the socket
+void Server::start() {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (path_.size() >= sizeof(address.sun_path)) {
+        throw std::runtime_error("socket path too long: " + path_);
+    }
+    std::strcpy(address.sun_path, path_.c_str());
+
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listen_fd_ < 0) {
+        throw std::runtime_error("cannot create a socket");
+    }
+    unlink(path_.c_str());
+    if (bind(listen_fd_, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0 ||
+        listen(listen_fd_, SOMAXCONN) != 0) {
+        close(listen_fd_);
+        listen_fd_ = -1;
+        throw std::runtime_error("cannot listen on " + path_);
+    }
+    accept_thread_ = std::thread([this] { acceptLoop(); });
+}
+
+// Accept connections
+void Server::acceptLoop() {
+    while (!stopping_.load()) {
+        int fd = accept4(listen_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) continue;
+            break;
+        }
+        std::lock_guard<std::mutex> lk(m_);
+        // Join the sessions that have ended, a long running server would
+        // collect their threads otherwise
+        for (auto it = sessions_.begin(); it != sessions_.end();) {
+            if (it->done.load()) {
+                it->thread.join();
+                it = sessions_.erase(it);
+            } else {
+                ++it;
+            }
+        }
+        if (stopping_.load()) {
+            close(fd);
+            break;
+        }
+        auto &session = sessions_.emplace_back();
+        session.fd = fd;
+        session.thread = std::thread([this, &session] { serve(session); });
+    }
+}
+
+// Serve a session
+void Server::serve(Session &session) {
+    std::vector<QueryInfo> queries;
+    // The error of every query of the batch, empty if it is scheduled
+    std::vector<std::string> errors;
+    size_t query_id = 0;
+    std::string buffer;
+    char chunk[4096];
+    bool connected = true;
+    while (connected) {
+        ssize_t res = recv(session.fd, chunk, sizeof(chunk), 0);
+        if (res < 0 && errno == EINTR) continue;
+        if (res <= 0) break;
+        buffer.append(chunk, res);
+
+        size_t begin = 0, end;
+        while (connected && (end = buffer.find('\n', begin)) != std::string::npos) {
+            std::string line = buffer.substr(begin, end - begin);
+            begin = end + 1;
+            if (!line.empty() && line.back() == '\r') line.pop_back();
+            if (line == "F") {
+                connected = sendAll(session.fd, runBatch(queries, errors));
+                queries.clear();
+                errors.clear();
+            } else if (!line.empty()) {
+                // A bad query is answered with an error, the session goes on
+                try {
+                    QueryInfo::checkSyntax(line);
+                    QueryInfo query;
+                    query.parseQuery(line, query_id++);
+                    joiner_.checkQuery(query);
+                    queries.push_back(std::move(query));
+                    errors.emplace_back();
+                } catch (const std::exception &e) {
+                    errors.push_back(e.what());
+                }
+            }
+        }
+        buffer.erase(0, begin);
+    }
+    {
+        // stop() shuts down the open sockets, so the socket is closed with m_ held
+        std::lock_guard<std::mutex> lk(m_);
+        close(session.fd);
+        session.fd = -1;
+    }
+    session.done.store(true);
+}
+
+// Run the valid queries of a batch
+std::string Server::runBatch(std::vector<QueryInfo> &queries, const std::vector<std::string> &errors) {
+    std::ostringstream out;
+    std::string failure;
+    try {
+        joiner_.runBatch(std::move(queries), out);
+    } catch (const std::exception &e) {
+        failure = e.what();
+    }
+    // The answers in query order, the errors in between
+    std::istringstream answers(out.str());
+    std::string response, line;
+    for (auto &error: errors) {
+        if (!error.empty()) {
+            response += "ERROR " + error + "\n";
+        } else if (!failure.empty()) {
+            response += "ERROR " + failure + "\n";
+        } else {
+            getline(answers, line);
+            response += line + "\n";
+        }
+    }
+    return response;
+}
+
+// Stop the server
+void Server::stop() {
+    if (listen_fd_ < 0) return;
+    stopping_.store(true);
+    // Wakes up accept()
+    shutdown(listen_fd_, SHUT_RDWR);
+    accept_thread_.join();
+    {
+        // Wakes up the sessions waiting for queries, a session running a batch
+        // answers it first
+        std::lock_guard<std::mutex> lk(m_);
+        for (auto &session: sessions_) {
+            if (session.fd >= 0) shutdown(session.fd, SHUT_RD);
+        }
+    }
+    for (auto &session: sessions_) {
+        session.thread.join();
+    }
+    sessions_.clear();
+    close(listen_fd_);
+    listen_fd_ = -1;
+    unlink(path_.c_str());
+}
@@ -0,0 +1,305 @@
+#include "sharding.h"
+
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/prctl.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "joiner.h"
+
+namespace {
+
+// Send all bytes, false if the peer is gone
+bool sendAll(int fd, const void *data, size_t bytes) {
+    auto *p = static_cast<const char *>(data);
+    while (bytes > 0) {
+        ssize_t res = send(fd, p, bytes, MSG_NOSIGNAL);
+        if (res < 0 && errno == EINTR) continue;
+        if (res <= 0) return false;
+        p += res;
+        bytes -= res;
+    }
+    return true;
+}
+
+// Receive exactly bytes bytes, false if the peer is gone
+bool receiveAll(int fd, void *data, size_t bytes) {
+    auto *p = static_cast<char *>(data);
+    while (bytes > 0) {
+        ssize_t res = recv(fd, p, bytes, 0);
+        if (res < 0 && errno == EINTR) continue;
+        if (res <= 0) return false;
+        p += res;
+        bytes -= res;
+    }
+    return true;
+}
+
+}
+
+// The constructor
+ShardedExecutor::ShardedExecutor(Options options) : options_(options) {
+    options_.workers = std::max(options_.workers, 1u);
+}
+
+// The destructor
+ShardedExecutor::~ShardedExecutor() {
+    stop();
+}
+
+// The most joined column of every relation
+std::vector<unsigned> ShardedExecutor::partitionColumns(const std::vector<Relation> &relations,
+                                                        const std::vector<QueryInfo> &queries) {
+    std::vector<std::vector<uint64_t>> uses(relations.size());
+    for (unsigned r = 0; r < relations.size(); ++r) {
+        uses[r].assign(relations[r].columns().size(), 0);
+    }
+    for (auto &query: queries) {
+        for (auto &p: query.predicates()) {
+            if (p.left.binding == p.right.binding) continue;
+            for (auto &side: {p.left, p.right}) {
+                auto rel_id = query.relation_ids()[side.binding];
+                if (rel_id < uses.size() && side.col_id < uses[rel_id].size()) {
+                    ++uses[rel_id][side.col_id];
+                }
+            }
+        }
+    }
+    std::vector<unsigned> columns(relations.size(), 0);
+    for (unsigned r = 0; r < relations.size(); ++r) {
+        // max_element returns the first of equal counts
+        if (!uses[r].empty()) {
+            columns[r] = std::max_element(uses[r].begin(), uses[r].end()) - uses[r].begin();
+        }
+    }
+    return columns;
+}
+
+// The bindings restricted to the partition of a worker
+std::vector<bool> ShardedExecutor::partitionedBindings(const QueryInfo &query, const std::vector<unsigned> &columns,
+                                                       const std::vector<Relation> &relations) {
+    // Bindings joined on their partition columns have equal keys, so their
+    // matching rows are in the same partition
+    auto &rel_ids = query.relation_ids();
+    std::vector<unsigned> component(rel_ids.size());
+    for (unsigned i = 0; i < component.size(); ++i) component[i] = i;
+    std::function<unsigned(unsigned)> find = [&](unsigned x) {
+        return component[x] == x ? x : component[x] = find(component[x]);
+    };
+    for (auto &p: query.predicates()) {
+        if (p.left.col_id == columns[rel_ids[p.left.binding]] && p.right.col_id == columns[rel_ids[p.right.binding]]) {
+            component[find(p.left.binding)] = find(p.right.binding);
+        }
+    }
+    // The class with the most rows is split, the others are read completely
+    std::vector<uint64_t> rows(rel_ids.size(), 0);
+    for (unsigned binding = 0; binding < rel_ids.size(); ++binding) {
+        rows[find(binding)] += relations[rel_ids[binding]].size();
+    }
+    unsigned driving = std::max_element(rows.begin(), rows.end()) - rows.begin();
+    std::vector<bool> partitioned(rel_ids.size());
+    for (unsigned binding = 0; binding < rel_ids.size(); ++binding) {
+        partitioned[binding] = find(binding) == driving;
+    }
+    return partitioned;
+}
+
+// Partition the relations and start the workers
+void ShardedExecutor::start(const std::vector<Relation> &relations, const std::vector<QueryInfo> &queries) {
+    unsigned num_workers = options_.workers;
+    auto columns = partitionColumns(relations, queries);
+    segment_bytes_ = 0;
+    for (auto &relation: relations) {
+        segment_bytes_ += relation.size() * relation.columns().size() * sizeof(uint64_t);
+    }
+    // Shared with the forked workers, not copied on write
+    segment_ = mmap(nullptr, std::max<uint64_t>(segment_bytes_, 1), PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (segment_ == MAP_FAILED) {
+        segment_ = nullptr;
+        throw std::runtime_error("cannot map the shared segment: " + std::string(strerror(errno)));
+    }
+
+    auto *next = static_cast<uint64_t *>(segment_);
+    relations_.clear();
+    for (unsigned r = 0; r < relations.size(); ++r) {
+        auto &relation = relations[r];
+        uint64_t size = relation.size();
+        SharedRelation shared;
+        shared.partition_column = columns[r];
+        // Counting sort of the rows by partition
+        std::vector<unsigned> partition(size);
+        shared.bounds.assign(num_workers + 1, 0);
+        if (!relation.columns().empty()) {
+            auto *keys = relation.columns()[columns[r]];
+            for (uint64_t row = 0; row < size; ++row) {
+                partition[row] = partitionOf(keys[row], num_workers);
+                ++shared.bounds[partition[row] + 1];
+            }
+        }
+        for (unsigned w = 0; w < num_workers; ++w) {
+            shared.bounds[w + 1] += shared.bounds[w];
+        }
+        for (auto *column: relation.columns()) {
+            auto positions = shared.bounds;
+            for (uint64_t row = 0; row < size; ++row) {
+                next[positions[partition[row]]++] = column[row];
+            }
+            shared.columns.push_back(next);
+            next += size;
+        }
+        relations_.push_back(std::move(shared));
+    }
+
+    for (unsigned w = 0; w < num_workers; ++w) {
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            stopLocked();
+            throw std::runtime_error("cannot create a worker socket: " + std::string(strerror(errno)));
+        }
+        pid_t pid = fork();
+        if (pid == 0) {
+            // The worker only keeps its own end
+            close(fds[0]);
+            for (auto &worker: workers_) {
+                close(worker.fd);
+            }
+            serve(w, fds[1]);
+        }
+        close(fds[1]);
+        if (pid < 0) {
+            close(fds[0]);
+            stopLocked();
+            throw std::runtime_error("cannot fork a worker: " + std::string(strerror(errno)));
+        }
+        workers_.push_back({pid, fds[0]});
+    }
+}
+
+// Serve the batches of the coordinator
+void ShardedExecutor::serve(unsigned worker, int fd) {
+    // Do not outlive the coordinator
+    prctl(PR_SET_PDEATHSIG, SIGKILL);
+    // Relations 0..n-1 are complete, n..2n-1 the partition of the worker
+    Joiner joiner;
+    for (auto &shared: relations_) {
+        joiner.addSharedRelation(Relation::view(shared.bounds.back(), shared.columns));
+    }
+    for (auto &shared: relations_) {
+        std::vector<uint64_t *> columns;
+        for (auto *column: shared.columns) {
+            columns.push_back(column + shared.bounds[worker]);
+        }
+        joiner.addSharedRelation(Relation::view(shared.bounds[worker + 1] - shared.bounds[worker], columns));
+    }
+
+    std::string text, response;
+    uint32_t num_queries;
+    while (receiveAll(fd, &num_queries, sizeof(num_queries))) {
+        response.clear();
+        for (uint32_t q = 0; q < num_queries; ++q) {
+            uint32_t length;
+            if (!receiveAll(fd, &length, sizeof(length))) _exit(EXIT_FAILURE);
+            text.resize(length);
+            if (!receiveAll(fd, text.data(), length)) _exit(EXIT_FAILURE);
+            QueryInfo query(text);
+            QueryResult result;
+            joiner.join(query, result);
+            // An empty flag and the checksums
+            response.push_back(result.empty ? 1 : 0);
+            response.append(reinterpret_cast<const char *>(result.data()), result.count * sizeof(uint64_t));
+        }
+        if (!sendAll(fd, response.data(), response.size())) _exit(EXIT_FAILURE);
+    }
+    // The coordinator closed the socket. The workers of the joiner (and the
+    // copies of the coordinator's objects) are not torn down.
+    _exit(EXIT_SUCCESS);
+}
+
+// Run a batch on the workers
+void ShardedExecutor::run(const std::vector<Relation> &relations, const std::vector<QueryInfo> &queries,
+                          const std::vector<QueryResult *> &results) {
+    std::lock_guard<std::mutex> lk(m_);
+    if (workers_.empty()) {
+        start(relations, queries);
+    }
+    // The same message for all workers: the bindings read the partition
+    // relation n + r instead of relation r
+    std::vector<unsigned> columns;
+    for (auto &shared: relations_) {
+        columns.push_back(shared.partition_column);
+    }
+    std::string message;
+    uint32_t num_queries = queries.size();
+    message.append(reinterpret_cast<const char *>(&num_queries), sizeof(num_queries));
+    for (auto query: queries) {
+        auto partitioned = partitionedBindings(query, columns, relations);
+        std::string text;
+        for (unsigned binding = 0; binding < query.relation_ids().size(); ++binding) {
+            auto rel_id = query.relation_ids()[binding];
+            text += (binding > 0 ? " " : "") + std::to_string(partitioned[binding] ? relations_.size() + rel_id : rel_id);
+        }
+        auto dump = query.dumpText();
+        text += dump.substr(dump.find('|'));
+        uint32_t length = text.size();
+        message.append(reinterpret_cast<const char *>(&length), sizeof(length));
+        message += text;
+    }
+    for (auto &worker: workers_) {
+        if (!sendAll(worker.fd, message.data(), message.size())) {
+            stopLocked();
+            throw std::runtime_error("a shard worker is gone");
+        }
+    }
+
+    for (auto *result: results) {
+        result->empty = true;
+        std::fill(result->data(), result->data() + result->count, 0);
+    }
+    std::vector<uint64_t> sums;
+    for (auto &worker: workers_) {
+        for (auto *result: results) {
+            char empty;
+            sums.resize(result->count);
+            if (!receiveAll(worker.fd, &empty, 1) || !receiveAll(worker.fd, sums.data(), sums.size() * sizeof(uint64_t))) {
+                stopLocked();
+                throw std::runtime_error("a shard worker is gone");
+            }
+            if (empty) continue;
+            // The result is empty only if it is empty in all partitions
+            result->empty = false;
+            for (unsigned i = 0; i < result->count; ++i) {
+                result->data()[i] += sums[i];
+            }
+        }
+    }
+}
+
+// Stop the workers
+void ShardedExecutor::stop() {
+    std::lock_guard<std::mutex> lk(m_);
+    stopLocked();
+}
+
+// Stop the workers and release the segment
+void ShardedExecutor::stopLocked() {
+    // A worker exits when its socket is closed
+    for (auto &worker: workers_) {
+        close(worker.fd);
+    }
+    for (auto &worker: workers_) {
+        waitpid(worker.pid, nullptr, 0);
+    }
+    workers_.clear();
+    relations_.clear();
+    if (segment_ != nullptr) {
+        munmap(segment_, std::max<uint64_t>(segment_bytes_, 1));
+        segment_ = nullptr;
+    }
+}
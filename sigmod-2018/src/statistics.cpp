@@ -0,0 +1,194 @@
+#include "statistics.h"
+
+#include <cmath>
+#include <random>
+#include <unordered_map>
+#include <unordered_set>
+
+// The estimated number of distinct values
+double HyperLogLog::estimate() const {
+    double m = registers_.size();
+    double sum = 0;
+    unsigned zeros = 0;
+    for (auto reg: registers_) {
+        sum += std::ldexp(1.0, -reg);
+        zeros += reg == 0;
+    }
+    double estimate = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+    // Linear counting is more precise while many registers are still empty
+    if (estimate <= 2.5 * m && zeros > 0) {
+        estimate = m * std::log(m / zeros);
+    }
+    return estimate;
+}
+
+// Sample the relation and count its distinct values
+RelationStatistics::RelationStatistics(const Relation &relation, uint64_t seed)
+        : rows_(relation.size()), gen_(seed) {
+    // Floyd's algorithm draws kSampleSize distinct rows, sorted they are read
+    // in order
+    std::vector<uint64_t> rows;
+    if (rows_ <= kSampleSize) {
+        for (uint64_t i = 0; i < rows_; ++i) rows.push_back(i);
+    } else {
+        std::unordered_set<uint64_t> chosen;
+        for (uint64_t j = rows_ - kSampleSize; j < rows_; ++j) {
+            uint64_t row = std::uniform_int_distribution<uint64_t>(0, j)(gen_);
+            if (!chosen.insert(row).second) {
+                chosen.insert(j);
+                row = j;
+            }
+            rows.push_back(row);
+        }
+        std::sort(rows.begin(), rows.end());
+    }
+
+    for (auto column: relation.columns()) {
+        std::vector<uint64_t> values;
+        values.reserve(rows.size());
+        for (auto row: rows) {
+            values.push_back(column[row]);
+        }
+        sample_.push_back(std::move(values));
+
+        HyperLogLog hll;
+        for (uint64_t i = 0; i < rows_; ++i) {
+            hll.add(column[i]);
+        }
+        sketches_.push_back(std::move(hll));
+    }
+    updateDistinct();
+}
+
+// Estimate the distinct counts from the sketches
+void RelationStatistics::updateDistinct() {
+    distinct_.clear();
+    for (auto &hll: sketches_) {
+        // Never more distinct values than rows
+        distinct_.push_back(std::max(1.0, std::min(hll.estimate(), static_cast<double>(rows_))));
+    }
+}
+
+// Add appended rows
+void RelationStatistics::append(const Relation &relation, uint64_t begin, uint64_t end) {
+    auto &columns = relation.columns();
+    for (uint64_t row = begin; row < end; ++row) {
+        // Reservoir sampling: row n replaces a sampled row with probability
+        // kSampleSize / (n + 1), which keeps the sample uniform
+        uint64_t slot = rows_;
+        if (rows_ >= kSampleSize) {
+            slot = std::uniform_int_distribution<uint64_t>(0, rows_)(gen_);
+        }
+        for (unsigned c = 0; c < columns.size(); ++c) {
+            auto value = columns[c][row];
+            sketches_[c].add(value);
+            if (rows_ < kSampleSize) {
+                sample_[c].push_back(value);
+            } else if (slot < kSampleSize) {
+                sample_[c][slot] = value;
+            }
+        }
+        ++rows_;
+    }
+    updateDistinct();
+}
+
+// Whether a sampled row passes the filters
+bool RelationStatistics::passes(uint64_t i, const std::vector<FilterInfo> &filters) const {
+    for (auto &f: filters) {
+        auto value = sample_[f.filter_column.col_id][i];
+        switch (f.comparison) {
+            case FilterInfo::Comparison::Equal:
+                if (value != f.constant) return false;
+                break;
+            case FilterInfo::Comparison::Greater:
+                if (value <= f.constant) return false;
+                break;
+            case FilterInfo::Comparison::Less:
+                if (value >= f.constant) return false;
+                break;
+        }
+    }
+    return true;
+}
+
+// Estimated fraction of the rows passing the filters
+double Statistics::filterSelectivity(RelationId rel_id, const std::vector<FilterInfo> &filters) const {
+    auto &stats = *relations_[rel_id];
+    uint64_t sample_size = stats.sampleSize();
+    if (sample_size == 0) {
+        return 0;
+    }
+    uint64_t passed = 0;
+    for (uint64_t i = 0; i < sample_size; ++i) {
+        passed += stats.passes(i, filters);
+    }
+    if (passed == 0 && sample_size < stats.rows()) {
+        // Rarer than one sampled row, assume half of one
+        return 0.5 / sample_size;
+    }
+    return static_cast<double>(passed) / sample_size;
+}
+
+// Estimated selectivity of joining two relations
+double Statistics::joinSelectivity(RelationId left, const std::vector<FilterInfo> &left_filters,
+                                   RelationId right, const std::vector<FilterInfo> &right_filters,
+                                   const std::vector<std::pair<unsigned, unsigned>> &columns) const {
+    auto &l_stats = *relations_[left], &r_stats = *relations_[right];
+    std::vector<uint64_t> l_rows, r_rows;
+    for (uint64_t i = 0; i < l_stats.sampleSize(); ++i) {
+        if (l_stats.passes(i, left_filters)) l_rows.push_back(i);
+    }
+    for (uint64_t j = 0; j < r_stats.sampleSize(); ++j) {
+        if (r_stats.passes(j, right_filters)) r_rows.push_back(j);
+    }
+    if (l_rows.empty() || r_rows.empty()) {
+        return -1;
+    }
+
+    // Hash join of the samples on the first column pair, the others are checked
+    std::unordered_map<uint64_t, std::vector<uint64_t>> table;
+    auto &l_keys = l_stats.sample(columns[0].first);
+    for (auto i: l_rows) {
+        table[l_keys[i]].push_back(i);
+    }
+    // Both samples of a relation are the same rows. A row paired with itself
+    // is far more likely in the sample than in the relation, those pairs are
+    // counted apart.
+    bool same = left == right;
+    uint64_t matches = 0, self_matches = 0, common_rows = 0;
+    auto &r_keys = r_stats.sample(columns[0].second);
+    for (auto j: r_rows) {
+        if (same && l_stats.passes(j, left_filters)) ++common_rows;
+        auto candidates = table.find(r_keys[j]);
+        if (candidates == table.end()) continue;
+        for (auto i: candidates->second) {
+            bool equal = true;
+            for (size_t k = 1; k < columns.size() && equal; ++k) {
+                equal = l_stats.sample(columns[k].first)[i] == r_stats.sample(columns[k].second)[j];
+            }
+            if (same && i == j) {
+                self_matches += equal;
+            } else {
+                matches += equal;
+            }
+        }
+    }
+
+    // Complete samples are exact however few matches they have
+    bool complete = l_stats.sampleSize() == l_stats.rows() && r_stats.sampleSize() == r_stats.rows();
+    if (matches < kMinSampleMatches && !complete) {
+        return -1;
+    }
+    double pairs = static_cast<double>(l_rows.size()) * r_rows.size();
+    if (!same) {
+        return matches / pairs;
+    }
+    // Scale the pairs of different rows and the pairs of a row with itself
+    // to the relation separately
+    double scale = static_cast<double>(l_stats.rows()) / l_stats.sampleSize();
+    double other_pairs = pairs - common_rows;
+    double count = other_pairs > 0 ? matches / other_pairs * (pairs * scale * scale - common_rows * scale) : 0;
+    count += self_matches * scale;
+    return count / (pairs * scale * scale);
+}
@@ -0,0 +1,52 @@
+#include "tasks.h"
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+namespace {
+
+// The chunks of a parallelFor, shared with helpers that may start after it returned
+struct ParallelState {
+    std::function<void(unsigned)> f;
+    unsigned num_chunks;
+    std::atomic<unsigned> next{0}, done{0};
+    std::mutex m;
+    std::condition_variable cv;
+
+    // Work on chunks until all are taken
+    void work() {
+        unsigned chunk;
+        while ((chunk = next.fetch_add(1)) < num_chunks) {
+            f(chunk);
+            if (done.fetch_add(1) + 1 == num_chunks) {
+                std::lock_guard<std::mutex> lk(m);
+                cv.notify_all();
+            }
+        }
+    }
+};
+
+}
+
+// Run chunks in parallel
+void parallelFor(TaskRunner *runner, unsigned parallelism, unsigned num_chunks,
+                 const std::function<void(unsigned)> &f) {
+    if (runner == nullptr || parallelism <= 1 || num_chunks <= 1) {
+        for (unsigned chunk = 0; chunk < num_chunks; ++chunk) {
+            f(chunk);
+        }
+        return;
+    }
+    auto state = std::make_shared<ParallelState>();
+    state->f = f;
+    state->num_chunks = num_chunks;
+    for (unsigned i = 1; i < std::min(parallelism, num_chunks); ++i) {
+        runner->submit([state]() { state->work(); });
+    }
+    state->work();
+    std::unique_lock<std::mutex> lk(state->m);
+    state->cv.wait(lk, [&]() { return state->done.load() == num_chunks; });
+}
@@ -1,6 +1,9 @@
 #include "utils.h"
 
+#include <algorithm>
+#include <cmath>
 #include <iostream>
+#include <random>
 
 // Create a dummy column
 static void createColumn(std::vector<uint64_t *> &columns,
@@ -21,6 +24,42 @@ Relation Utils::createRelation(uint64_t size, uint64_t num_columns) {
     return Relation(size, move(columns));
 }
 
+// Create a Zipf distributed column, rank r is drawn with probability ~ 1/r^skew
+static void createZipfColumn(std::vector<uint64_t *> &columns,
+                             uint64_t num_tuples,
+                             const std::vector<double> &cdf,
+                             std::mt19937_64 &gen) {
+    auto col = new uint64_t[num_tuples];
+    columns.push_back(col);
+    std::uniform_real_distribution<double> dist(0.0, 1.0);
+    for (uint64_t i = 0; i < num_tuples; ++i) {
+        auto rank = std::lower_bound(cdf.begin(), cdf.end(), dist(gen)) - cdf.begin();
+        col[i] = std::min<uint64_t>(rank, cdf.size() - 1);
+    }
+}
+
+// Create a relation with Zipf distributed values
+Relation Utils::createZipfRelation(uint64_t size, uint64_t num_columns,
+                                   uint64_t key_domain, double skew,
+                                   uint64_t seed) {
+    std::vector<double> cdf(std::max<uint64_t>(key_domain, 1));
+    double sum = 0;
+    for (uint64_t i = 0; i < cdf.size(); ++i) {
+        sum += 1.0 / std::pow(static_cast<double>(i + 1), skew);
+        cdf[i] = sum;
+    }
+    for (auto &c: cdf) {
+        c /= sum;
+    }
+
+    std::mt19937_64 gen(seed);
+    std::vector<uint64_t *> columns;
+    for (unsigned i = 0; i < num_columns; ++i) {
+        createZipfColumn(columns, size, cdf, gen);
+    }
+    return Relation(size, move(columns));
+}
+
 // Store a relation in all formats
 void Utils::storeRelation(std::ofstream &out, Relation &r, unsigned i) {
     auto base_name = "r" + std::to_string(i);
@@ -0,0 +1,57 @@
+#include "gtest/gtest.h"
+
+#include <unordered_map>
+
+#include "arena.h"
+
+TEST(Arena, BumpAllocation) {
+  Arena arena;
+  auto *a = static_cast<char *>(arena.allocate(10, 1));
+  auto *b = static_cast<char *>(arena.allocate(8, 8));
+  ASSERT_EQ(reinterpret_cast<uintptr_t>(b) % 8, 0u);
+  ASSERT_GE(b, a + 10);
+  ASSERT_EQ(arena.numBlocks(), 1u);
+
+  // The last allocation is given back
+  arena.deallocate(b, 8);
+  ASSERT_EQ(arena.allocate(8, 8), b);
+}
+
+TEST(Arena, LargeAllocationsUseHeap) {
+  Arena arena;
+  void *large = arena.allocate(Arena::kLargeAllocation + 1, 8);
+  ASSERT_EQ(arena.numBlocks(), 0u);
+  arena.deallocate(large, Arena::kLargeAllocation + 1);
+}
+
+TEST(Arena, Containers) {
+  Arena arena;
+  std::vector<uint64_t, ArenaAllocator<uint64_t>> values{ArenaAllocator<uint64_t>(&arena)};
+  for (uint64_t i = 0; i < 100000; ++i) {
+    values.push_back(i);
+  }
+  ASSERT_EQ(values[99999], 99999u);
+
+  using Map = std::unordered_multimap<uint64_t, uint64_t, std::hash<uint64_t>, std::equal_to<>,
+                                      ArenaAllocator<std::pair<const uint64_t, uint64_t>>>;
+  Map map{Map::allocator_type(&arena)};
+  for (uint64_t i = 0; i < 1000; ++i) {
+    map.emplace(i % 10, i);
+  }
+  ASSERT_EQ(map.count(3), 100u);
+  ASSERT_GE(arena.numBlocks(), 1u);
+
+  // Without an arena the allocator uses the heap
+  std::vector<uint64_t, ArenaAllocator<uint64_t>> heap(1000, 1);
+  ASSERT_EQ(heap.get_allocator().arena(), nullptr);
+}
+
+TEST(Arena, BlocksAreRecycled) {
+  char *first;
+  {
+    Arena arena;
+    first = static_cast<char *>(arena.allocate(16, 16));
+  }
+  Arena next;
+  ASSERT_EQ(next.allocate(16, 16), first);
+}
@@ -0,0 +1,125 @@
+#include "gtest/gtest.h"
+
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <thread>
+
+#include "batch.h"
+#include "joiner.h"
+#include "utils.h"
+
+TEST(Batch, FormatResults) {
+  QueryResult result;
+  result.resize(3);
+  result.data()[0] = 0;
+  result.data()[1] = 42;
+  result.data()[2] = UINT64_MAX;
+  std::string out;
+  result.format(out);
+  ASSERT_EQ(out, "0 42 18446744073709551615\n");
+
+  result.empty = true;
+  out.clear();
+  result.format(out);
+  ASSERT_EQ(out, "NULL NULL NULL\n");
+
+  // More selections than fit inline
+  QueryResult large;
+  large.resize(QueryResult::kInlineSums + 2);
+  for (uint32_t i = 0; i < large.count; ++i) large.data()[i] = i;
+  out.clear();
+  large.format(out);
+  ASSERT_EQ(out, "0 1 2 3 4 5 6 7\n");
+}
+
+TEST(Batch, PrintsInQueryOrder) {
+  Batch batch;
+  auto *first = batch.add(1);
+  auto *second = batch.add(2);
+  second->data()[0] = 1;
+  second->data()[1] = 2;
+  batch.complete();
+  first->empty = true;
+  batch.complete();
+  std::ostringstream out;
+  batch.print(out);
+  ASSERT_EQ(out.str(), "NULL\n1 2\n");
+}
+
+TEST(Batch, DestroyedRightAfterWait) {
+  // The last worker to complete must be done with the batch before wait()
+  // returns, the batch is destroyed right away
+  for (unsigned round = 0; round < 2000; ++round) {
+    auto *batch = new Batch();
+    batch->add(1);
+    batch->add(1);
+    std::thread first([batch]() { batch->complete(); });
+    std::thread second([batch]() { batch->complete(); });
+    batch->wait();
+    delete batch;
+    first.join();
+    second.join();
+  }
+}
+
+TEST(Batch, JoinerBatches) {
+  Joiner joiner;
+  for (unsigned i = 0; i < 3; i++) {
+    joiner.addRelation(Utils::createRelation(10 * (i + 1), 3));
+  }
+  joiner.setNumThreads(3);
+  for (unsigned batch = 0; batch < 2; ++batch) {
+    std::string expected;
+    for (unsigned q = 0; q < 20; ++q) {
+      QueryInfo query("0 1 2|0.0=1.1&1.2=2.0&0.1<" + std::to_string(q) + "|1.0 2.2");
+      QueryInfo copy = query;
+      expected += joiner.join(copy);
+      joiner.scheduleQuery(query);
+    }
+    std::ostringstream out;
+    joiner.printCheckSum(out);
+    ASSERT_EQ(out.str(), expected);
+  }
+}
+
+TEST(Batch, TracesEveryQuery) {
+  Joiner joiner;
+  for (unsigned i = 0; i < 3; i++) {
+    joiner.addRelation(Utils::createRelation(100 * (i + 1), 3));
+  }
+  std::mutex m;
+  std::vector<QueryTrace> traces;
+  joiner.setQueryObserver([&](const QueryTrace &trace) {
+    std::lock_guard<std::mutex> lk(m);
+    traces.push_back(trace);
+  });
+  joiner.setNumThreads(2);
+  std::string expected;
+  for (size_t q = 0; q < 10; ++q) {
+    // Every other query is the copy of the one before
+    std::string raw = "0 1 2|0.0=1.1&1.2=2.0&0.1<" + std::to_string(q / 2 * 10) + "|1.0 2.2";
+    QueryInfo copy(raw);
+    expected += joiner.join(copy);
+    QueryInfo query;
+    query.parseQuery(raw, q);
+    joiner.scheduleQuery(query);
+  }
+  std::ostringstream out;
+  joiner.printCheckSum(out);
+  ASSERT_EQ(out.str(), expected);
+
+  // A helping worker may still be reporting its part
+  std::lock_guard<std::mutex> lk(m);
+  std::set<size_t> ids;
+  for (auto &trace: traces) {
+    ASSERT_LE(trace.enqueued_ns, trace.started_ns);
+    ASSERT_LE(trace.started_ns, trace.finished_ns);
+    ASSERT_LT(trace.worker, 2u);
+    if (trace.query_id != QueryTrace::kPart) {
+      ASSERT_TRUE(ids.insert(trace.query_id).second) << trace.query_id;
+    }
+  }
+  ASSERT_EQ(ids.size(), 10u);
+  ASSERT_EQ(*ids.rbegin(), 9u);
+}
@@ -0,0 +1,153 @@
+#include "gtest/gtest.h"
+
+#include <functional>
+#include <unordered_map>
+
+#include "bitmap.h"
+#include "filter_kernels.h"
+#include "joiner.h"
+#include "operators.h"
+#include "utils.h"
+
+namespace {
+using RowFilter = std::function<bool(uint64_t)>;
+
+/// The result of "0 1|0.0=1.0|0.1 1.1" on the rows passing the filters, by brute force
+std::string naiveJoin(const Relation &left, const Relation &right, const RowFilter &left_pass,
+                      const RowFilter &right_pass) {
+  std::unordered_multimap<uint64_t, uint64_t> right_rows;
+  for (uint64_t row = 0; row < right.size(); ++row) {
+    if (right_pass(row)) right_rows.emplace(right.columns()[0][row], row);
+  }
+  uint64_t count = 0, left_sum = 0, right_sum = 0;
+  for (uint64_t row = 0; row < left.size(); ++row) {
+    if (!left_pass(row)) continue;
+    auto [begin, end] = right_rows.equal_range(left.columns()[0][row]);
+    for (auto match = begin; match != end; ++match) {
+      ++count;
+      left_sum += left.columns()[1][row];
+      right_sum += right.columns()[1][match->second];
+    }
+  }
+  if (count == 0) return "NULL NULL\n";
+  return std::to_string(left_sum) + " " + std::to_string(right_sum) + "\n";
+}
+}
+
+TEST(Bitmap, ForEachAndCount) {
+  Bitmap bitmap(300);
+  std::vector<uint64_t> rows{0, 1, 63, 64, 65, 127, 128, 200, 255, 256, 299};
+  for (auto row: rows) bitmap.set(row);
+  ASSERT_EQ(bitmap.count(0, 300), rows.size());
+  ASSERT_EQ(bitmap.count(64, 128), 3u);
+  for (uint64_t begin: {0, 1, 63, 64, 100, 256}) {
+    for (uint64_t end: {begin, begin + 1, uint64_t(64), uint64_t(128), uint64_t(256), uint64_t(299), uint64_t(300)}) {
+      if (end < begin) continue;
+      std::vector<uint64_t> visited, expected;
+      bitmap.forEach(begin, end, [&](uint64_t row) { visited.push_back(row); });
+      for (auto row: rows) {
+        if (row >= begin && row < end) expected.push_back(row);
+      }
+      ASSERT_EQ(visited, expected) << begin << " " << end;
+    }
+  }
+}
+
+TEST(Bitmap, FilterScanChoosesRepresentation) {
+  auto relation = Utils::createZipfRelation(100000, 2, 1000, 0, 7);
+  std::vector<const Relation *> relations{&relation};
+  auto run = [&](std::vector<FilterInfo> filters, bool dense) {
+    auto context = std::make_shared<Context>(relations, std::make_shared<QueryInfo>());
+    FilterScan scan(relation, filters, context);
+    scan.run();
+    std::vector<uint64_t> expected;
+    for (uint64_t row = 0; row < relation.size(); ++row) {
+      bool pass = true;
+      for (auto &f: filters) {
+        auto value = relation.columns()[f.filter_column.col_id][row];
+        pass &= f.comparison == FilterInfo::Comparison::Equal ? value == f.constant
+                : f.comparison == FilterInfo::Comparison::Greater ? value > f.constant : value < f.constant;
+      }
+      if (pass) expected.push_back(row);
+    }
+    ASSERT_EQ(scan.bitmap() != nullptr, dense);
+    ASSERT_EQ(scan.result_size(), expected.size());
+    auto &ids = (*scan.getResults())[0];
+    ASSERT_EQ(std::vector<uint64_t>(ids.begin(), ids.end()), expected);
+    ASSERT_EQ(scan.bitmap(), nullptr);
+  };
+  SelectInfo c0(0, 0, 0), c1(0, 0, 1);
+  run({FilterInfo(c0, 5, FilterInfo::Comparison::Less)}, false);
+  run({FilterInfo(c0, 5, FilterInfo::Comparison::Greater)}, true);
+  run({FilterInfo(c0, 100, FilterInfo::Comparison::Greater), FilterInfo(c1, 900, FilterInfo::Comparison::Less)},
+      true);
+  // Dense filters that are sparse together
+  run({FilterInfo(c0, 500, FilterInfo::Comparison::Less), FilterInfo(c1, 500, FilterInfo::Comparison::Greater),
+       FilterInfo(c1, 505, FilterInfo::Comparison::Less)}, false);
+  // More filters than the selection kernels take
+  std::vector<FilterInfo> many(FilterKernels::kMaxFilters + 1, FilterInfo(c0, 999, FilterInfo::Comparison::Less));
+  run(many, true);
+}
+
+TEST(Bitmap, ChecksumOfBitmap) {
+  auto relation = Utils::createZipfRelation(Checksum::kMinParallelChecksum * 2, 2, 1000, 0, 8);
+  std::vector<const Relation *> relations{&relation};
+  auto context = std::make_shared<Context>(relations, std::make_shared<QueryInfo>());
+  auto scan = std::make_unique<FilterScan>(relation, std::vector<FilterInfo>{
+      FilterInfo(SelectInfo(0, 0, 1), 10, FilterInfo::Comparison::Greater)}, context);
+  scan->run();
+  ASSERT_NE(scan->bitmap(), nullptr);
+  Checksum checksum(std::make_unique<Materialized>(std::move(scan), context),
+                    {SelectInfo(0, 0, 0), SelectInfo(0, 0, 1)}, context);
+  checksum.run();
+  std::vector<uint64_t> expected(2, 0);
+  uint64_t count = 0;
+  for (uint64_t row = 0; row < relation.size(); ++row) {
+    if (relation.columns()[1][row] <= 10) continue;
+    ++count;
+    expected[0] += relation.columns()[0][row];
+    expected[1] += relation.columns()[1][row];
+  }
+  ASSERT_EQ(checksum.result_size(), count);
+  ASSERT_EQ(checksum.check_sums(), expected);
+}
+
+TEST(Bitmap, JoinsOnBitmaps) {
+  // Large enough for the probe and the checksum to be split over threads
+  auto left = Utils::createZipfRelation(100000, 2, 100000, 0, 9);
+  auto right = Utils::createZipfRelation(100000, 2, 1000, 0, 10);
+  auto make_joiner = [&]() {
+    auto joiner = std::make_unique<Joiner>();
+    joiner->addRelation(Utils::createZipfRelation(100000, 2, 100000, 0, 9));
+    joiner->addRelation(Utils::createZipfRelation(100000, 2, 1000, 0, 10));
+    return joiner;
+  };
+  auto value = [](const Relation &relation, uint64_t row) { return relation.columns()[1][row]; };
+  std::vector<std::pair<std::string, std::string>> queries{
+      // Both sides dense
+      {"0 1|0.0=1.0&0.1>10&1.1>10|0.1 1.1",
+       naiveJoin(left, right, [&](uint64_t r) { return value(left, r) > 10; },
+                 [&](uint64_t r) { return value(right, r) > 10; })},
+      // A sparse and a dense side
+      {"0 1|0.0=1.0&0.1<500&1.1>10|0.1 1.1",
+       naiveJoin(left, right, [&](uint64_t r) { return value(left, r) < 500; },
+                 [&](uint64_t r) { return value(right, r) > 10; })},
+      // A dense side and a plain scan
+      {"0 1|0.0=1.0&1.1<990|0.1 1.1",
+       naiveJoin(left, right, [](uint64_t) { return true; }, [&](uint64_t r) { return value(right, r) < 990; })},
+  };
+  for (unsigned threads: {1, 3}) {
+    auto joiner = make_joiner();
+    joiner->setNumThreads(threads);
+    std::string expected;
+    for (auto &[raw, result]: queries) {
+      QueryInfo query(raw);
+      ASSERT_EQ(joiner->join(query), result) << raw;
+      joiner->scheduleQuery(QueryInfo(raw));
+      expected += result;
+    }
+    std::ostringstream out;
+    joiner->printCheckSum(out);
+    ASSERT_EQ(out.str(), expected);
+  }
+}
@@ -0,0 +1,68 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <thread>
+
+#include "build_cache.h"
+#include "joiner.h"
+#include "utils.h"
+
+TEST(BuildCache, BuildsOnce) {
+  BuildCache cache;
+  std::atomic<unsigned> builds{0};
+  auto build = [&]() {
+    ++builds;
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    auto table = std::make_shared<JoinTable>();
+    table->hash_table.build({{1, 2}});
+    return table;
+  };
+  std::vector<std::thread> threads;
+  std::vector<std::shared_ptr<const JoinTable>> tables(4);
+  for (unsigned i = 0; i < tables.size(); ++i) {
+    threads.emplace_back([&, i]() { tables[i] = cache.get("0&1<5|0", 64, build); });
+  }
+  for (auto &t: threads) t.join();
+  ASSERT_EQ(builds.load(), 1u);
+  for (auto &table: tables) ASSERT_EQ(table, tables[0]);
+  ASSERT_EQ(cache.size(), 1u);
+
+  cache.clear();
+  ASSERT_EQ(cache.size(), 0u);
+  // Tables in use stay valid
+  ASSERT_EQ(tables[0]->hash_table.size(), 1u);
+}
+
+TEST(BuildCache, EvictsUnderMemoryPressure) {
+  BuildCache cache(nullptr, 100);
+  auto build = []() { return std::make_shared<JoinTable>(); };
+  ASSERT_NE(cache.get("a", 60, build), nullptr);
+  // Does not fit next to a, which is dropped
+  ASSERT_NE(cache.get("b", 60, build), nullptr);
+  ASSERT_EQ(cache.size(), 1u);
+  // Never fits
+  ASSERT_EQ(cache.get("c", 200, build), nullptr);
+}
+
+TEST(BuildCache, SharedBuildSides) {
+  Joiner joiner;
+  joiner.addRelation(Utils::createRelation(10, 3));
+  joiner.addRelation(Utils::createZipfRelation(1000, 3, 10, 0.8, 1));
+  joiner.setNumThreads(2);
+  // The same build side with different probe sides, and a build side that is
+  // no plain scan because of its self join
+  std::vector<std::string> queries{"0 1|0.0=1.0|1.1", "0 1|0.0=1.0&1.1<3|1.1 0.2",
+                                   "0 1|0.0=1.1|1.0", "0 1|0.0=1.0&0.1=0.2|1.2"};
+  std::string expected;
+  for (auto &raw: queries) {
+    QueryInfo query(raw);
+    Joiner fresh;
+    fresh.addRelation(Utils::createRelation(10, 3));
+    fresh.addRelation(Utils::createZipfRelation(1000, 3, 10, 0.8, 1));
+    expected += fresh.join(query);
+    joiner.scheduleQuery(QueryInfo(raw));
+  }
+  std::ostringstream out;
+  joiner.printCheckSum(out);
+  ASSERT_EQ(out.str(), expected);
+}
@@ -0,0 +1,74 @@
+#include "gtest/gtest.h"
+
+#include <cstring>
+#include <fstream>
+
+#include "bulk_loader.h"
+#include "utils.h"
+
+namespace {
+/// Store relations of awkward sizes, columns start at unaligned offsets
+std::vector<std::string> storeRelations(std::vector<Relation> &relations) {
+  relations.push_back(Utils::createZipfRelation(100000, 3, 1 << 20, 0.5, 1));
+  relations.push_back(Utils::createRelation(0, 2));
+  relations.push_back(Utils::createZipfRelation(1, 1, 100, 0, 2));
+  relations.push_back(Utils::createZipfRelation(4097, 5, 1 << 20, 0, 3));
+  std::vector<std::string> files;
+  for (unsigned i = 0; i < relations.size(); ++i) {
+    files.push_back("bulk_loader_r" + std::to_string(i));
+    relations[i].storeRelation(files.back());
+  }
+  return files;
+}
+
+void expectEqual(const std::vector<Relation> &expected, const std::vector<Relation> &actual) {
+  ASSERT_EQ(expected.size(), actual.size());
+  for (unsigned i = 0; i < expected.size(); ++i) {
+    ASSERT_EQ(expected[i].size(), actual[i].size());
+    ASSERT_EQ(expected[i].columns().size(), actual[i].columns().size());
+    ASSERT_TRUE(actual[i].appendable());
+    for (unsigned c = 0; c < expected[i].columns().size(); ++c) {
+      ASSERT_EQ(memcmp(expected[i].columns()[c], actual[i].columns()[c], expected[i].size() * sizeof(uint64_t)), 0)
+          << "relation " << i << " column " << c;
+    }
+  }
+}
+}
+
+TEST(BulkLoader, LoadsLikeTheStreamLoader) {
+  std::vector<Relation> relations;
+  auto files = storeRelations(relations);
+  for (auto backend: {LoadBackend::Auto, LoadBackend::IoUring, LoadBackend::Threads}) {
+    for (bool direct: {true, false}) {
+      // Small chunks so reads span columns and relations share the queue
+      BulkLoader::Options options;
+      options.backend = backend;
+      options.direct = direct;
+      options.queue_depth = 3;
+      options.chunk_bytes = 3 * BulkLoader::kAlignment;
+      BulkLoader loader(options);
+      expectEqual(relations, loader.load(files));
+
+      auto &report = loader.report();
+      ASSERT_EQ(report.files, files.size());
+      ASSERT_EQ(report.bytes, (100000 * 3 + 1 + 4097 * 5) * sizeof(uint64_t) + 3 * 2 * sizeof(uint64_t));
+      if (backend == LoadBackend::Threads) {
+        ASSERT_EQ(report.backend, LoadBackend::Threads);
+      }
+      if (!direct) {
+        ASSERT_EQ(report.direct_files, 0);
+      }
+    }
+  }
+}
+
+TEST(BulkLoader, RejectsBadFiles) {
+  BulkLoader loader;
+  ASSERT_THROW(loader.load({"bulk_loader_missing"}), std::runtime_error);
+  // A header promising more rows than the file holds
+  std::ofstream out("bulk_loader_truncated", std::ios::binary);
+  uint64_t header[3] = {1000, 2, 7};
+  out.write(reinterpret_cast<char *>(header), sizeof(header));
+  out.close();
+  ASSERT_THROW(loader.load({"bulk_loader_truncated"}), std::runtime_error);
+}
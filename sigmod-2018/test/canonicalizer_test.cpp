@@ -0,0 +1,84 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <sstream>
+
+#include "canonicalizer.h"
+#include "joiner.h"
+#include "utils.h"
+
+namespace {
+/// A joiner on three small relations
+std::unique_ptr<Joiner> makeJoiner() {
+  auto joiner = std::make_unique<Joiner>();
+  joiner->addRelation(Utils::createZipfRelation(2000, 3, 200, 0, 41));
+  joiner->addRelation(Utils::createZipfRelation(1500, 2, 200, 0, 42));
+  joiner->addRelation(Utils::createZipfRelation(1000, 2, 200, 0, 43));
+  return joiner;
+}
+}
+
+TEST(Canonicalizer, PermutedQueriesAreEqual) {
+  // The same query with the bindings rotated, the predicates reversed and
+  // the selections swapped
+  auto a = Canonicalizer::canonicalize(QueryInfo("0 1 2|0.0=1.0&1.1=2.0&0.1>5|0.2 2.1"));
+  auto b = Canonicalizer::canonicalize(QueryInfo("2 0 1|2.0=1.0&0.0=2.1&1.1>5|0.1 1.2"));
+  ASSERT_EQ(a.key, b.key);
+  ASSERT_EQ(a.selections.size(), 2u);
+  ASSERT_EQ(a.selections[0], b.selections[1]);
+  ASSERT_EQ(a.selections[1], b.selections[0]);
+  ASSERT_EQ(a.query.selections().size(), 2u);
+
+  // Repeated predicates, filters and selections
+  auto c = Canonicalizer::canonicalize(QueryInfo("0 1 2|1.0=0.0&0.0=1.0&1.1=2.0&0.1>5&0.1>5|0.2 2.1 0.2"));
+  ASSERT_EQ(a.key, c.key);
+  ASSERT_EQ(c.selections, (std::vector<unsigned>{a.selections[0], a.selections[1], a.selections[0]}));
+}
+
+TEST(Canonicalizer, DifferentQueriesDiffer) {
+  auto key = [](const std::string &raw) { return Canonicalizer::canonicalize(QueryInfo(raw)).key; };
+  ASSERT_NE(key("0 1|0.0=1.0&0.1>5|0.0"), key("0 1|0.0=1.0&0.1>6|0.0"));
+  ASSERT_NE(key("0 1|0.0=1.0&0.1>5|0.0"), key("0 1|0.0=1.0&1.1>5|0.0"));
+  ASSERT_NE(key("0 1|0.0=1.0|0.0"), key("0 1|0.0=1.1|0.0"));
+  ASSERT_NE(key("0 0|0.0=1.0&0.1<5|0.0"), key("0 0|0.0=1.1&0.1<5|0.0"));
+}
+
+TEST(Canonicalizer, BatchRunsCopiesOnce) {
+  std::vector<std::string> queries{
+      "0 1 2|0.0=1.0&1.1=2.0&0.1>5|0.2 2.1",
+      "1 2|0.1=1.0&1.1<100|1.1 0.0",
+      "2 0 1|2.0=1.0&0.0=2.1&1.1>5|0.1 1.2",
+      "0 1 2|0.0=1.0&1.1=2.0&0.1>5|2.1 0.2 2.1",
+      // Equal up to the order of the self join bindings
+      "0 0 1|0.0=1.1&1.0=2.0|0.1 1.1",
+      "0 0 1|1.0=0.1&0.0=2.0|1.1 0.1",
+      // Empty
+      "0 1|0.0=1.0&0.1>1000|0.1",
+      "1 0|1.0=0.0&1.1>1000|1.1",
+  };
+  auto single = makeJoiner();
+  std::string expected;
+  for (auto &raw: queries) {
+    QueryInfo query(raw);
+    expected += single->join(query);
+  }
+  for (bool deduplicate: {false, true}) {
+    auto joiner = makeJoiner();
+    joiner->setNumThreads(2);
+    joiner->useDeduplication(deduplicate);
+    std::atomic<unsigned> scans{0};
+    joiner->setEstimateObserver([&](bool join, double, uint64_t) {
+      if (!join) ++scans;
+    });
+    for (auto &raw: queries) joiner->scheduleQuery(QueryInfo(raw));
+    std::ostringstream out;
+    joiner->printCheckSum(out);
+    ASSERT_EQ(out.str(), expected) << deduplicate;
+    if (deduplicate) {
+      // Four distinct queries, the empty ones stop before any scan
+      ASSERT_EQ(scans.load(), 3u + 2u + 3u);
+    } else {
+      ASSERT_EQ(scans.load(), 3u * 3 + 2u + 3u * 2);
+    }
+  }
+}
@@ -0,0 +1,68 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <random>
+
+#include "column_sums.h"
+#include "joiner.h"
+#include "utils.h"
+
+namespace {
+/// The sums of the columns over the ids, one row at a time
+std::vector<uint64_t> naiveSums(const std::vector<TupleId> &ids, const std::vector<const uint64_t *> &columns) {
+  std::vector<uint64_t> sums(columns.size(), 0);
+  for (auto id: ids) {
+    for (unsigned c = 0; c < columns.size(); ++c) sums[c] += columns[c][id];
+  }
+  return sums;
+}
+}
+
+TEST(ColumnSums, KernelsMatchNaiveSums) {
+  auto relation = Utils::createZipfRelation(50000, 3, 1 << 20, 0, 3);
+  std::vector<const uint64_t *> columns(relation.columns().begin(), relation.columns().end());
+  // Random ids with duplicates, not a multiple of the block or vector size
+  std::vector<TupleId> ids;
+  std::mt19937_64 rng(1);
+  for (unsigned i = 0; i < 2 * ColumnSums::kBlockSize + 7; ++i) ids.push_back(rng() % relation.size());
+
+  // Sorted, the AVX2 kernel gathers them
+  auto sorted = ids;
+  std::sort(sorted.begin(), sorted.end());
+
+  std::vector<ColumnSums::Kernel> kernels{ColumnSums::sumScalar, ColumnSums::best()};
+  if (ColumnSums::hasAvx2()) kernels.push_back(ColumnSums::sumAvx2);
+  for (auto kernel: kernels) {
+    for (auto *input: {&ids, &sorted}) {
+      for (uint64_t count: {uint64_t(0), uint64_t(3), uint64_t(17), uint64_t(input->size())}) {
+        std::vector<TupleId> prefix(input->begin(), input->begin() + count);
+        std::vector<uint64_t> sums(columns.size(), 0);
+        kernel(prefix.data(), prefix.size(), columns.data(), columns.size(), sums.data());
+        ASSERT_EQ(sums, naiveSums(prefix, columns));
+      }
+    }
+  }
+}
+
+TEST(ColumnSums, ParallelChecksum) {
+  // Large enough for the checksum to be split into ranges
+  auto make_joiner = []() {
+    auto joiner = std::make_unique<Joiner>();
+    joiner->addRelation(Utils::createZipfRelation(Checksum::kMinParallelChecksum * 4, 3, 100, 0.5, 1));
+    joiner->addRelation(Utils::createRelation(100, 2));
+    return joiner;
+  };
+  std::string raw = "0 1|0.0=1.0|0.1 1.1 0.2 0.1";
+  QueryInfo query(raw);
+  auto expected = make_joiner()->join(query);
+
+  auto joiner = make_joiner();
+  joiner->setNumThreads(3);
+  joiner->scheduleQuery(QueryInfo(raw));
+  // A second, cheap query so the first one gets all threads
+  joiner->scheduleQuery(QueryInfo("1 1|0.0=1.1|0.0"));
+  std::ostringstream out;
+  joiner->printCheckSum(out);
+  QueryInfo second("1 1|0.0=1.1|0.0");
+  ASSERT_EQ(out.str(), expected + make_joiner()->join(second));
+}
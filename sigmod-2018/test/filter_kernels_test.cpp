@@ -0,0 +1,101 @@
+#include "gtest/gtest.h"
+
+#include "bitmap.h"
+#include "filter_kernels.h"
+#include "utils.h"
+
+namespace {
+/// Whether a value passes a filter
+bool passes(uint64_t value, const FilterInfo &f) {
+  switch (f.comparison) {
+    case FilterInfo::Comparison::Equal: return value == f.constant;
+    case FilterInfo::Comparison::Greater: return value > f.constant;
+    case FilterInfo::Comparison::Less: return value < f.constant;
+  }
+  return false;
+}
+}
+
+TEST(FilterKernels, AllComparisonCombinations) {
+  auto relation = Utils::createZipfRelation(1000, 4, 8, 0, 5);
+  // Every sequence of up to kMaxFilters comparisons, on the columns in turn
+  std::vector<std::vector<FilterInfo>> all{{}};
+  for (unsigned n = 1; n <= FilterKernels::kMaxFilters; ++n) {
+    std::vector<std::vector<FilterInfo>> longer;
+    for (auto &filters: all) {
+      if (filters.size() != n - 1) continue;
+      for (auto comparison: comparisonTypes) {
+        auto extended = filters;
+        extended.emplace_back(SelectInfo(0, 0, n - 1), 3 + n % 2, comparison);
+        longer.push_back(extended);
+      }
+    }
+    all.insert(all.end(), longer.begin(), longer.end());
+  }
+  ASSERT_EQ(all.size(), 1u + 3 + 9 + 27 + 81);
+
+  for (auto &filters: all) {
+    auto kernel = FilterKernels::select(filters);
+    if (filters.empty()) {
+      ASSERT_EQ(kernel, nullptr);
+      continue;
+    }
+    ASSERT_NE(kernel, nullptr);
+    std::vector<const uint64_t *> columns;
+    std::vector<uint64_t> constants;
+    for (auto &f: filters) {
+      columns.push_back(relation.columns()[f.filter_column.col_id]);
+      constants.push_back(f.constant);
+    }
+    // A range not starting at 0
+    std::vector<TupleId> out(1000);
+    out.resize(kernel(columns.data(), constants.data(), 100, 1000, out.data()));
+    std::vector<TupleId> expected;
+    for (uint64_t i = 100; i < 1000; ++i) {
+      bool pass = true;
+      for (auto &f: filters) pass = pass && passes(relation.columns()[f.filter_column.col_id][i], f);
+      if (pass) expected.push_back(i);
+    }
+    ASSERT_EQ(out, expected);
+  }
+
+  std::vector<FilterInfo> too_many(FilterKernels::kMaxFilters + 1,
+                                   FilterInfo(SelectInfo(0, 0, 0), 1, FilterInfo::Comparison::Less));
+  ASSERT_EQ(FilterKernels::select(too_many), nullptr);
+}
+
+TEST(FilterKernels, BitmapKernels) {
+  auto relation = Utils::createZipfRelation(1000, 2, 8, 0, 6);
+  auto value = [&](unsigned col_id, uint64_t row) { return relation.columns()[col_id][row]; };
+  for (bool scalar: {false, true}) {
+    for (auto first: comparisonTypes) {
+      for (auto second: comparisonTypes) {
+        FilterInfo f1(SelectInfo(0, 0, 0), 3, first), f2(SelectInfo(0, 0, 1), 5, second);
+        // Set bits that have to be overwritten, a range not starting at 0
+        // and not ending on a word
+        Bitmap bitmap(1000);
+        for (uint64_t row = 0; row < 1000; row += 3) bitmap.set(row);
+        FilterKernels::selectBitmap(first, false, scalar)(relation.columns()[0], 3, 128, 999, bitmap.words());
+        FilterKernels::selectBitmap(second, true, scalar)(relation.columns()[1], 5, 128, 999, bitmap.words());
+        for (uint64_t row = 0; row < 1000; ++row) {
+          bool expected = row < 128 ? row % 3 == 0 : row < 999 && passes(value(0, row), f1) && passes(value(1, row), f2);
+          ASSERT_EQ(bitmap.test(row), expected) << row;
+        }
+      }
+    }
+  }
+  // Unsigned comparisons of values with the top bit set, a full word for the AVX2 kernel
+  std::vector<uint64_t> column;
+  for (unsigned i = 0; i < Bitmap::kWordBits / 8; ++i) {
+    column.insert(column.end(), {0, 1, uint64_t(1) << 63, ~uint64_t(0), 5, 6, 7, 8});
+  }
+  for (bool scalar: {false, true}) {
+    Bitmap greater(column.size()), less(column.size());
+    FilterKernels::selectBitmap(FilterInfo::Comparison::Greater, false, scalar)(column.data(), 6, 0, column.size(),
+                                                                                greater.words());
+    FilterKernels::selectBitmap(FilterInfo::Comparison::Less, false, scalar)(column.data(), 6, 0, column.size(),
+                                                                             less.words());
+    ASSERT_EQ(greater.words()[0], 0xccccccccccccccccull);
+    ASSERT_EQ(less.words()[0], 0x1313131313131313ull);
+  }
+}
@@ -0,0 +1,57 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <map>
+
+#include "join_hash_table.h"
+
+TEST(JoinHashTable, ProbeFindsAllDuplicates) {
+  std::vector<JoinHashTable::Entry> entries;
+  for (uint64_t row = 0; row < 1000; ++row) {
+    entries.push_back({row % 100, row});
+  }
+  JoinHashTable table;
+  table.build(entries);
+  ASSERT_EQ(table.size(), 1000u);
+  ASSERT_GE(table.numBuckets(), 1000u);
+
+  std::vector<uint64_t> rows;
+  table.probe(42, [&](uint64_t row) { rows.push_back(row); });
+  std::sort(rows.begin(), rows.end());
+  ASSERT_EQ(rows.size(), 10u);
+  for (uint64_t i = 0; i < rows.size(); ++i) {
+    ASSERT_EQ(rows[i], 42 + 100 * i);
+  }
+  unsigned misses = 0;
+  table.probe(100, [&](uint64_t) { ++misses; });
+  ASSERT_EQ(misses, 0u);
+}
+
+TEST(JoinHashTable, BatchedProbeMatchesSingle) {
+  std::vector<JoinHashTable::Entry> entries;
+  for (uint64_t row = 0; row < 5000; ++row) {
+    entries.push_back({(row * 7919) % 3000, row});
+  }
+  JoinHashTable table;
+  table.build(entries);
+
+  // More keys than one batch, and a count that is no multiple of it
+  std::vector<uint64_t> keys;
+  for (uint64_t key = 0; key < 4001; key += 3) keys.push_back(key);
+  std::multimap<uint64_t, uint64_t> single, batched;
+  for (uint64_t i = 0; i < keys.size(); ++i) {
+    table.probe(keys[i], [&](uint64_t row) { single.emplace(i, row); });
+  }
+  table.probeBatch(keys.data(), keys.size(), [&](size_t i, uint64_t row) { batched.emplace(i, row); });
+  ASSERT_FALSE(single.empty());
+  ASSERT_EQ(single, batched);
+}
+
+TEST(JoinHashTable, EmptyTable) {
+  JoinHashTable table;
+  table.build({});
+  uint64_t key = 1;
+  unsigned matches = 0;
+  table.probeBatch(&key, 1, [&](size_t, uint64_t) { ++matches; });
+  ASSERT_EQ(matches, 0u);
+}
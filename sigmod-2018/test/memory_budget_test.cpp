@@ -0,0 +1,83 @@
+#include "gtest/gtest.h"
+
+#include "joiner.h"
+#include "memory_budget.h"
+#include "utils.h"
+
+TEST(MemoryBudget, ReservesWithinParent) {
+  MemoryBudget total(100);
+  {
+    MemoryBudget query(80, &total);
+    ASSERT_TRUE(query.tryReserve(50));
+    ASSERT_FALSE(query.tryReserve(40));
+    ASSERT_EQ(query.used(), 50u);
+    ASSERT_EQ(total.used(), 50u);
+
+    MemoryBudget other(80, &total);
+    ASSERT_EQ(other.available(), 50u);
+    ASSERT_FALSE(other.tryReserve(60));
+    ASSERT_EQ(other.used(), 0u);
+    // Charges go above the limit
+    other.charge(70);
+    ASSERT_EQ(total.used(), 120u);
+    ASSERT_EQ(query.available(), 0u);
+  }
+  // Finished queries give their memory back
+  ASSERT_EQ(total.used(), 0u);
+}
+
+TEST(MemoryBudget, SpillFileRoundTrip) {
+  SpillFile file;
+  uint64_t count = SpillFile::kBlockRecords * 3 + 7;
+  for (uint64_t i = 0; i < count; ++i) {
+    file.append(i, i * 2);
+  }
+  ASSERT_EQ(file.size(), count);
+  uint64_t expected = 0;
+  file.read([&](uint64_t key, uint64_t value) {
+    ASSERT_EQ(key, expected);
+    ASSERT_EQ(value, expected * 2);
+    ++expected;
+  });
+  ASSERT_EQ(expected, count);
+
+  // Appends after a read go to the end of the file
+  for (uint64_t i = count; i < 2 * count; ++i) {
+    file.append(i, i * 2);
+  }
+  expected = 0;
+  file.read([&](uint64_t key, uint64_t value) {
+    ASSERT_EQ(key, expected);
+    ASSERT_EQ(value, expected * 2);
+    ++expected;
+  });
+  ASSERT_EQ(expected, 2 * count);
+}
+
+TEST(MemoryBudget, SpilledJoinMatchesInMemory) {
+  std::vector<std::string> results;
+  for (uint64_t limit: {MemoryBudget::kUnlimited, uint64_t(1)}) {
+    Joiner joiner;
+    joiner.setMemoryLimits(limit, MemoryBudget::kUnlimited);
+    joiner.addRelation(Utils::createZipfRelation(20000, 2, 500, 0.5, 1));
+    joiner.addRelation(Utils::createZipfRelation(30000, 2, 500, 0.5, 2));
+    joiner.addRelation(Utils::createRelation(1000, 2));
+    QueryInfo query("0 1 2|0.0=1.0&0.1=1.1&1.1=2.0|0.1 2.1 1.0");
+    results.push_back(joiner.join(query));
+  }
+  ASSERT_EQ(results[0], results[1]);
+  ASSERT_NE(results[0], "NULL NULL NULL\n");
+}
+
+TEST(MemoryBudget, JoinSpillsOverBudget) {
+  Relation left = Utils::createRelation(5000, 1);
+  Relation right = Utils::createRelation(8000, 1);
+  std::vector<const Relation *> relations{&left, &right};
+  auto context = std::make_shared<Context>(relations, std::make_shared<QueryInfo>());
+  context->memory_.reset(1000, nullptr);
+  Join join(std::make_unique<Scan>(left, 0, context), std::make_unique<Scan>(right, 1, context),
+            PredicateInfo(SelectInfo(0, 0), SelectInfo(1, 0)), context);
+  join.run();
+  ASSERT_TRUE(join.spilled());
+  ASSERT_EQ(join.result_size(), 5000u);
+}
@@ -0,0 +1,67 @@
+#include "gtest/gtest.h"
+
+#include "joiner.h"
+#include "numa.h"
+#include "utils.h"
+
+TEST(Numa, SimulatedTopology) {
+  auto topology = NumaTopology::simulate(2, 4);
+  ASSERT_TRUE(topology.simulated());
+  ASSERT_EQ(topology.numNodes(), 2u);
+  ASSERT_EQ(topology.cpus(0), (std::vector<unsigned>{0, 2}));
+  ASSERT_EQ(topology.cpus(1), (std::vector<unsigned>{1, 3}));
+
+  // More nodes than cpus: the cpus are shared
+  auto shared = NumaTopology::simulate(4, 1);
+  ASSERT_EQ(shared.numNodes(), 4u);
+  for (unsigned node = 0; node < 4; ++node) {
+    ASSERT_EQ(shared.cpus(node), std::vector<unsigned>{0});
+  }
+}
+
+TEST(Numa, DetectedTopologyHasCpus) {
+  auto topology = NumaTopology::detect();
+  ASSERT_GE(topology.numNodes(), 1u);
+  for (unsigned node = 0; node < topology.numNodes(); ++node) {
+    ASSERT_FALSE(topology.cpus(node).empty());
+  }
+}
+
+TEST(Numa, PreferredQueue) {
+  MultiChannel<int> channel(3);
+  channel.Put(1, 0);
+  channel.Put(2, 1);
+  channel.Put(3, 2);
+  ASSERT_EQ(channel.Get(1), 2);
+  // Queue 1 is empty, fall back to the next one
+  ASSERT_EQ(channel.Get(1), 3);
+  ASSERT_EQ(channel.Get(1), 1);
+}
+
+TEST(Numa, PlaceRelation) {
+  auto topology = NumaTopology::simulate(2, 2);
+  Relation r = Utils::createRelation(1000, 3);
+  r.place(1, topology);
+  ASSERT_EQ(r.home_node(), 1);
+  for (unsigned c = 0; c < 3; ++c) {
+    for (uint64_t i = 0; i < r.size(); ++i) {
+      ASSERT_EQ(r.columns()[c][i], i);
+    }
+  }
+}
+
+TEST(Numa, JoinerBalancesRelationsOverNodes) {
+  Joiner joiner;
+  joiner.enableNuma(NumaPolicy::PerNode, NumaTopology::simulate(2, 2));
+  for (unsigned i = 0; i < 4; i++) {
+    joiner.addRelation(Utils::createRelation(10, 3));
+  }
+  ASSERT_EQ(joiner.relations()[0].home_node(), 0);
+  ASSERT_EQ(joiner.relations()[1].home_node(), 1);
+  ASSERT_EQ(joiner.relations()[2].home_node(), 0);
+  ASSERT_EQ(joiner.relations()[3].home_node(), 1);
+
+  QueryInfo i("1 2|0.0=1.1|1.2");
+  ASSERT_EQ(joiner.homeNode(i), 1);
+  ASSERT_EQ(joiner.join(i), "45\n");
+}
@@ -173,3 +173,17 @@ TEST(Parser, DumpText) {
 
   ASSERT_EQ(i.dumpText(), raw_query);
 }
+
+TEST(Parser, CheckSyntax) {
+  QueryInfo::checkSyntax("0 2|0.1=1.1&0.0=1.0&1.2=3|0.1 1.4");
+  QueryInfo::checkSyntax("3 0 1|0.2=1.0&0.1=2.0&0.2>3499|1.2 0.1");
+  QueryInfo::checkSyntax("0|0.0=0.0|0.1");
+  QueryInfo::checkSyntax("0|0.0=0.1&0.1>5|0.0");
+  for (std::string bad: {"0 1|0.0=1.0", "0 1|0.0=1.0|0.0|", "|0.0=1.0|0.0", "0 x|0.0=1.0|0.0", "0 1|0.0=2.0|0.0",
+                         "0 1|0.0<1.0|0.0", "0 1|0.0=1.0=1.1|0.0", "0 1|0=1.0|0.0", "0 1|0.0=1.0|", "0 1|0.0>-1|0.0",
+                         "0 1|0.0>99999999999999999999|0.0", "0  1|0.0=1.0|0.0",
+                         // Without join predicates, and a binding that is not joined
+                         "0|0.1=5|0.0", "0 1|0.1=5&1.0=3|0.0", "0 1 2|0.0=1.0|0.0", "0 1|0.0=0.1&1.0=1.1|0.0"}) {
+    ASSERT_THROW(QueryInfo::checkSyntax(bad), std::invalid_argument) << bad;
+  }
+}
@@ -0,0 +1,117 @@
+#include "gtest/gtest.h"
+
+#include "joiner.h"
+#include "planner.h"
+#include "utils.h"
+
+namespace {
+
+class PlannerTest : public testing::Test {
+ protected:
+  Relation small = Utils::createRelation(10, 3);
+  Relation medium = Utils::createRelation(100, 3);
+  Relation large = Utils::createRelation(1000, 3);
+  std::vector<const Relation *> relations{&large, &medium, &small};
+};
+
+TEST_F(PlannerTest, StartsWithSmallestJoin) {
+  QueryInfo query("0 1 2|0.0=1.0&1.1=2.1|0.0");
+  Planner planner(query, relations);
+  auto plan = planner.plan({1000, 100, 10});
+  ASSERT_EQ(plan.size(), 3u);
+  // 1 join 2 is estimated at 100 * 10 / 100 = 10 tuples
+  ASSERT_EQ(plan[0].binding, 2u);
+  ASSERT_EQ(plan[1].binding, 1u);
+  ASSERT_DOUBLE_EQ(plan[1].estimate, 10);
+  ASSERT_EQ(plan[2].binding, 0u);
+}
+
+TEST_F(PlannerTest, ContinuesFromObservedSize) {
+  QueryInfo query("0 1 2|0.0=1.0&1.1=2.1|0.0");
+  Planner planner(query, relations);
+  auto rest = planner.plan({1, 2}, 50, {1000, 100, 10});
+  ASSERT_EQ(rest.size(), 1u);
+  ASSERT_EQ(rest[0].binding, 0u);
+  ASSERT_DOUBLE_EQ(rest[0].estimate, 50);
+}
+
+TEST_F(PlannerTest, DuplicatePredicatesCountOnce) {
+  QueryInfo query("0 1|0.0=1.0&1.0=0.0|0.0");
+  Planner planner(query, relations);
+  ASSERT_DOUBLE_EQ(planner.estimateJoin({0}, 1000, 1, 100), 100);
+}
+
+TEST_F(PlannerTest, DetectsCycles) {
+  ASSERT_FALSE(Planner(QueryInfo("0 1 2|0.0=1.0&1.1=2.1|0.0"), relations).isCyclic());
+  // Two predicates between the same bindings are no cycle
+  ASSERT_FALSE(Planner(QueryInfo("0 1|0.0=1.0&0.1=1.1|0.0"), relations).isCyclic());
+  ASSERT_TRUE(Planner(QueryInfo("0 1 2|0.0=1.0&1.1=2.1&2.2=0.2|0.0"), relations).isCyclic());
+}
+
+TEST(Planner, MultiwayJoinMatchesNestedLoops) {
+  Joiner joiner;
+  for (unsigned i = 0; i < 3; i++) {
+    joiner.addRelation(Utils::createZipfRelation(60, 2, 8, 0.8, i + 1));
+  }
+  auto &r = joiner.relations();
+  // Triangle 0.0=1.0, 1.1=2.0, 2.1=0.1 with a filter
+  uint64_t count = 0, sum = 0;
+  for (uint64_t a = 0; a < r[0].size(); ++a) {
+    for (uint64_t b = 0; b < r[1].size(); ++b) {
+      if (r[0].columns()[0][a] != r[1].columns()[0][b]) continue;
+      for (uint64_t c = 0; c < r[2].size(); ++c) {
+        if (r[1].columns()[1][b] != r[2].columns()[0][c]) continue;
+        if (r[2].columns()[1][c] != r[0].columns()[1][a]) continue;
+        if (r[2].columns()[1][c] >= 6) continue;
+        ++count;
+        sum += r[1].columns()[1][b];
+      }
+    }
+  }
+  ASSERT_GT(count, 0u);
+  QueryInfo query("0 1 2|0.0=1.0&1.1=2.0&2.1=0.1&2.1<6|1.1");
+  ASSERT_EQ(joiner.join(query), std::to_string(sum) + "\n");
+}
+
+TEST(Planner, CompositeKeyJoin) {
+  Joiner joiner;
+  for (unsigned i = 0; i < 2; i++) {
+    joiner.addRelation(Utils::createZipfRelation(200, 2, 6, 0.8, i + 1));
+  }
+  auto &r = joiner.relations();
+  uint64_t sum = 0;
+  for (uint64_t a = 0; a < r[0].size(); ++a) {
+    for (uint64_t b = 0; b < r[1].size(); ++b) {
+      if (r[0].columns()[0][a] == r[1].columns()[0][b] && r[0].columns()[1][a] == r[1].columns()[1][b]) {
+        sum += r[0].columns()[1][a];
+      }
+    }
+  }
+  ASSERT_GT(sum, 0u);
+  // Both predicates are one join, written twice and in either direction
+  QueryInfo query("0 1|0.0=1.0&1.1=0.1&0.0=1.0|0.1");
+  ASSERT_EQ(joiner.join(query), std::to_string(sum) + "\n");
+}
+
+TEST(Planner, NeedsReplan) {
+  ASSERT_FALSE(Planner::needsReplan(100, 100));
+  ASSERT_FALSE(Planner::needsReplan(100, 400));
+  ASSERT_TRUE(Planner::needsReplan(100, 401));
+  ASSERT_TRUE(Planner::needsReplan(100, 0));
+}
+
+TEST(Planner, AdaptiveJoinResults) {
+  Joiner joiner;
+  for (unsigned i = 0; i < 4; i++) {
+    joiner.addRelation(Utils::createRelation(10 * (i + 1), 3));
+  }
+  // Every order of the plan has to produce the same checksums
+  QueryInfo chain("0 1 2 3|0.0=1.1&1.2=2.0&2.1=3.2|3.0 0.1");
+  ASSERT_EQ(joiner.join(chain), "45 45\n");
+  QueryInfo filtered("3 2 1 0|0.0=1.1&1.2=2.0&2.1=3.2&0.0<5|3.0 0.1");
+  ASSERT_EQ(joiner.join(filtered), "10 10\n");
+  QueryInfo empty("0 1|0.0=1.1&1.2>100|0.0 1.0");
+  ASSERT_EQ(joiner.join(empty), "NULL NULL\n");
+}
+
+}
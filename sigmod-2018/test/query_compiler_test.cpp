@@ -0,0 +1,91 @@
+#include "gtest/gtest.h"
+
+#include <sstream>
+
+#include "joiner.h"
+#include "query_compiler.h"
+#include "rewriter.h"
+#include "utils.h"
+
+namespace {
+/// A joiner on three small relations
+std::unique_ptr<Joiner> makeJoiner() {
+  auto joiner = std::make_unique<Joiner>();
+  joiner->addRelation(Utils::createZipfRelation(2000, 3, 200, 0, 21));
+  joiner->addRelation(Utils::createZipfRelation(3000, 2, 200, 0, 22));
+  joiner->addRelation(Utils::createZipfRelation(1000, 2, 200, 0, 23));
+  return joiner;
+}
+
+/// Queries of three templates, each with several constants
+std::vector<std::string> templateQueries() {
+  std::vector<std::string> queries;
+  for (unsigned constant: {10, 50, 120, 199}) {
+    auto c = std::to_string(constant);
+    queries.push_back("0 1|0.0=1.0&0.1>" + c + "|0.2 1.1");
+    queries.push_back("0 1 2|0.0=1.0&1.1=2.0&2.1<" + c + "&0.2=" + std::to_string(constant % 7) + "|0.1 2.1 1.0");
+    // A self join with two predicates between the same bindings
+    queries.push_back("1 1 2|0.0=1.1&0.1=1.0&1.0=2.0&2.0>" + c + "|0.0 2.1");
+  }
+  return queries;
+}
+}
+
+TEST(QueryCompiler, CompiledResultsMatchInterpreter) {
+  auto interpreter = makeJoiner();
+  auto compiled = makeJoiner();
+  QueryCompiler::Options options;
+  options.hot_threshold = 1;
+  compiled->enableCompilation(options);
+  auto queries = templateQueries();
+  for (unsigned rep = 0; rep < 2; ++rep) {
+    for (auto &raw: queries) {
+      QueryInfo expected(raw), actual(raw);
+      ASSERT_EQ(compiled->join(actual), interpreter->join(expected)) << raw;
+    }
+    compiled->compiler()->wait();
+  }
+  ASSERT_EQ(compiled->compiler()->compiledTemplates(), 3u);
+  ASSERT_EQ(compiled->compiler()->failedTemplates(), 0u);
+  ASSERT_GE(compiled->compiler()->compiledRuns(), queries.size());
+}
+
+TEST(QueryCompiler, FailedCompilationStaysInterpreted) {
+  for (std::string command: {"false", "/nonexistent/compiler"}) {
+    auto interpreter = makeJoiner();
+    auto compiled = makeJoiner();
+    QueryCompiler::Options options;
+    options.hot_threshold = 1;
+    options.compiler = command;
+    compiled->enableCompilation(options);
+    auto queries = templateQueries();
+    for (unsigned rep = 0; rep < 2; ++rep) {
+      for (auto &raw: queries) {
+        QueryInfo expected(raw), actual(raw);
+        ASSERT_EQ(compiled->join(actual), interpreter->join(expected)) << command << " " << raw;
+      }
+      compiled->compiler()->wait();
+    }
+    ASSERT_EQ(compiled->compiler()->compiledTemplates(), 0u);
+    ASSERT_EQ(compiled->compiler()->failedTemplates(), 3u);
+    ASSERT_EQ(compiled->compiler()->compiledRuns(), 0u);
+  }
+}
+
+TEST(QueryCompiler, TemplatesIgnoreConstants) {
+  QueryInfo a("0 1|0.0=1.0&0.1>10|0.1"), b("0 1|0.0=1.0&0.1>20|0.1"), c("0 1|0.0=1.0&0.1<10|0.1");
+  ASSERT_TRUE(Rewriter::rewrite(a) && Rewriter::rewrite(b) && Rewriter::rewrite(c));
+  ASSERT_EQ(QueryCompiler::templateKey(a), QueryCompiler::templateKey(b));
+  ASSERT_NE(QueryCompiler::templateKey(a), QueryCompiler::templateKey(c));
+}
+
+TEST(QueryCompiler, GenerateRejectsUnplannableOrders) {
+  std::vector<std::pair<unsigned, unsigned>> slots;
+  QueryInfo chain("0 1 2|0.0=1.0&1.1=2.0|0.1");
+  ASSERT_TRUE(Rewriter::rewrite(chain));
+  ASSERT_NE(QueryCompiler::generate(chain, {0, 1, 2}, slots), "");
+  // Binding 2 is not connected to binding 0
+  ASSERT_EQ(QueryCompiler::generate(chain, {0, 2, 1}, slots), "");
+  // Not all bindings
+  ASSERT_EQ(QueryCompiler::generate(chain, {0, 1}, slots), "");
+}
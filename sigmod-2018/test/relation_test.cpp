@@ -1,7 +1,12 @@
+#include <algorithm>
+#include <atomic>
 #include <fstream>
+#include <sys/resource.h>
+#include <thread>
 
 #include "gtest/gtest.h"
 
+#include "joiner.h"
 #include "relation.h"
 #include "utils.h"
 
@@ -71,3 +76,118 @@ TEST(Relation, CreateSQL) {
   ASSERT_FALSE(std::getline(infile, line));
 }
 
+
+TEST(Relation, AppendKeepsColumnsInPlace) {
+  Relation r = Utils::createRelation(1000, 3);
+  ASSERT_THROW(r.append({r.columns()[0], r.columns()[1], r.columns()[2]}, 1), std::logic_error);
+  r.makeAppendable();
+  r.buildIndex();
+  auto columns = r.columns();
+
+  // Several segments at once, then a few rows at a time
+  std::vector<std::vector<uint64_t>> rows(3);
+  for (uint64_t i = 1000; i < 1000 + 3 * Relation::kSegmentRows; ++i) {
+    for (auto &column: rows) column.push_back(i);
+  }
+  r.append({rows[0].data(), rows[1].data(), rows[2].data()}, rows[0].size());
+  r.append({rows[0].data(), rows[1].data(), rows[2].data()}, 7);
+  ASSERT_THROW(r.append({rows[0].data()}, 1), std::invalid_argument);
+
+  uint64_t size = 1000 + 3 * Relation::kSegmentRows + 7;
+  ASSERT_EQ(r.size(), size);
+  ASSERT_EQ(r.columns(), columns);
+  for (uint64_t i = 0; i < size; ++i) {
+    ASSERT_EQ(columns[2][i], i < size - 7 ? i : 1000 + i - (size - 7));
+  }
+  // The index is kept up to date
+  ASSERT_EQ(r.match(1003, 1), (std::vector<TupleId>{1003, size - 4}));
+}
+
+TEST(Relation, PlainColumnsUnderAddressSpaceLimit) {
+  auto relation = Utils::createZipfRelation(5000, 2, 100, 0.5, 7);
+  relation.storeRelation("relation_limited");
+  std::string raw = "0 0|0.0=1.0&0.1>10|0.1 1.1";
+  Joiner unlimited;
+  unlimited.addRelation(Relation("relation_limited"));
+  QueryInfo query(raw);
+  auto expected = unlimited.join(query);
+
+  // Less address space than one reserved column, in a child process
+  auto limited = [&] {
+    rlimit limit{uint64_t(8) << 30, uint64_t(8) << 30};
+    setrlimit(RLIMIT_AS, &limit);
+    Relation loaded("relation_limited");
+    bool ok = !loaded.appendable() && loaded.size() == relation.size();
+    for (unsigned c = 0; c < 2; ++c) {
+      ok = ok && std::equal(loaded.columns()[c], loaded.columns()[c] + loaded.size(), relation.columns()[c]);
+    }
+    ok = ok && !Relation::allocate(10, 2).appendable() && !loaded.makeAppendable();
+    Joiner joiner;
+    joiner.addRelation(std::move(loaded));
+    QueryInfo again(raw);
+    ok = ok && joiner.join(again) == expected;
+    try {
+      std::vector<uint64_t> row{1};
+      joiner.appendRows(0, {row.data(), row.data()}, 1);
+      ok = false;
+    } catch (const std::logic_error &) {
+    }
+    return ok;
+  };
+  ASSERT_EXIT(exit(limited() ? 0 : 1), ::testing::ExitedWithCode(0), "");
+  std::remove("relation_limited");
+}
+
+TEST(Relation, QueriesSeeSnapshots) {
+  // The first rows of one relation, so the snapshots are prefixes of each other
+  auto all = Utils::createZipfRelation(30000, 2, 100, 0.5, 1);
+  auto make_relations = [&](uint64_t rows) {
+    std::vector<Relation> relations;
+    relations.push_back(Utils::createRelation(rows, 2));
+    for (unsigned c = 0; c < 2; ++c) {
+      std::copy(all.columns()[c], all.columns()[c] + rows, relations[0].columns()[c]);
+    }
+    relations.push_back(Utils::createZipfRelation(5000, 2, 100, 0.5, 2));
+    return relations;
+  };
+  std::string raw = "0 1|0.0=1.0&0.1>10|0.1 1.1";
+  auto expected = [&](uint64_t rows) {
+    Joiner joiner;
+    for (auto &relation: make_relations(rows)) joiner.addRelation(std::move(relation));
+    QueryInfo query(raw);
+    return joiner.join(query);
+  };
+
+  Joiner joiner;
+  joiner.setNumThreads(2);
+  for (auto &relation: make_relations(10000)) joiner.addRelation(std::move(relation));
+  auto columns = all.columns();
+  QueryInfo before(raw);
+  ASSERT_EQ(joiner.join(before), expected(10000));
+
+  // The build tables of the first query are still cached, the ones of the
+  // old snapshot must not be used
+  joiner.appendRows(0, {columns[0] + 10000, columns[1] + 10000}, 20000);
+  ASSERT_EQ(joiner.getRelation(0).size(), 30000);
+  QueryInfo after(raw);
+  ASSERT_EQ(joiner.join(after), expected(30000));
+
+  // Rows that never match, appended while queries run, change nothing
+  std::vector<uint64_t> unmatched(1000, 1u << 30);
+  std::atomic<bool> done{false};
+  std::thread appender([&] {
+    for (unsigned i = 0; i < 200; ++i) {
+      joiner.appendRows(0, {unmatched.data(), unmatched.data()}, unmatched.size());
+      std::this_thread::yield();
+    }
+    done.store(true);
+  });
+  auto four = expected(30000) + expected(30000) + expected(30000) + expected(30000);
+  do {
+    std::vector<QueryInfo> batch(4, QueryInfo(raw));
+    std::ostringstream results;
+    joiner.runBatch(batch, results);
+    EXPECT_EQ(results.str(), four);
+  } while (!done.load());
+  appender.join();
+}
@@ -0,0 +1,70 @@
+#include "gtest/gtest.h"
+
+#include "joiner.h"
+#include "rewriter.h"
+#include "utils.h"
+
+TEST(Rewriter, PropagatesEqualityOverJoins) {
+  QueryInfo i("0 1 2|0.1=1.2&1.2=2.0&0.1=5|0.0");
+  ASSERT_TRUE(Rewriter::rewrite(i));
+  ASSERT_EQ(i.dumpText(), "0 1 2|0.1=1.2&1.2=2.0&0.1=5&1.2=5&2.0=5|0.0");
+}
+
+TEST(Rewriter, TightensRanges) {
+  QueryInfo i("0 1|0.0=1.0&0.0>3&1.0<10&0.0>5|0.1");
+  ASSERT_TRUE(Rewriter::rewrite(i));
+  ASSERT_EQ(i.dumpText(), "0 1|0.0=1.0&0.0>5&0.0<10&1.0>5&1.0<10|0.1");
+
+  // A range of one value is an equality, which is ordered first
+  QueryInfo single("0 1|0.0=1.0&1.1>2&0.0>3&1.0<5|0.1");
+  ASSERT_TRUE(Rewriter::rewrite(single));
+  ASSERT_EQ(single.dumpText(), "0 1|0.0=1.0&0.0=4&1.0=4&1.1>2|0.1");
+}
+
+TEST(Rewriter, RemovesRedundantPredicates) {
+  QueryInfo i("0 1 2|0.0=1.0&1.0=0.0&1.0=2.0&2.0=0.0&0.1=1.1|0.0");
+  ASSERT_TRUE(Rewriter::rewrite(i));
+  ASSERT_EQ(i.dumpText(), "0 1 2|0.0=1.0&1.0=2.0&0.1=1.1|0.0");
+}
+
+TEST(Rewriter, DetectsContradictions) {
+  QueryInfo equal("0 1|0.0=1.0&0.0=1&1.0=2|0.0");
+  ASSERT_FALSE(Rewriter::rewrite(equal));
+  QueryInfo range("0 1|0.0=1.0&0.0>5&1.0<6|0.0");
+  ASSERT_FALSE(Rewriter::rewrite(range));
+  QueryInfo less("0 1|0.0=1.0&0.1<0|0.0");
+  ASSERT_FALSE(Rewriter::rewrite(less));
+
+  Joiner joiner;
+  joiner.addRelation(Utils::createRelation(10, 2));
+  joiner.addRelation(Utils::createRelation(10, 2));
+  QueryInfo query("0 1|0.0=1.0&0.0>5&1.0<6|0.0 1.1");
+  ASSERT_EQ(joiner.join(query), "NULL NULL\n");
+}
+
+TEST(Rewriter, SameResults) {
+  Joiner joiner;
+  for (unsigned i = 0; i < 3; i++) {
+    joiner.addRelation(Utils::createRelation(10 * (i + 1), 3));
+  }
+  QueryInfo pushed("0 1 2|0.0=1.1&1.1=2.2&2.2>2&1.1<7|0.1 2.0");
+  ASSERT_EQ(joiner.join(pushed), "18 18\n");
+  QueryInfo equal("0 1 2|0.0=1.1&1.2=2.0&0.0=4|1.2 2.1");
+  ASSERT_EQ(joiner.join(equal), "4 4\n");
+}
+
+TEST(Rewriter, DropsSelfEquality) {
+  QueryInfo i("0|0.0=0.0&0.1<5|0.1");
+  ASSERT_TRUE(Rewriter::rewrite(i));
+  ASSERT_EQ(i.dumpText(), "0|0.1<5|0.1");
+
+  // Without predicates the query is the filtered scan of its binding
+  Joiner joiner;
+  joiner.addRelation(Utils::createRelation(1000, 3));
+  QueryInfo equal("0|0.0=0.0|0.1 0.2");
+  ASSERT_EQ(joiner.join(equal), "499500 499500\n");
+  QueryInfo filtered("0|0.0=0.0&0.1<100|0.2");
+  ASSERT_EQ(joiner.join(filtered), "4950\n");
+  QueryInfo none("0|0.0=0.0&0.1>5000|0.2");
+  ASSERT_EQ(joiner.join(none), "NULL\n");
+}
@@ -0,0 +1,167 @@
+#include "gtest/gtest.h"
+
+#include <algorithm>
+#include <cstring>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#include "server.h"
+#include "utils.h"
+
+namespace {
+/// Connect to the server at path
+int connectTo(const std::string &path) {
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  std::strcpy(address.sun_path, path.c_str());
+  EXPECT_EQ(connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)), 0);
+  return fd;
+}
+
+/// Send the text and read until the given number of lines arrived
+std::string request(int fd, const std::string &text, unsigned lines) {
+  EXPECT_EQ(write(fd, text.data(), text.size()), ssize_t(text.size()));
+  std::string response;
+  char chunk[256];
+  while (std::count(response.begin(), response.end(), '\n') < lines) {
+    ssize_t res = read(fd, chunk, sizeof(chunk));
+    if (res <= 0) break;
+    response.append(chunk, res);
+  }
+  return response;
+}
+
+/// A joiner with two small relations
+std::unique_ptr<Joiner> makeJoiner() {
+  auto joiner = std::make_unique<Joiner>();
+  joiner->addRelation(Utils::createZipfRelation(20000, 3, 100, 0.5, 1));
+  joiner->addRelation(Utils::createZipfRelation(5000, 2, 100, 0.5, 2));
+  return joiner;
+}
+
+/// The expected result of a query
+std::string expected(const std::string &raw) {
+  QueryInfo query(raw);
+  return makeJoiner()->join(query);
+}
+}
+
+TEST(Server, ConcurrentSessions) {
+  auto path = "/tmp/sigmod-server-test-" + std::to_string(getpid()) + ".sock";
+  auto joiner = makeJoiner();
+  joiner->setNumThreads(2);
+  Server server(*joiner, path);
+  server.start();
+
+  std::vector<std::string> queries{
+      "0 1|0.0=1.0|0.1 1.1",
+      "0 0|0.0=1.1&0.2<50|1.0 0.1",
+      "1 0|0.1=1.0|0.0 1.2",
+      "0 1|0.0=1.0&0.1>20|0.0 1.1",
+  };
+  // Every session sends two batches of the queries in its own order, so the
+  // results are only right if they are kept apart
+  auto session = [&](unsigned shift) {
+    int fd = connectTo(path);
+    for (unsigned batch = 0; batch < 2; ++batch) {
+      std::string text, answer;
+      for (unsigned i = 0; i < queries.size(); ++i) {
+        auto &raw = queries[(i + shift + batch) % queries.size()];
+        text += raw + "\n";
+        answer += expected(raw);
+      }
+      EXPECT_EQ(request(fd, text + "F\n", queries.size()), answer);
+    }
+    close(fd);
+  };
+  std::vector<std::thread> clients;
+  for (unsigned shift = 0; shift < 3; ++shift) clients.emplace_back(session, shift);
+  for (auto &client: clients) client.join();
+
+  // A session that is still connected is disconnected by stop()
+  int idle = connectTo(path);
+  ASSERT_EQ(request(idle, "1 1|0.0=1.1|0.0\nF\n", 1), expected("1 1|0.0=1.1|0.0"));
+  server.stop();
+  char byte;
+  ASSERT_EQ(read(idle, &byte, 1), 0);
+  close(idle);
+  ASSERT_NE(access(path.c_str(), F_OK), 0);
+}
+
+TEST(Server, RunBatchMatchesPrintCheckSum) {
+  auto joiner = makeJoiner();
+  joiner->setNumThreads(2);
+  std::vector<std::string> raws{"0 1|0.0=1.0|0.1 1.1", "1 1|0.0=1.1|0.0", "0 1|0.0=1.0&0.1>20|0.0 1.1"};
+  std::vector<QueryInfo> queries;
+  for (auto &raw: raws) {
+    queries.emplace_back(raw);
+    joiner->scheduleQuery(QueryInfo(raw));
+  }
+  std::ostringstream batch, scheduled;
+  joiner->runBatch(queries, batch);
+  joiner->printCheckSum(scheduled);
+  ASSERT_EQ(batch.str(), scheduled.str());
+}
+
+TEST(Server, BadQueriesKeepTheSessions) {
+  auto path = "/tmp/sigmod-server-test-bad-" + std::to_string(getpid()) + ".sock";
+  auto joiner = makeJoiner();
+  joiner->setNumThreads(2);
+  Server server(*joiner, path);
+  server.start();
+
+  int bad = connectTo(path);
+  int good = connectTo(path);
+  std::string valid = "0 1|0.0=1.0|0.1 1.1";
+  // An unknown relation, column and binding, and syntax errors between valid queries
+  auto response = request(bad, valid + "\n0 99|0.0=1.0|0.0\n0 1|0.7=1.0|0.0\n0 1|0.0=2.0|0.0\n"
+                               "0 1|0.0=1.x|0.0\nnonsense\n0 1|0.0=1.0\n" + valid + "\nF\n", 8);
+  std::istringstream lines(response);
+  std::string line;
+  for (unsigned i = 0; i < 8; ++i) {
+    ASSERT_TRUE(getline(lines, line)) << response;
+    if (i == 0 || i == 7) {
+      ASSERT_EQ(line + "\n", expected(valid));
+    } else {
+      ASSERT_EQ(line.rfind("ERROR ", 0), 0u) << line;
+    }
+  }
+  // Both sessions go on
+  ASSERT_EQ(request(bad, valid + "\nF\n", 1), expected(valid));
+  ASSERT_EQ(request(good, valid + "\nF\n", 1), expected(valid));
+  close(bad);
+  close(good);
+  server.stop();
+}
+
+TEST(Server, QueriesWithoutJoinsAreErrors) {
+  auto path = "/tmp/sigmod-server-test-nojoin-" + std::to_string(getpid()) + ".sock";
+  auto joiner = makeJoiner();
+  joiner->setNumThreads(2);
+  Server server(*joiner, path);
+  server.start();
+
+  int fd = connectTo(path);
+  int other = connectTo(path);
+  std::string valid = "0 1|0.0=1.0|0.1 1.1";
+  // Only a filter, and a binding that is not joined
+  auto response = request(fd, "0|0.1=5|0.0\n0 1|0.0=0.1|0.0\n" + valid + "\nF\n", 3);
+  std::istringstream lines(response);
+  std::string line;
+  for (unsigned i = 0; i < 2; ++i) {
+    ASSERT_TRUE(getline(lines, line)) << response;
+    ASSERT_EQ(line.rfind("ERROR ", 0), 0u) << line;
+  }
+  ASSERT_TRUE(getline(lines, line)) << response;
+  ASSERT_EQ(line + "\n", expected(valid));
+  // The server keeps serving
+  ASSERT_EQ(request(fd, valid + "\nF\n", 1), expected(valid));
+  ASSERT_EQ(request(other, valid + "\nF\n", 1), expected(valid));
+  close(fd);
+  close(other);
+  server.stop();
+}
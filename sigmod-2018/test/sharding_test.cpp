@@ -0,0 +1,88 @@
+#include "gtest/gtest.h"
+
+#include <sstream>
+
+#include "joiner.h"
+#include "sharding.h"
+#include "utils.h"
+
+namespace {
+/// A joiner on three small relations
+std::unique_ptr<Joiner> makeJoiner() {
+  auto joiner = std::make_unique<Joiner>();
+  joiner->addRelation(Utils::createZipfRelation(3000, 3, 300, 0, 31));
+  joiner->addRelation(Utils::createZipfRelation(2000, 2, 300, 0, 32));
+  joiner->addRelation(Utils::createZipfRelation(1000, 2, 300, 0, 33));
+  return joiner;
+}
+
+const std::vector<std::string> kQueries{
+    "0 1|0.0=1.0&0.1>10|0.2 1.1",
+    "0 1 2|0.0=1.0&1.1=2.0&2.1<200|0.1 2.1 1.0",
+    // Joined on other columns than the partition columns
+    "0 2|0.1=1.1&0.2<100|0.0 1.0",
+    // A self join and a cycle
+    "0 0 1|0.0=1.0&1.1=2.0&0.1<50|0.2 1.2",
+    "0 1 2|0.0=1.0&1.0=2.0&0.1=2.1|0.0 2.1",
+    // Empty in every partition
+    "0 1|0.0=1.0&0.1>1000|0.1",
+};
+
+/// Run the queries as one batch
+std::string runBatch(Joiner &joiner, const std::vector<std::string> &queries) {
+  for (auto &raw: queries) joiner.scheduleQuery(QueryInfo(raw));
+  std::ostringstream out;
+  joiner.printCheckSum(out);
+  return out.str();
+}
+}
+
+TEST(Sharding, PartitionColumnsAreTheMostJoined) {
+  auto joiner = makeJoiner();
+  std::vector<QueryInfo> queries{QueryInfo("0 1|0.1=1.0|0.0"), QueryInfo("0 1 1|0.1=1.1&0.1=2.0|0.0")};
+  auto columns = ShardedExecutor::partitionColumns(joiner->relations(), queries);
+  ASSERT_EQ(columns, (std::vector<unsigned>{1, 0, 0}));
+}
+
+TEST(Sharding, PartitionedBindingsShareKeys) {
+  auto joiner = makeJoiner();
+  std::vector<unsigned> columns{0, 0, 0};
+  // 0.0=1.0 is on partition columns, 1.1=2.0 is not
+  auto partitioned = ShardedExecutor::partitionedBindings(QueryInfo("0 1 2|0.0=1.0&1.1=2.0|0.0"), columns,
+                                                          joiner->relations());
+  ASSERT_EQ(partitioned, (std::vector<bool>{true, true, false}));
+  // Nothing joined on partition columns, the largest binding is split
+  partitioned = ShardedExecutor::partitionedBindings(QueryInfo("2 0|0.1=1.1|0.0"), columns, joiner->relations());
+  ASSERT_EQ(partitioned, (std::vector<bool>{false, true}));
+}
+
+TEST(Sharding, ResultsMatchThreads) {
+  auto threads = makeJoiner();
+  threads->setNumThreads(2);
+  auto expected = runBatch(*threads, kQueries);
+  for (unsigned workers: {1, 3}) {
+    auto sharded = makeJoiner();
+    ShardedExecutor::Options options;
+    options.workers = workers;
+    sharded->enableSharding(options);
+    // Twice: the second batch reuses the running workers
+    ASSERT_EQ(runBatch(*sharded, kQueries), expected) << workers;
+    ASSERT_EQ(runBatch(*sharded, kQueries), expected) << workers;
+  }
+}
+
+TEST(Sharding, AppendedRowsRepartition) {
+  auto threads = makeJoiner();
+  threads->setNumThreads(2);
+  auto sharded = makeJoiner();
+  ShardedExecutor::Options options;
+  options.workers = 2;
+  sharded->enableSharding(options);
+  ASSERT_EQ(runBatch(*sharded, kQueries), runBatch(*threads, kQueries));
+
+  std::vector<uint64_t> keys{1, 2, 3, 5, 8}, values{5, 15, 25, 35, 45};
+  for (auto *joiner: {threads.get(), sharded.get()}) {
+    joiner->appendRows(1, {keys.data(), values.data()}, keys.size());
+  }
+  ASSERT_EQ(runBatch(*sharded, kQueries), runBatch(*threads, kQueries));
+}
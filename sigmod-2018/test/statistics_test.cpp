@@ -0,0 +1,122 @@
+#include "gtest/gtest.h"
+
+#include <cmath>
+#include <unordered_map>
+
+#include "planner.h"
+#include "statistics.h"
+#include "utils.h"
+
+TEST(Statistics, HyperLogLogCountsDistinctValues) {
+  for (uint64_t distinct: {10ull, 1000ull, 200000ull}) {
+    HyperLogLog hll;
+    for (uint64_t i = 0; i < 3 * distinct; ++i) hll.add(i % distinct);
+    ASSERT_NEAR(hll.estimate() / distinct, 1.0, 0.05) << distinct;
+  }
+}
+
+TEST(Statistics, SampleIsAlignedAcrossColumns) {
+  // Column 1 is twice column 0 in every row
+  uint64_t rows = 100000;
+  auto relation = Utils::createZipfRelation(rows, 2, 1000, 0, 7);
+  for (uint64_t i = 0; i < rows; ++i) {
+    relation.columns()[1][i] = relation.columns()[0][i] * 2;
+  }
+  RelationStatistics stats(relation);
+  ASSERT_EQ(stats.rows(), rows);
+  ASSERT_EQ(stats.sampleSize(), RelationStatistics::kSampleSize);
+  for (uint64_t i = 0; i < stats.sampleSize(); ++i) {
+    ASSERT_EQ(stats.sample(1)[i], stats.sample(0)[i] * 2);
+  }
+  ASSERT_NEAR(stats.distinct(0), 1000, 50);
+  // Never more distinct values than rows
+  RelationStatistics tiny(Utils::createRelation(5, 1));
+  ASSERT_LE(tiny.distinct(0), 5);
+}
+
+TEST(Statistics, AppendedRows) {
+  auto full = Utils::createZipfRelation(50000, 2, 5000, 0, 3);
+  Relation relation = Utils::createRelation(0, 2);
+  relation.makeAppendable();
+  Statistics statistics;
+  statistics.addRelation(relation);
+  auto before = statistics;
+
+  // In pieces smaller and larger than the sample
+  for (uint64_t begin = 0; begin < full.size();) {
+    uint64_t count = std::min<uint64_t>(full.size() - begin, begin < 5000 ? 300 : 7000);
+    relation.append({full.columns()[0] + begin, full.columns()[1] + begin}, count);
+    auto stats = std::make_shared<RelationStatistics>(statistics.relation(0));
+    stats->append(relation, begin, begin + count);
+    statistics.replace(0, std::move(stats));
+    begin += count;
+  }
+  // A copy keeps the statistics it was taken with
+  ASSERT_EQ(before.relation(0).rows(), 0);
+
+  auto &stats = statistics.relation(0);
+  RelationStatistics rebuilt(full);
+  ASSERT_EQ(stats.rows(), full.size());
+  ASSERT_EQ(stats.sampleSize(), RelationStatistics::kSampleSize);
+  // The sketches see the same values either way
+  ASSERT_EQ(stats.distinct(0), rebuilt.distinct(0));
+  ASSERT_EQ(stats.distinct(1), rebuilt.distinct(1));
+  // The sampled rows are rows of the relation, aligned across the columns
+  std::unordered_map<uint64_t, uint64_t> pairs;
+  for (uint64_t i = 0; i < full.size(); ++i) pairs[full.columns()[0][i] * 5000 + full.columns()[1][i]]++;
+  for (uint64_t i = 0; i < stats.sampleSize(); ++i) {
+    ASSERT_TRUE(pairs.count(stats.sample(0)[i] * 5000 + stats.sample(1)[i]));
+  }
+  // And still a uniform sample: about half of them below the median
+  std::vector<FilterInfo> filters{FilterInfo(SelectInfo(0, 0, 0), 2500, FilterInfo::Comparison::Less)};
+  ASSERT_NEAR(statistics.filterSelectivity(0, filters), 0.5, 0.06);
+}
+
+TEST(Statistics, FilterAndJoinSelectivity) {
+  Statistics statistics;
+  auto uniform = Utils::createZipfRelation(100000, 2, 1000, 0, 1);
+  auto small = Utils::createZipfRelation(500, 2, 50, 0, 2);
+  statistics.addRelation(uniform);
+  statistics.addRelation(small);
+
+  std::vector<FilterInfo> filters{FilterInfo(SelectInfo(0, 0, 0), 250, FilterInfo::Comparison::Less)};
+  ASSERT_NEAR(statistics.filterSelectivity(0, filters), 0.25, 0.05);
+  // Rarer than a sampled row, but not impossible
+  filters = {FilterInfo(SelectInfo(0, 0, 0), 1000000, FilterInfo::Comparison::Greater)};
+  ASSERT_GT(statistics.filterSelectivity(0, filters), 0);
+  ASSERT_LT(statistics.filterSelectivity(0, filters), 1.0 / RelationStatistics::kSampleSize);
+
+  // The exact selectivity of a self join of the small relation, which is
+  // sampled completely, counts every row paired with itself
+  std::unordered_map<uint64_t, uint64_t> counts;
+  for (uint64_t i = 0; i < small.size(); ++i) ++counts[small.columns()[0][i]];
+  double pairs = 0;
+  for (auto &[value, count]: counts) pairs += static_cast<double>(count) * count;
+  ASSERT_NEAR(statistics.joinSelectivity(1, {}, 1, {}, {{0, 0}}), pairs / (500.0 * 500.0), 1e-9);
+
+  // About 1 / 1000 for a uniform domain of 1000 values
+  double selectivity = statistics.joinSelectivity(0, {}, 0, {}, {{0, 0}});
+  ASSERT_NEAR(selectivity * 1000, 1.0, 0.3);
+  // Two independent uniform columns almost never match in the sample
+  ASSERT_LT(statistics.joinSelectivity(0, {}, 0, {}, {{0, 0}, {1, 1}}), 0);
+}
+
+TEST(Statistics, PlannerUsesStatistics) {
+  // Column 0 of relation 0 has a single value, distinct counts tell the
+  // planner its joins are cross products
+  auto constant = Utils::createZipfRelation(1000, 1, 1, 0, 3);
+  auto keys = Utils::createZipfRelation(1000, 1, 1000, 0, 4);
+  Statistics statistics;
+  statistics.addRelation(constant);
+  statistics.addRelation(keys);
+  std::vector<const Relation *> relations{&constant, &keys};
+  QueryInfo query("0 1|0.0=1.0|0.0");
+
+  Planner planner(query, relations, &statistics);
+  double matches = 0;
+  for (uint64_t i = 0; i < keys.size(); ++i) matches += keys.columns()[0][i] == constant.columns()[0][0];
+  double estimate = planner.estimateJoin({0}, 1000, 1, 1000);
+  ASSERT_NEAR(estimate / (1000 * matches), 1.0, 0.5);
+  // The defaults assume a key join
+  ASSERT_DOUBLE_EQ(Planner(query, relations).estimateJoin({0}, 1000, 1, 1000), 1000);
+}
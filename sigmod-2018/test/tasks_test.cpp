@@ -0,0 +1,81 @@
+#include "gtest/gtest.h"
+
+#include <atomic>
+#include <sstream>
+#include <thread>
+
+#include "joiner.h"
+#include "planner.h"
+#include "tasks.h"
+#include "utils.h"
+
+namespace {
+
+// Runs every task on a new thread
+class ThreadRunner : public TaskRunner {
+ public:
+  std::vector<std::thread> threads;
+
+  void submit(std::function<void()> task) override {
+    threads.emplace_back(std::move(task));
+  }
+
+  ~ThreadRunner() override {
+    for (auto &t: threads) t.join();
+  }
+};
+
+}
+
+TEST(Tasks, ParallelForRunsAllChunks) {
+  ThreadRunner runner;
+  std::vector<std::atomic<unsigned>> runs(100);
+  parallelFor(&runner, 4, runs.size(), [&](unsigned chunk) { ++runs[chunk]; });
+  ASSERT_EQ(runner.threads.size(), 3u);
+  for (auto &r: runs) ASSERT_EQ(r.load(), 1u);
+
+  // Without a runner everything runs on the caller
+  unsigned count = 0;
+  parallelFor(nullptr, 4, 10, [&](unsigned) { ++count; });
+  ASSERT_EQ(count, 10u);
+}
+
+TEST(Tasks, EstimatedCost) {
+  Relation small = Utils::createRelation(10, 2);
+  Relation large = Utils::createRelation(100000, 2);
+  std::vector<const Relation *> relations{&small, &large};
+  QueryInfo cheap("0 1|0.0=1.0&1.1<5|0.0");
+  QueryInfo expensive("0 1|0.0=1.0|0.0");
+  ASSERT_LT(Planner(cheap, relations).estimateCost(), Planner(expensive, relations).estimateCost());
+}
+
+TEST(Tasks, ParallelJoinMatchesSerial) {
+  Joiner joiner;
+  joiner.addRelation(Utils::createZipfRelation(200000, 2, 50000, 0.3, 1));
+  joiner.addRelation(Utils::createZipfRelation(300000, 2, 50000, 0.3, 2));
+  joiner.setNumThreads(4);
+  std::string raw("0 1|0.0=1.0|0.1 1.1");
+  QueryInfo serial(raw), parallel(raw);
+  QueryResult result;
+  joiner.join(parallel, result, 4);
+  std::string text;
+  result.format(text);
+  ASSERT_EQ(text, joiner.join(serial));
+}
+
+TEST(Tasks, LongestQueriesFirst) {
+  Joiner joiner;
+  joiner.addRelation(Utils::createRelation(10, 2));
+  joiner.addRelation(Utils::createRelation(100000, 2));
+  joiner.setNumThreads(2);
+  // The results stay in query order whatever order the queries run in
+  std::string expected;
+  for (auto raw: {"0 0|0.0=1.0|0.0", "1 1|0.0=1.0|0.1", "0 1|0.0=1.0|1.1"}) {
+    QueryInfo query(raw);
+    expected += joiner.join(query);
+    joiner.scheduleQuery(QueryInfo(raw));
+  }
+  std::ostringstream out;
+  joiner.printCheckSum(out);
+  ASSERT_EQ(out.str(), expected);
+}